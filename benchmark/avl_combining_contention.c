@@ -0,0 +1,248 @@
+// Benchmark: throughput of the AVL shared by flat combining
+// (tree-avl-combining.h) against the AVL behind one mutex and behind one
+// reader-writer lock (tree-avl-sync.h).
+//
+// Build from the benchmark directory:
+//   gcc avl_combining_contention.c -o avl_combining_contention -O2 -lm -pthread
+// Run (optionally with the largest thread count, default 64):
+//   ./avl_combining_contention [THREADS_MAX]
+//
+// Each run starts from a tree holding half of KEY_RANGE random keys, then
+// every thread runs random operations on random keys for RUN_MS: searches,
+// insertions and removals in the proportions of the mix. An insertion adds
+// a copy even of a present key (tree_insert_sorted()), the same in the
+// three trees. KEY_RANGE is small so that the tree fits in the cache and
+// the time goes to the hand-offs of the lock rather than to the tree. The
+// output is the total number of operations per microsecond, for 1, 2,
+// 4... threads.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // writer-preferring lock of the sync tree
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-avl/tree-avl.c"
+#include "../src/tree-avl/tree-avl-handle.c"
+#include "../src/tree-avl/tree-avl-sync.c"
+#include "../src/tree-avl/tree-avl-combining.c"
+
+// --- CONFIGURATION ---
+#define KEY_RANGE 4096
+#define THREADS_MAX 64
+#define RUN_MS 500
+
+typedef struct {
+    const char *name;
+    int search; // percent of searches, the rest split between
+                // insertions and removals
+} Mix;
+
+static const Mix mixes[] = {
+    { "90/5/5", 90 },
+    { "50/25/25", 50 },
+    { "0/50/50", 0 },
+};
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// Per-thread generator (xorshift), rand() would serialize the threads
+unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// --- TREES ---
+
+// The plain mutex wrapper: one lock for every operation, the nodes from a
+// slab like in the two other trees
+typedef struct {
+    pthread_mutex_t lock;
+    TreeSlab *slab;
+    TreeHandle handle;
+} MutexTree;
+
+typedef struct {
+    MutexTree *mutex;
+    SyncTree sync;
+    CombiningTree combining;
+} Trees;
+
+// --- WORKERS ---
+
+typedef struct {
+    Trees *trees;
+    int search;
+    unsigned seed;
+    atomic_bool *stop;
+    long operations;
+} Worker;
+
+void *run_mutex(void *arg) {
+    Worker *worker = arg;
+    MutexTree *tree = worker->trees->mutex;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+        int op = (r >> 24) % 100;
+
+        pthread_mutex_lock(&tree->lock);
+        if (op < worker->search)
+            tree_handle_search(tree->handle, &key);
+        else if ((op - worker->search) % 2 == 0)
+            tree_handle_insert(tree->handle, &key);
+        else
+            tree_handle_remove(tree->handle, &key);
+        pthread_mutex_unlock(&tree->lock);
+        operations++;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+void *run_sync(void *arg) {
+    Worker *worker = arg;
+    SyncTree sync = worker->trees->sync;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+        int op = (r >> 24) % 100, found;
+
+        if (op < worker->search)
+            sync_tree_search(sync, &key, &found);
+        else if ((op - worker->search) % 2 == 0)
+            sync_tree_insert(sync, &key);
+        else
+            sync_tree_remove(sync, &key);
+        operations++;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+void *run_combining(void *arg) {
+    Worker *worker = arg;
+    CombiningSlot slot = combining_tree_slot_new(worker->trees->combining);
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+        int op = (r >> 24) % 100, found;
+
+        if (op < worker->search)
+            combining_tree_search(slot, &key, &found);
+        else if ((op - worker->search) % 2 == 0)
+            combining_tree_insert(slot, &key);
+        else
+            combining_tree_remove(slot, &key);
+        operations++;
+    }
+    combining_tree_slot_delete(slot);
+    worker->operations = operations;
+    return NULL;
+}
+
+// Operations per microsecond of n threads running func for RUN_MS
+double run(void *(*func)(void *), Trees *trees, int search, int n) {
+    pthread_t threads[THREADS_MAX];
+    Worker workers[THREADS_MAX];
+    atomic_bool stop = false;
+    struct timespec start_ts, end_ts, pause = { 0, RUN_MS * 1000000L };
+    long operations = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < n; i++) {
+        unsigned seed = 2463534242u + i * 7919;
+
+        workers[i] = (Worker){ trees, search, seed, &stop, 0 };
+        if (pthread_create(&threads[i], NULL, func, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        operations += workers[i].operations;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    return operations / (get_time_ms(&start_ts, &end_ts) * 1000.0);
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int threads_max = argc > 1 ? atoi(argv[1]) : THREADS_MAX;
+
+    if (threads_max < 1 || threads_max > THREADS_MAX)
+        threads_max = THREADS_MAX;
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+
+    printf("Mix (search/insert/remove), Threads, Mutex (ops/us), "
+           "Reader-writer lock (ops/us), Flat combining (ops/us)\n");
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+        for (int n = 1; n <= threads_max; n *= 2) {
+            MutexTree mutex = { PTHREAD_MUTEX_INITIALIZER,
+                                tree_slab_new(sizeof(int)), NULL };
+            Trees trees = { &mutex, sync_tree_new(sizeof(int), cmpInt),
+                            combining_tree_new(sizeof(int), cmpInt) };
+            CombiningSlot slot = combining_tree_slot_new(trees.combining);
+
+            mutex.handle = tree_handle_new(sizeof(int), cmpInt, mutex.slab);
+
+            // Same initial keys in the three trees, in the same order
+            for (int i = 0; i < KEY_RANGE / 2; i++) {
+                int key = rand() % KEY_RANGE;
+                bool inserted;
+
+                tree_handle_insert_unique(mutex.handle, &key, &inserted);
+                if (inserted) {
+                    sync_tree_insert(trees.sync, &key);
+                    combining_tree_insert(slot, &key);
+                }
+            }
+            combining_tree_slot_delete(slot);
+
+            double mutex_ops = run(run_mutex, &trees, mixes[m].search, n);
+            double sync_ops = run(run_sync, &trees, mixes[m].search, n);
+            double combining_ops = run(run_combining, &trees,
+                                       mixes[m].search, n);
+            printf("%s, %d, %.2f, %.2f, %.2f\n", mixes[m].name, n,
+                   mutex_ops, sync_ops, combining_ops);
+
+            tree_handle_delete(mutex.handle, NULL);
+            tree_slab_delete(mutex.slab);
+            sync_tree_delete(trees.sync, NULL);
+            combining_tree_delete(trees.combining, NULL);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Benchmark: throughput of the concurrent AVL (tree-avl-concurrent.h)
+// against the AVL behind one reader-writer lock (tree-avl-sync.h).
+//
+// Build from the benchmark directory:
+//   gcc avl_concurrent_throughput.c -o avl_concurrent_throughput -O2 -lm -pthread
+// Run (optionally with the largest thread count, default 64):
+//   ./avl_concurrent_throughput [THREADS_MAX]
+//
+// Each run starts from a tree holding half of KEY_RANGE random keys, then
+// every thread runs random operations on random keys for RUN_MS: searches,
+// insertions and removals in the proportions of the mix, so the tree keeps
+// its size. The output is the total number of operations per microsecond,
+// for 1, 2, 4... threads. Threads beyond the number of cores only add
+// preemption: a thread preempted while it holds the global lock stops all
+// the others, one preempted in the concurrent tree holds at most a few
+// nodes.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // writer-preferring lock of the sync tree
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-avl/tree-avl.c"
+#include "../src/tree-avl/tree-avl-handle.c"
+#include "../src/tree-avl/tree-avl-sync.c"
+#include "../src/tree-avl/tree-avl-concurrent.c"
+
+// --- CONFIGURATION ---
+#define KEY_RANGE 1000000
+#define THREADS_MAX 64
+#define RUN_MS 500
+
+typedef struct {
+    const char *name;
+    int search; // percent of searches, the rest split between
+                // insertions and removals
+} Mix;
+
+static const Mix mixes[] = {
+    { "100/0/0", 100 },
+    { "90/5/5", 90 },
+    { "50/25/25", 50 },
+};
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// Per-thread generator (xorshift), rand() would serialize the threads
+unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// The values of the concurrent tree: any non-NULL pointer
+int values[KEY_RANGE];
+
+// --- WORKERS ---
+
+typedef struct {
+    SyncTree sync;
+    ConcurrentTree concurrent;
+    int search;
+    unsigned seed;
+    atomic_bool *stop;
+    long operations;
+} Worker;
+
+void *run_sync(void *arg) {
+    Worker *worker = arg;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+        int op = (r >> 24) % 100, found;
+
+        if (op < worker->search)
+            sync_tree_search(worker->sync, &key, &found);
+        else if ((op - worker->search) % 2 == 0) {
+            TreeHandle handle = sync_tree_write_begin(worker->sync);
+            tree_handle_insert_unique(handle, &key, NULL);
+            sync_tree_write_end(worker->sync);
+        } else
+            sync_tree_remove(worker->sync, &key);
+        operations++;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+void *run_concurrent(void *arg) {
+    Worker *worker = arg;
+    ConcurrentSlot slot = concurrent_tree_slot_new(worker->concurrent);
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+        int op = (r >> 24) % 100;
+
+        if (op < worker->search)
+            concurrent_tree_get(slot, &key);
+        else if ((op - worker->search) % 2 == 0)
+            concurrent_tree_put(slot, &key, &values[key], NULL);
+        else
+            concurrent_tree_remove(slot, &key);
+        operations++;
+    }
+    concurrent_tree_slot_delete(slot);
+    worker->operations = operations;
+    return NULL;
+}
+
+// Operations per microsecond of n threads running func for RUN_MS
+double run(void *(*func)(void *), SyncTree sync, ConcurrentTree concurrent,
+           int search, int n) {
+    pthread_t threads[THREADS_MAX];
+    Worker workers[THREADS_MAX];
+    atomic_bool stop = false;
+    struct timespec start_ts, end_ts, pause = { 0, RUN_MS * 1000000L };
+    long operations = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < n; i++) {
+        unsigned seed = 2463534242u + i * 7919;
+
+        workers[i] = (Worker){ sync, concurrent, search, seed, &stop, 0 };
+        if (pthread_create(&threads[i], NULL, func, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        operations += workers[i].operations;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    return operations / (get_time_ms(&start_ts, &end_ts) * 1000.0);
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int threads_max = argc > 1 ? atoi(argv[1]) : THREADS_MAX;
+
+    if (threads_max < 1 || threads_max > THREADS_MAX)
+        threads_max = THREADS_MAX;
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+
+    printf("Mix (search/insert/remove), Threads, "
+           "Global lock (ops/us), Concurrent (ops/us)\n");
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+        for (int n = 1; n <= threads_max; n *= 2) {
+            SyncTree sync = sync_tree_new(sizeof(int), cmpInt);
+            ConcurrentTree concurrent = concurrent_tree_new(sizeof(int),
+                                                            cmpInt);
+            ConcurrentSlot slot = concurrent_tree_slot_new(concurrent);
+
+            // Same initial keys in both trees, inserted in the same order
+            for (int i = 0; i < KEY_RANGE / 2; i++) {
+                int key = rand() % KEY_RANGE;
+                void *previous = NULL;
+
+                concurrent_tree_put(slot, &key, &values[key], &previous);
+                if (!previous)
+                    sync_tree_insert(sync, &key);
+            }
+
+            concurrent_tree_slot_delete(slot);
+
+            double sync_ops = run(run_sync, sync, NULL, mixes[m].search, n);
+            double concurrent_ops = run(run_concurrent, NULL, concurrent,
+                                        mixes[m].search, n);
+            printf("%s, %d, %.2f, %.2f\n", mixes[m].name, n, sync_ops,
+                   concurrent_ops);
+
+            sync_tree_delete(sync, NULL);
+            concurrent_tree_delete(concurrent);
+        }
+    }
+    return 0;
+}
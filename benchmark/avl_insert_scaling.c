@@ -0,0 +1,107 @@
+// Regression benchmark: AVL insertion must scale as N log N.
+//
+// Build from the benchmark directory:
+//   gcc avl_insert_scaling.c -o avl_insert_scaling -O2 -lm
+// Run (optionally with the largest N, default 10^7):
+//   ./avl_insert_scaling [N_MAX]
+//
+// For every N the time is normalized by N log2(N). With sequential keys the
+// tree stays cache friendly, so the normalized cost must stay nearly flat:
+// the program exits with a non-zero status if it grows by more than
+// MAX_STEP_RATIO from one N to the next (O(n) work per insertion would make
+// it grow about 10x per step). Random keys are reported for information,
+// their cost per level rises with cache misses once the tree outgrows the
+// caches.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-avl/tree-avl.c"
+
+// --- CONFIGURATION ---
+#define N_START 1000
+#define N_MAX 10000000
+#define N_FACTOR 10
+#define MAX_STEP_RATIO 4.0
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// Insert n keys and return the time per N log2 N unit, in nanoseconds
+double run(int n, bool sequential) {
+    struct timespec start_ts, end_ts;
+    Tree tree = tree_new();
+    int *keys = malloc(n * sizeof(int));
+
+    for (int i = 0; i < n; i++)
+        keys[i] = sequential ? i : rand();
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < n; i++) {
+        if (!tree_insert_sorted(&tree, &keys[i], sizeof(int), cmpInt)) {
+            fprintf(stderr, "Insertion failed at %d\n", i);
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+    // An AVL tree is never higher than 1.44 log2(n + 2)
+    if (tree_height(tree) > 1.44 * log2(n + 2.0)) {
+        fprintf(stderr, "Tree is not balanced for N = %d\n", n);
+        exit(1);
+    }
+
+    tree_delete(tree, NULL);
+    free(keys);
+    return get_time_ms(&start_ts, &end_ts) * 1e6 / (n * log2(n));
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int n_max = argc > 1 ? atoi(argv[1]) : N_MAX;
+    int status = 0;
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+    for (int sequential = 1; sequential >= 0; sequential--) {
+        double previous = 0;
+
+        printf("%s keys\n", sequential ? "Sequential" : "Random");
+        printf("N, ns / (N log2 N)\n");
+        for (int n = N_START; n <= n_max; n *= N_FACTOR) {
+            double cost = run(n, sequential);
+
+            printf("%d, %.3f\n", n, cost);
+            if (sequential && previous > 0 && cost > MAX_STEP_RATIO * previous) {
+                printf("FAIL: cost grew %.1fx faster than N log N\n",
+                       cost / previous);
+                status = 1;
+            }
+            previous = cost;
+        }
+        printf("\n");
+    }
+
+    return status;
+}
@@ -0,0 +1,143 @@
+// Benchmark: write throughput of the AVL split into shards by key range
+// (tree-avl-shard.h), against the number of shards.
+//
+// Build from the benchmark directory:
+//   gcc avl_shard_write_scaling.c -o avl_shard_write_scaling -O2 -lm -pthread
+// Run (optionally with the number of writer threads, default 64):
+//   ./avl_shard_write_scaling [THREADS]
+//
+// Each run starts from a tree holding half of KEY_RANGE random keys, split
+// into shards of equal key ranges, then every thread inserts and removes
+// random keys for RUN_MS, so the tree keeps its size. The output is the
+// total number of writes per microsecond for 1, 2, 4... SHARDS_MAX shards.
+// With 1 shard every write waits for the same lock; with more shards than
+// threads, two writers rarely meet on one.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-avl/tree-avl.c"
+#include "../src/tree-avl/tree-avl-handle.c"
+#include "../src/tree-avl/tree-avl-shard.c"
+
+// --- CONFIGURATION ---
+#define KEY_RANGE 1000000
+#define THREADS_MAX 64
+#define SHARDS_MAX 64
+#define RUN_MS 500
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// Per-thread generator (xorshift), rand() would serialize the threads
+unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// --- WORKERS ---
+
+typedef struct {
+    ShardTree tree;
+    unsigned seed;
+    atomic_bool *stop;
+    long operations;
+} Worker;
+
+void *run_writer(void *arg) {
+    Worker *worker = arg;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        unsigned r = next_random(&worker->seed);
+        int key = r % KEY_RANGE;
+
+        // Insert only absent keys, so the tree keeps its size
+        if ((r >> 31) && !shard_tree_search(worker->tree, &key, NULL))
+            shard_tree_insert(worker->tree, &key);
+        else
+            shard_tree_remove(worker->tree, &key);
+        operations++;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+// Writes per microsecond of n threads for RUN_MS
+double run(ShardTree tree, int n) {
+    pthread_t threads[THREADS_MAX];
+    Worker workers[THREADS_MAX];
+    atomic_bool stop = false;
+    struct timespec start_ts, end_ts, pause = { 0, RUN_MS * 1000000L };
+    long operations = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < n; i++) {
+        workers[i] = (Worker){ tree, 2463534242u + i * 7919, &stop, 0 };
+        if (pthread_create(&threads[i], NULL, run_writer, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        operations += workers[i].operations;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    return operations / (get_time_ms(&start_ts, &end_ts) * 1000.0);
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : THREADS_MAX;
+    int points[SHARDS_MAX - 1];
+
+    if (threads < 1 || threads > THREADS_MAX)
+        threads = THREADS_MAX;
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+
+    printf("Threads, Shards, Writes (ops/us)\n");
+    for (int count = 1; count <= SHARDS_MAX; count *= 2) {
+        // Shards of equal key ranges
+        for (int i = 1; i < count; i++)
+            points[i - 1] = (int)((long)i * KEY_RANGE / count);
+        ShardTree tree = shard_tree_new(sizeof(int), cmpInt, count,
+                                        count > 1 ? points : NULL);
+
+        for (int i = 0; i < KEY_RANGE / 2; i++) {
+            int key = rand() % KEY_RANGE;
+            if (!shard_tree_search(tree, &key, NULL))
+                shard_tree_insert(tree, &key);
+        }
+
+        printf("%d, %d, %.2f\n", threads, count, run(tree, threads));
+        shard_tree_delete(tree, NULL);
+    }
+    return 0;
+}
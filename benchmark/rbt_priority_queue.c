@@ -0,0 +1,163 @@
+// Benchmark: RBT priority queue (tree_handle_pop_min) against a binary heap.
+//
+// Build from the benchmark directory:
+//   gcc rbt_priority_queue.c -o rbt_priority_queue -O2 -lm -pthread
+// Run (optionally with the largest queue size, default 10^6):
+//   ./rbt_priority_queue [N_MAX]
+//
+// The workload is the "hold" model of timer queues: a queue of N timers,
+// where the earliest one is repeatedly popped and rearmed a random delay
+// later. Both queues call the same comparison function. The RBT pops the
+// cached first node without searching for it; adding
+// -DTREE_ORDER_STATISTICS=1 adds the walk to the root that recounts the
+// subtrees on every insertion and removal.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-rbt/tree-rbt.c"
+#include "../src/tree-rbt/tree-rbt-handle.c"
+
+// --- CONFIGURATION ---
+#define N_START 1000
+#define N_MAX 1000000
+#define N_FACTOR 10
+#define HOLDS 2000000
+#define MAX_DELAY 100000
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// --- BINARY HEAP (the reference) ---
+
+typedef struct {
+    int *keys;
+    size_t count;
+    int (*compare)(const void *, const void *);
+} Heap;
+
+void heap_push(Heap *heap, int key) {
+    size_t i = heap->count++;
+
+    while (i > 0 && heap->compare(&key, &heap->keys[(i - 1) / 2]) < 0) {
+        heap->keys[i] = heap->keys[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->keys[i] = key;
+}
+
+int heap_pop(Heap *heap) {
+    int top = heap->keys[0];
+    int key = heap->keys[--heap->count];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+            heap->compare(&heap->keys[child + 1], &heap->keys[child]) < 0)
+            child++;
+        if (heap->compare(&heap->keys[child], &key) >= 0)
+            break;
+        heap->keys[i] = heap->keys[child];
+        i = child;
+    }
+    heap->keys[i] = key;
+    return top;
+}
+
+// --- WORKLOADS ---
+
+// Nanoseconds per pop + push on the RBT, the checksum in *sum
+double run_tree(int n, const int *delays, long long *sum) {
+    struct timespec start_ts, end_ts;
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+    TreeHandle queue = tree_handle_new(sizeof(int), cmpInt, slab);
+    int key;
+
+    for (int i = 0; i < n; i++)
+        tree_handle_insert(queue, &delays[i]);
+
+    *sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < HOLDS; i++) {
+        tree_handle_pop_min(queue, &key);
+        *sum += key;
+        key += delays[i];
+        tree_handle_insert(queue, &key);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+    tree_handle_delete(queue, NULL);
+    tree_slab_delete(slab);
+    return get_time_ms(&start_ts, &end_ts) * 1e6 / HOLDS;
+}
+
+double run_heap(int n, const int *delays, long long *sum) {
+    struct timespec start_ts, end_ts;
+    Heap heap = { malloc(n * sizeof(int)), 0, cmpInt };
+
+    for (int i = 0; i < n; i++)
+        heap_push(&heap, delays[i]);
+
+    *sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i < HOLDS; i++) {
+        int key = heap_pop(&heap);
+        *sum += key;
+        heap_push(&heap, key + delays[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+    free(heap.keys);
+    return get_time_ms(&start_ts, &end_ts) * 1e6 / HOLDS;
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int n_max = argc > 1 ? atoi(argv[1]) : N_MAX;
+    int *delays = malloc(HOLDS * sizeof(int));
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+    for (int i = 0; i < HOLDS; i++)
+        delays[i] = 1 + rand() % MAX_DELAY;
+
+    printf("N, RBT (ns/op), Heap (ns/op)\n");
+    for (int n = N_START; n <= n_max; n *= N_FACTOR) {
+        long long tree_sum, heap_sum;
+        double tree_ns = run_tree(n, delays, &tree_sum);
+        double heap_ns = run_heap(n, delays, &heap_sum);
+
+        // Both queues must pop the same keys
+        if (tree_sum != heap_sum) {
+            fprintf(stderr, "Checksums differ for N = %d\n", n);
+            return 1;
+        }
+        printf("%d, %.1f, %.1f\n", n, tree_ns, heap_ns);
+    }
+
+    free(delays);
+    return 0;
+}
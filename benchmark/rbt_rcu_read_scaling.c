@@ -0,0 +1,201 @@
+// Benchmark: read scaling of the RCU red-black tree (tree-rbt-rcu.h)
+// against the red-black tree behind a reader-writer lock (tree-rbt-sync.h).
+//
+// Build from the benchmark directory:
+//   gcc rbt_rcu_read_scaling.c -o rbt_rcu_read_scaling -O2 -lm -pthread
+// Run (optionally with the largest number of readers, default 64):
+//   ./rbt_rcu_read_scaling [READERS_MAX]
+//
+// A tree of N_KEYS keys is searched for RUN_MS by 1, 2, 4... reader threads
+// while one writer thread keeps removing a random key and inserting it
+// back. The output is the total number of searches and of writes per
+// microsecond. RCU readers never wait for the writer nor write to a shared
+// cache line, so their throughput should grow with the readers as long as
+// there are cores for them.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // writer-preferring lock of the sync tree
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/tree-rbt/tree-rbt.c"
+#include "../src/tree-rbt/tree-rbt-handle.c"
+#include "../src/tree-rbt/tree-rbt-sync.c"
+#include "../src/tree-rbt/tree-rbt-rcu.c"
+
+// --- CONFIGURATION ---
+#define N_KEYS 1000000
+#define READERS_MAX 64
+#define RUN_MS 500
+// Searches per read section
+#define SECTION 16
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// Per-thread generator (xorshift), rand() would serialize the threads
+unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// --- WORKERS ---
+
+typedef struct {
+    SyncTree sync;
+    RcuTree rcu;
+    unsigned seed;
+    atomic_bool *stop;
+    long operations;
+} Worker;
+
+void *read_sync(void *arg) {
+    Worker *worker = arg;
+    long operations = 0;
+    int found;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        int key = next_random(&worker->seed) % N_KEYS;
+        sync_tree_search(worker->sync, &key, &found);
+        operations++;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+void *write_sync(void *arg) {
+    Worker *worker = arg;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        int key = next_random(&worker->seed) % N_KEYS;
+        sync_tree_remove(worker->sync, &key);
+        sync_tree_insert(worker->sync, &key);
+        operations += 2;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+void *read_rcu(void *arg) {
+    Worker *worker = arg;
+    RcuReader reader = rcu_tree_reader_new(worker->rcu);
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        rcu_tree_read_begin(reader);
+        for (int i = 0; i < SECTION; i++) {
+            int key = next_random(&worker->seed) % N_KEYS;
+            rcu_tree_search(worker->rcu, &key);
+        }
+        rcu_tree_read_end(reader);
+        operations += SECTION;
+    }
+    rcu_tree_reader_delete(reader);
+    worker->operations = operations;
+    return NULL;
+}
+
+void *write_rcu(void *arg) {
+    Worker *worker = arg;
+    long operations = 0;
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        int key = next_random(&worker->seed) % N_KEYS;
+        rcu_tree_remove(worker->rcu, &key);
+        rcu_tree_insert(worker->rcu, &key);
+        operations += 2;
+    }
+    worker->operations = operations;
+    return NULL;
+}
+
+// Searches per microsecond of n readers, writes per microsecond in *writes
+double run(void *(*reader)(void *), void *(*writer)(void *), SyncTree sync,
+           RcuTree rcu, int n, double *writes) {
+    pthread_t threads[READERS_MAX + 1];
+    Worker workers[READERS_MAX + 1];
+    atomic_bool stop = false;
+    struct timespec start_ts, end_ts, pause = { 0, RUN_MS * 1000000L };
+    long operations = 0;
+    double ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (int i = 0; i <= n; i++) {
+        unsigned seed = 2463534242u + i * 7919;
+
+        workers[i] = (Worker){ sync, rcu, seed, &stop, 0 };
+        if (pthread_create(&threads[i], NULL, i < n ? reader : writer,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i <= n; i++) {
+        pthread_join(threads[i], NULL);
+        if (i < n)
+            operations += workers[i].operations;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    ms = get_time_ms(&start_ts, &end_ts);
+    *writes = workers[n].operations / (ms * 1000.0);
+    return operations / (ms * 1000.0);
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int readers_max = argc > 1 ? atoi(argv[1]) : READERS_MAX;
+    SyncTree sync = sync_tree_new(sizeof(int), cmpInt);
+    RcuTree rcu = rcu_tree_new(sizeof(int), cmpInt);
+
+    if (readers_max < 1 || readers_max > READERS_MAX)
+        readers_max = READERS_MAX;
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    // Same keys in both trees, inserted in the same order
+    for (int i = 0; i < N_KEYS; i++) {
+        int key = (int)(((long long)i * 7919) % N_KEYS);
+        sync_tree_insert(sync, &key);
+        rcu_tree_insert(rcu, &key);
+    }
+
+    printf("Readers, RWLock reads (ops/us), RCU reads (ops/us), "
+           "RWLock writes (ops/us), RCU writes (ops/us)\n");
+    for (int n = 1; n <= readers_max; n *= 2) {
+        double sync_writes, rcu_writes;
+        double sync_reads = run(read_sync, write_sync, sync, NULL, n,
+                                &sync_writes);
+        double rcu_reads = run(read_rcu, write_rcu, NULL, rcu, n,
+                               &rcu_writes);
+        printf("%d, %.2f, %.2f, %.3f, %.3f\n", n, sync_reads, rcu_reads,
+               sync_writes, rcu_writes);
+    }
+
+    sync_tree_delete(sync, NULL);
+    rcu_tree_delete(rcu, NULL);
+    return 0;
+}
@@ -36,18 +36,230 @@
 #define tree_search avl_tree_search
 #define tree_sort avl_tree_sort
 #define tree_remove_sorted avl_tree_remove_sorted
-#define recompute_balance avl_recompute_balance
+#define rebalance avl_rebalance
+#define replace_child avl_replace_child
+#define insert_retrace avl_insert_retrace
+#define remove_retrace avl_remove_retrace
 #define rotate_left avl_rotate_left
 #define rotate_right avl_rotate_right
-#define min_value_node avl_min_value_node
 #define set avl_set
+#define TreeSlab AvlTreeSlab
+#define _TreeSlab _AvlTreeSlab
+#define TreeSlabChunk AvlTreeSlabChunk
+#define _TreeSlabChunk _AvlTreeSlabChunk
+#define tree_slab_new avl_tree_slab_new
+#define tree_slab_release avl_tree_slab_release
+#define tree_slab_delete avl_tree_slab_delete
+#define node_alloc avl_node_alloc
+#define node_free avl_node_free
+#define delete_payloads avl_delete_payloads
+#define tree_delete_slab avl_tree_delete_slab
+#define tree_delete_into_slab avl_tree_delete_into_slab
+#define tree_slab_create avl_tree_slab_create
+#define tree_insert_sorted_slab avl_tree_insert_sorted_slab
+#define tree_remove_sorted_slab avl_tree_remove_sorted_slab
+#define node_parent avl_node_parent
+#define node_set_parent avl_node_set_parent
+#define node_balance avl_node_balance
+#define node_set_balance avl_node_set_balance
+#define tree_get_parent avl_tree_get_parent
+#define tree_get_balance avl_tree_get_balance
+#define tree_insert_node avl_tree_insert_node
+#define tree_detach_node avl_tree_detach_node
+#define tree_first avl_tree_first
+#define tree_last avl_tree_last
+#define tree_next avl_tree_next
+#define tree_prev avl_tree_prev
+#define tree_lower_bound avl_tree_lower_bound
+#define tree_upper_bound avl_tree_upper_bound
+#define tree_floor avl_tree_floor
+#define tree_ceil avl_tree_ceil
+#define tree_range avl_tree_range
+#define tree_select avl_tree_select
+#define tree_rank avl_tree_rank
+#define node_count avl_node_count
+#define node_update avl_node_update
+#define update_path avl_update_path
+#define link_left avl_link_left
+#define link_right avl_link_right
+#define tree_from_sorted avl_tree_from_sorted
+#define tree_from_sorted_slab avl_tree_from_sorted_slab
+#define sorted_height avl_sorted_height
+#define link_sorted avl_link_sorted
+#define tree_insert_batch avl_tree_insert_batch
+#define tree_insert_batch_slab avl_tree_insert_batch_slab
+#define sort_items avl_sort_items
+#define insert_finger avl_insert_finger
+#define tree_size_up_to avl_tree_size_up_to
+#define TreeBatchStrategy AvlTreeBatchStrategy
+#define TREE_BATCH_FAILED AVL_TREE_BATCH_FAILED
+#define TREE_BATCH_FINGER AVL_TREE_BATCH_FINGER
+#define TREE_BATCH_REBUILD AVL_TREE_BATCH_REBUILD
+#define tree_join avl_tree_join
+#define tree_concat avl_tree_concat
+#define tree_split avl_tree_split
+#define join_with avl_join_with
+#define split_with avl_split_with
+#define height_of avl_height_of
+#define join_retrace avl_join_retrace
+#define tree_union avl_tree_union
+#define tree_intersection avl_tree_intersection
+#define tree_difference avl_tree_difference
+#define SetOperation AvlSetOperation
+#define SET_UNION AVL_SET_UNION
+#define SET_INTERSECTION AVL_SET_INTERSECTION
+#define SET_DIFFERENCE AVL_SET_DIFFERENCE
+#define SetContext AvlSetContext
+#define SetTask AvlSetTask
+#define set_with avl_set_with
+#define set_task_run avl_set_task_run
+#define run_both avl_run_both
+#define _SetTask _AvlSetTask
+#define TaskState AvlTaskState
+#define TASK_QUEUED AVL_TASK_QUEUED
+#define TASK_RUNNING AVL_TASK_RUNNING
+#define TASK_DONE AVL_TASK_DONE
+#define unqueue avl_unqueue
+#define set_worker avl_set_worker
+#define offer avl_offer
+#define free_node avl_free_node
+#define split_last avl_split_last
+#define join2_with avl_join2_with
+#define set_operation avl_set_operation
+#define hint_link avl_hint_link
+#define tree_insert_hint avl_tree_insert_hint
+#define tree_insert_hint_slab avl_tree_insert_hint_slab
+#define tree_insert_rightmost avl_tree_insert_rightmost
+#define tree_insert_rightmost_slab avl_tree_insert_rightmost_slab
+#define find_link avl_find_link
+#define tree_insert_unique avl_tree_insert_unique
+#define tree_insert_unique_slab avl_tree_insert_unique_slab
+#define tree_upsert avl_tree_upsert
+#define tree_upsert_slab avl_tree_upsert_slab
+#define multiset_count avl_multiset_count
+#define tree_multiset_get_data avl_tree_multiset_get_data
+#define tree_multiset_get_count avl_tree_multiset_get_count
+#define tree_multiset_add avl_tree_multiset_add
+#define tree_multiset_remove avl_tree_multiset_remove
+#define tree_multiset_count avl_tree_multiset_count
+#define tree_remove_node avl_tree_remove_node
+#define tree_remove_node_slab avl_tree_remove_node_slab
+#define SortCursor AvlSortCursor
 // We include the .c file directly to apply the macros
 #include "../src/tree-avl/tree-avl.c"
+#undef SortCursor
+#undef tree_remove_node_slab
+#undef tree_remove_node
+#undef tree_multiset_count
+#undef tree_multiset_remove
+#undef tree_multiset_add
+#undef tree_multiset_get_count
+#undef tree_multiset_get_data
+#undef multiset_count
+#undef tree_upsert_slab
+#undef tree_upsert
+#undef tree_insert_unique_slab
+#undef tree_insert_unique
+#undef find_link
+#undef tree_insert_rightmost_slab
+#undef tree_insert_rightmost
+#undef tree_insert_hint_slab
+#undef tree_insert_hint
+#undef hint_link
+#undef set_operation
+#undef join2_with
+#undef split_last
+#undef free_node
+#undef offer
+#undef set_worker
+#undef unqueue
+#undef TASK_DONE
+#undef TASK_RUNNING
+#undef TASK_QUEUED
+#undef TaskState
+#undef _SetTask
+#undef run_both
+#undef set_task_run
+#undef set_with
+#undef SetTask
+#undef SetContext
+#undef SET_DIFFERENCE
+#undef SET_INTERSECTION
+#undef SET_UNION
+#undef SetOperation
+#undef tree_difference
+#undef tree_intersection
+#undef tree_union
+#undef join_retrace
+#undef height_of
+#undef split_with
+#undef join_with
+#undef tree_split
+#undef tree_concat
+#undef tree_join
+#undef TREE_BATCH_REBUILD
+#undef TREE_BATCH_FINGER
+#undef TREE_BATCH_FAILED
+#undef TreeBatchStrategy
+#undef tree_size_up_to
+#undef insert_finger
+#undef sort_items
+#undef tree_insert_batch_slab
+#undef tree_insert_batch
+#undef link_sorted
+#undef sorted_height
+#undef tree_from_sorted_slab
+#undef tree_from_sorted
+#undef link_right
+#undef link_left
+#undef update_path
+#undef node_update
+#undef node_count
+#undef tree_rank
+#undef tree_select
+#undef tree_range
+#undef tree_ceil
+#undef tree_floor
+#undef tree_upper_bound
+#undef tree_lower_bound
+#undef tree_prev
+#undef tree_next
+#undef tree_last
+#undef tree_first
+#undef tree_detach_node
+#undef tree_insert_node
+#undef NODE_SIZE
+#undef TREE_BATCH_REBUILD_FRACTION
+#undef TREE_SET_PARALLEL_HEIGHT
+#undef MULTISET_HEADER
+#undef tree_get_balance
+#undef tree_get_parent
+#undef node_set_balance
+#undef node_balance
+#undef node_set_parent
+#undef node_parent
+#undef tree_remove_sorted_slab
+#undef tree_insert_sorted_slab
+#undef tree_slab_create
+#undef tree_delete_into_slab
+#undef tree_delete_slab
+#undef delete_payloads
+#undef node_free
+#undef node_alloc
+#undef tree_slab_delete
+#undef tree_slab_release
+#undef tree_slab_new
+#undef _TreeSlabChunk
+#undef TreeSlabChunk
+#undef _TreeSlab
+#undef TreeSlab
 #undef set
-#undef min_value_node
 #undef rotate_right
 #undef rotate_left
-#undef recompute_balance
+#undef remove_retrace
+#undef insert_retrace
+#undef replace_child
+#undef rebalance
 #undef tree_remove_sorted
 #undef tree_sort
 #undef tree_search
@@ -104,8 +316,212 @@
 #define transplant rbt_transplant
 #define min_value_node rbt_min_value_node
 #define delete_fixup rbt_delete_fixup
+#define TreeSlab RbtTreeSlab
+#define _TreeSlab _RbtTreeSlab
+#define TreeSlabChunk RbtTreeSlabChunk
+#define _TreeSlabChunk _RbtTreeSlabChunk
+#define tree_slab_new rbt_tree_slab_new
+#define tree_slab_release rbt_tree_slab_release
+#define tree_slab_delete rbt_tree_slab_delete
+#define node_alloc rbt_node_alloc
+#define node_free rbt_node_free
+#define delete_payloads rbt_delete_payloads
+#define tree_delete_slab rbt_tree_delete_slab
+#define tree_delete_into_slab rbt_tree_delete_into_slab
+#define tree_slab_create rbt_tree_slab_create
+#define tree_insert_sorted_slab rbt_tree_insert_sorted_slab
+#define tree_remove_sorted_slab rbt_tree_remove_sorted_slab
+#define node_parent rbt_node_parent
+#define node_set_parent rbt_node_set_parent
+#define node_color rbt_node_color
+#define node_set_color rbt_node_set_color
+#define tree_get_parent rbt_tree_get_parent
+#define tree_get_color rbt_tree_get_color
+#define tree_insert_node rbt_tree_insert_node
+#define tree_detach_node rbt_tree_detach_node
+#define tree_first rbt_tree_first
+#define tree_last rbt_tree_last
+#define tree_next rbt_tree_next
+#define tree_prev rbt_tree_prev
+#define tree_lower_bound rbt_tree_lower_bound
+#define tree_upper_bound rbt_tree_upper_bound
+#define tree_floor rbt_tree_floor
+#define tree_ceil rbt_tree_ceil
+#define tree_range rbt_tree_range
+#define tree_select rbt_tree_select
+#define tree_rank rbt_tree_rank
+#define node_count rbt_node_count
+#define node_update rbt_node_update
+#define update_path rbt_update_path
+#define tree_from_sorted rbt_tree_from_sorted
+#define tree_from_sorted_slab rbt_tree_from_sorted_slab
+#define sorted_height rbt_sorted_height
+#define link_sorted rbt_link_sorted
+#define tree_insert_batch rbt_tree_insert_batch
+#define tree_insert_batch_slab rbt_tree_insert_batch_slab
+#define sort_items rbt_sort_items
+#define insert_finger rbt_insert_finger
+#define tree_size_up_to rbt_tree_size_up_to
+#define link_sorted_tree rbt_link_sorted_tree
+#define TreeBatchStrategy RbtTreeBatchStrategy
+#define TREE_BATCH_FAILED RBT_TREE_BATCH_FAILED
+#define TREE_BATCH_FINGER RBT_TREE_BATCH_FINGER
+#define TREE_BATCH_REBUILD RBT_TREE_BATCH_REBUILD
+#define tree_join rbt_tree_join
+#define tree_concat rbt_tree_concat
+#define tree_split rbt_tree_split
+#define join_with rbt_join_with
+#define split_with rbt_split_with
+#define black_height rbt_black_height
+#define tree_union rbt_tree_union
+#define tree_intersection rbt_tree_intersection
+#define tree_difference rbt_tree_difference
+#define SetOperation RbtSetOperation
+#define SET_UNION RBT_SET_UNION
+#define SET_INTERSECTION RBT_SET_INTERSECTION
+#define SET_DIFFERENCE RBT_SET_DIFFERENCE
+#define SetContext RbtSetContext
+#define SetTask RbtSetTask
+#define set_with rbt_set_with
+#define set_task_run rbt_set_task_run
+#define run_both rbt_run_both
+#define _SetTask _RbtSetTask
+#define TaskState RbtTaskState
+#define TASK_QUEUED RBT_TASK_QUEUED
+#define TASK_RUNNING RBT_TASK_RUNNING
+#define TASK_DONE RBT_TASK_DONE
+#define unqueue rbt_unqueue
+#define set_worker rbt_set_worker
+#define offer rbt_offer
+#define free_node rbt_free_node
+#define split_last rbt_split_last
+#define join2_with rbt_join2_with
+#define set_operation rbt_set_operation
+#define hint_link rbt_hint_link
+#define tree_insert_hint rbt_tree_insert_hint
+#define tree_insert_hint_slab rbt_tree_insert_hint_slab
+#define tree_insert_rightmost rbt_tree_insert_rightmost
+#define tree_insert_rightmost_slab rbt_tree_insert_rightmost_slab
+#define find_link rbt_find_link
+#define tree_insert_unique rbt_tree_insert_unique
+#define tree_insert_unique_slab rbt_tree_insert_unique_slab
+#define tree_upsert rbt_tree_upsert
+#define tree_upsert_slab rbt_tree_upsert_slab
+#define multiset_count rbt_multiset_count
+#define tree_multiset_get_data rbt_tree_multiset_get_data
+#define tree_multiset_get_count rbt_tree_multiset_get_count
+#define tree_multiset_add rbt_tree_multiset_add
+#define tree_multiset_remove rbt_tree_multiset_remove
+#define tree_multiset_count rbt_tree_multiset_count
+#define tree_remove_node rbt_tree_remove_node
+#define tree_remove_node_slab rbt_tree_remove_node_slab
+#define SortCursor RbtSortCursor
 // Include the .c file for the RBT
 #include "../src/tree-rbt/tree-rbt.c"
+#undef SortCursor
+#undef tree_remove_node_slab
+#undef tree_remove_node
+#undef tree_multiset_count
+#undef tree_multiset_remove
+#undef tree_multiset_add
+#undef tree_multiset_get_count
+#undef tree_multiset_get_data
+#undef multiset_count
+#undef tree_upsert_slab
+#undef tree_upsert
+#undef tree_insert_unique_slab
+#undef tree_insert_unique
+#undef find_link
+#undef tree_insert_rightmost_slab
+#undef tree_insert_rightmost
+#undef tree_insert_hint_slab
+#undef tree_insert_hint
+#undef hint_link
+#undef set_operation
+#undef join2_with
+#undef split_last
+#undef free_node
+#undef offer
+#undef set_worker
+#undef unqueue
+#undef TASK_DONE
+#undef TASK_RUNNING
+#undef TASK_QUEUED
+#undef TaskState
+#undef _SetTask
+#undef run_both
+#undef set_task_run
+#undef set_with
+#undef SetTask
+#undef SetContext
+#undef SET_DIFFERENCE
+#undef SET_INTERSECTION
+#undef SET_UNION
+#undef SetOperation
+#undef tree_difference
+#undef tree_intersection
+#undef tree_union
+#undef black_height
+#undef split_with
+#undef join_with
+#undef tree_split
+#undef tree_concat
+#undef tree_join
+#undef TREE_BATCH_REBUILD
+#undef TREE_BATCH_FINGER
+#undef TREE_BATCH_FAILED
+#undef TreeBatchStrategy
+#undef link_sorted_tree
+#undef tree_size_up_to
+#undef insert_finger
+#undef sort_items
+#undef tree_insert_batch_slab
+#undef tree_insert_batch
+#undef link_sorted
+#undef sorted_height
+#undef tree_from_sorted_slab
+#undef tree_from_sorted
+#undef update_path
+#undef node_update
+#undef node_count
+#undef tree_rank
+#undef tree_select
+#undef tree_range
+#undef tree_ceil
+#undef tree_floor
+#undef tree_upper_bound
+#undef tree_lower_bound
+#undef tree_prev
+#undef tree_next
+#undef tree_last
+#undef tree_first
+#undef tree_detach_node
+#undef tree_insert_node
+#undef NODE_SIZE
+#undef TREE_BATCH_REBUILD_FRACTION
+#undef TREE_SET_PARALLEL_HEIGHT
+#undef MULTISET_HEADER
+#undef tree_get_color
+#undef tree_get_parent
+#undef node_set_color
+#undef node_color
+#undef node_set_parent
+#undef node_parent
+#undef tree_remove_sorted_slab
+#undef tree_insert_sorted_slab
+#undef tree_slab_create
+#undef tree_delete_into_slab
+#undef tree_delete_slab
+#undef delete_payloads
+#undef node_free
+#undef node_alloc
+#undef tree_slab_delete
+#undef tree_slab_release
+#undef tree_slab_new
+#undef _TreeSlabChunk
+#undef TreeSlabChunk
+#undef _TreeSlab
+#undef TreeSlab
 #undef delete_fixup
 #undef min_value_node
 #undef transplant
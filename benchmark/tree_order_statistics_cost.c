@@ -0,0 +1,112 @@
+// Benchmark: cost of the subtree counts (TREE_ORDER_STATISTICS) on the
+// updates of the AVL and the RBT.
+//
+// Build from the benchmark directory, once per setting (add -DRBT for the
+// red-black tree):
+//   gcc tree_order_statistics_cost.c -o cost_off -O2 -lm -pthread
+//   gcc tree_order_statistics_cost.c -o cost_on -O2 -lm -pthread -DTREE_ORDER_STATISTICS=1
+// Run (optionally with the largest tree size, default 10^6):
+//   ./cost_off [N_MAX] && ./cost_on [N_MAX]
+//
+// For each size N, through a tree handle: N insertions of random keys, N
+// removals of those keys, N appends of increasing keys, then N pops of the
+// minimum. Without the counts, the rebalancing of the appends and of the
+// RBT pops is amortized O(1); with them, each operation also recounts every
+// subtree up to the root. The output is nanoseconds per operation.
+
+// FIX for CLOCK_MONOTONIC (must be at the very top)
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef RBT
+#include "../src/tree-rbt/tree-rbt.c"
+#include "../src/tree-rbt/tree-rbt-handle.c"
+#define TREE_NAME "RBT"
+#else
+#include "../src/tree-avl/tree-avl.c"
+#include "../src/tree-avl/tree-avl-handle.c"
+#define TREE_NAME "AVL"
+#endif
+
+// --- CONFIGURATION ---
+#define N_START 1000
+#define N_MAX 1000000
+#define N_FACTOR 10
+
+// --- HELPER FUNCTIONS ---
+
+int cmpInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper to get high-resolution time in milliseconds
+double get_time_ms(const struct timespec *start, const struct timespec *end) {
+    time_t secs = end->tv_sec - start->tv_sec;
+    long nsecs = end->tv_nsec - start->tv_nsec;
+    if (nsecs < 0) {
+        --secs;
+        nsecs += 1000000000L;
+    }
+    return (double)secs * 1000.0 + (double)nsecs / 1e6;
+}
+
+// --- MAIN BENCHMARK PROGRAM ---
+
+int main(int argc, char **argv) {
+    int n_max = argc > 1 ? atoi(argv[1]) : N_MAX;
+    struct timespec start_ts, end_ts;
+
+    if (n_max < N_START)
+        n_max = N_MAX;
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srand(42);
+
+    printf("Tree, Order statistics, N, Insert (ns/op), Remove (ns/op), "
+           "Append (ns/op), Pop min (ns/op)\n");
+    for (int n = N_START; n <= n_max; n *= N_FACTOR) {
+        TreeSlab *slab = tree_slab_new(sizeof(int));
+        TreeHandle handle = tree_handle_new(sizeof(int), cmpInt, slab);
+        int *keys = malloc(n * sizeof(int));
+        double ms[4];
+
+        for (int i = 0; i < n; i++)
+            keys[i] = rand();
+
+        clock_gettime(CLOCK_MONOTONIC, &start_ts);
+        for (int i = 0; i < n; i++)
+            tree_handle_insert(handle, &keys[i]);
+        clock_gettime(CLOCK_MONOTONIC, &end_ts);
+        ms[0] = get_time_ms(&start_ts, &end_ts);
+
+        clock_gettime(CLOCK_MONOTONIC, &start_ts);
+        for (int i = 0; i < n; i++)
+            tree_handle_remove(handle, &keys[i]);
+        clock_gettime(CLOCK_MONOTONIC, &end_ts);
+        ms[1] = get_time_ms(&start_ts, &end_ts);
+
+        clock_gettime(CLOCK_MONOTONIC, &start_ts);
+        for (int i = 0; i < n; i++)
+            tree_handle_insert(handle, &i);
+        clock_gettime(CLOCK_MONOTONIC, &end_ts);
+        ms[2] = get_time_ms(&start_ts, &end_ts);
+
+        clock_gettime(CLOCK_MONOTONIC, &start_ts);
+        for (int i = 0; i < n; i++)
+            tree_handle_pop_min(handle, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end_ts);
+        ms[3] = get_time_ms(&start_ts, &end_ts);
+
+        printf("%s, %s, %d, %.1f, %.1f, %.1f, %.1f\n", TREE_NAME,
+               TREE_ORDER_STATISTICS ? "on" : "off", n, ms[0] * 1e6 / n,
+               ms[1] * 1e6 / n, ms[2] * 1e6 / n, ms[3] * 1e6 / n);
+
+        free(keys);
+        tree_handle_delete(handle, NULL);
+        tree_slab_delete(slab);
+    }
+    return 0;
+}
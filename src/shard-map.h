@@ -0,0 +1,229 @@
+/*--------------------------------------------------------------------*/
+/* Split points of the sharded trees (tree-avl-shard.c, tree-rbt-shard.c),
+   included by both after their tree header: the functions below only use
+   the names that tree-avl.h and tree-rbt.h have in common.
+
+   The split points live in a map that is never modified: a rebuild
+   publishes a new one while it holds the locks of the shards it changes.
+   An operation enters the index, picks its shard from the current map,
+   locks the shard, checks that the map is still the current one (if it
+   is, no rebuild can move the payloads of the shard before the lock is
+   released) and leaves. The map replaced by a rebuild is released once
+   every operation that may still read it has left: the operations count
+   themselves in one of two phases, and the rebuild switches the phase,
+   then waits for the counts of the old one to drop to zero. Counts are
+   spread over a few cache lines, one per group of threads, so that the
+   operations on distinct shards do not all write the same line. */
+#ifndef _SHARD_MAP_H_
+#define _SHARD_MAP_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#define SHARD_STRIPES 16
+
+typedef struct _ShardMap ShardMap;
+
+struct _ShardMap
+  {
+    bool split; // false: every payload in the first shard
+    _Alignas (max_align_t) char split_points[];
+  };
+
+typedef struct
+  {
+    _Alignas (64) atomic_size_t active[2]; // operations in each phase
+  } ShardStripe;
+
+typedef struct
+  {
+    _Atomic (ShardMap *) map;
+    atomic_uint phase;
+    size_t count; // shards, one more than the split points
+    size_t size;
+    int (*compare) (const void *, const void *);
+    ShardStripe stripes[SHARD_STRIPES];
+  } ShardIndex;
+
+static atomic_uint shard_next_stripe;
+
+static _Thread_local unsigned shard_stripe; // stripe of the thread, plus one
+
+static ShardMap *
+shard_map_new (const ShardIndex *index, const void *split_points)
+{
+  ShardMap *map = malloc (sizeof (*map)
+                          + (index->count - 1) * index->size);
+
+  if (!map)
+    return NULL;
+  map->split = split_points != NULL;
+  if (split_points)
+    memcpy (map->split_points, split_points,
+            (index->count - 1) * index->size);
+  return map;
+}
+
+static bool
+shard_index_init (ShardIndex *index,
+                  size_t count,
+                  size_t size,
+                  int (*compare) (const void *, const void *),
+                  const void *split_points)
+{
+  size_t i;
+
+  index->count = count;
+  index->size = size;
+  index->compare = compare;
+  atomic_init (&index->phase, 0);
+  for (i = 0; i < SHARD_STRIPES; i++)
+    {
+      atomic_init (&index->stripes[i].active[0], 0);
+      atomic_init (&index->stripes[i].active[1], 0);
+    }
+  atomic_init (&index->map, shard_map_new (index, split_points));
+  return atomic_load (&index->map) != NULL;
+}
+
+// Not thread-safe
+static void
+shard_index_destroy (ShardIndex *index)
+{
+  free (atomic_load (&index->map));
+}
+
+static const void *
+shard_split_point (const ShardIndex *index, const ShardMap *map, size_t i)
+{
+  return map->split_points + i * index->size;
+}
+
+// Number of split points not greater than data
+static size_t
+shard_of (const ShardIndex *index, const ShardMap *map, const void *data)
+{
+  size_t lo = 0, hi = index->count - 1;
+
+  if (!map->split)
+    return 0;
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (index->compare (shard_split_point (index, map, mid), data) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+// Count the calling thread in the current phase, return what
+// shard_index_leave() takes; the current map stays allocated until then
+static atomic_size_t *
+shard_index_enter (ShardIndex *index)
+{
+  atomic_size_t *active;
+
+  if (!shard_stripe)
+    shard_stripe = atomic_fetch_add (&shard_next_stripe, 1)
+                   % SHARD_STRIPES + 1;
+  active = &index->stripes[shard_stripe - 1]
+              .active[atomic_load (&index->phase) & 1];
+  atomic_fetch_add (active, 1);
+  return active;
+}
+
+static void
+shard_index_leave (atomic_size_t *active)
+{
+  atomic_fetch_sub_explicit (active, 1, memory_order_release);
+}
+
+// Under the locks of the shards whose payloads the new map moves; the old
+// one goes to shard_index_reclaim()
+static void
+shard_index_publish (ShardIndex *index, ShardMap *map)
+{
+  atomic_store (&index->map, map);
+}
+
+// Without any shard lock (the operations that read old may wait on one):
+// release old once no operation can read it any more. One rebuild at a
+// time.
+static void
+shard_index_reclaim (ShardIndex *index, ShardMap *old)
+{
+  unsigned phase = atomic_fetch_add (&index->phase, 1) & 1;
+  size_t i;
+
+  for (i = 0; i < SHARD_STRIPES; i++)
+    while (atomic_load (&index->stripes[i].active[phase]))
+      sched_yield ();
+  free (old);
+}
+
+// Whether shard i and shard i + 1 trade payloads from old to map
+static bool
+shard_boundary_moved (const ShardIndex *index,
+                      const ShardMap *old,
+                      const ShardMap *map,
+                      size_t i)
+{
+  return old->split != map->split
+         || (map->split
+             && index->compare (shard_split_point (index, old, i),
+                                shard_split_point (index, map, i)) != 0);
+}
+
+// Number of payloads of tree in [lo, hi): O(log n) with the subtree
+// counts, else O(log n) plus the number counted
+static size_t
+shard_count_between (const ShardIndex *index,
+                     Tree tree,
+                     const void *lo,
+                     const void *hi)
+{
+#if TREE_ORDER_STATISTICS
+  return tree_rank (tree, hi, index->compare)
+         - tree_rank (tree, lo, index->compare);
+#else
+  size_t count = 0;
+  Tree node;
+
+  for (node = tree_lower_bound (tree, lo, index->compare);
+       node && index->compare (tree_get_data (node), hi) < 0;
+       node = tree_next (node))
+    count++;
+  return count;
+#endif
+}
+
+/* Number of payloads of tree less than split point i of map, given
+   below_old, the number less than split point i of old. tree holds the
+   payloads of a run of shards on both sides of the split point; if old is
+   not split, they were all in the first shard and below_old is ignored. */
+static size_t
+shard_count_below (const ShardIndex *index,
+                   Tree tree,
+                   const ShardMap *old,
+                   const ShardMap *map,
+                   size_t i,
+                   size_t below_old)
+{
+  const void *from, *to;
+
+  if (!old->split)
+    return tree_rank (tree, shard_split_point (index, map, i),
+                      index->compare);
+  from = shard_split_point (index, old, i);
+  to = shard_split_point (index, map, i);
+  if (index->compare (to, from) < 0)
+    return below_old - shard_count_between (index, tree, to, from);
+  return below_old + shard_count_between (index, tree, from, to);
+}
+
+#endif
@@ -2,7 +2,17 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "tree-avl.h"
+#include "tree-avl-compact.h"
+#include "tree-avl-handle.h"
+#include "tree-avl-sync.h"
+#include "tree-avl-concurrent.h"
+#include "tree-avl-shard.h"
+#include "tree-avl-combining.h"
+#include "tree-avl-typed.h"
 #include <stddef.h>
 
 void monPrintF (void * a, void * b){
@@ -50,7 +60,7 @@ void printIntWithBalance(void *data, void *extra_data) {
     (void) extra_data;
     Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
     int value = *(int*)data;
-    int balance = node->balance;
+    int balance = tree_get_balance(node);
 
     printf("Valeur : %2d (Balance: %2d)\n", value, balance);
 }
@@ -65,7 +75,7 @@ void printStr(void *data, void *extra_data) {
     Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
 
     char *value = *(char **)data;
-    int balance = node->balance;
+    int balance = tree_get_balance(node);
 
     printf("Valeur du noeud : %-10s (Balance: %2d)\n", value, balance);
 }
@@ -85,7 +95,7 @@ void printEntry(void *data, void *extra_data) {
 
     // Access the data and balance
     Entry *e = (Entry *)data;
-    int balance = node->balance;
+    int balance = tree_get_balance(node);
     printf("{%-7s : %-18s} (Balance: %2d)\n", e->mot, e->definition, balance);
 }
 
@@ -185,6 +195,1260 @@ void testAVLEntry(void) {
 }
 
 
+/// ------------------ AVL INVARIANTS ------------------
+
+// Check parent links, balance factors and the AVL property, return the height
+size_t checkAVL(Tree tree, Tree parent) {
+    if (!tree)
+        return 0;
+    assert(tree_get_parent(tree) == parent);
+    size_t hl = checkAVL(tree->left, tree);
+    size_t hr = checkAVL(tree->right, tree);
+    assert(tree_get_balance(tree) == (int)hl - (int)hr);
+    assert(tree_get_balance(tree) >= -1 && tree_get_balance(tree) <= 1);
+#if TREE_ORDER_STATISTICS
+    assert(tree->count == 1 + tree_size(tree->left) + tree_size(tree->right));
+#endif
+    return 1 + (hl > hr ? hl : hr);
+}
+
+void testAVLInvariants(void) {
+    Tree root = NULL;
+    int n = 2000;
+
+    printf("\n===== Test AVL invariants =====\n");
+    srand(42);
+    for (int i = 0; i < n; i++) {
+        int v = rand() % 500;
+        assert(tree_insert_sorted(&root, &v, sizeof(int), cmpInt));
+        checkAVL(root, NULL);
+    }
+    assert(tree_size(root) == (size_t)n);
+
+    // Sorted insertions are the worst case for an unbalanced tree
+    Tree seq = NULL;
+    for (int i = 0; i < n; i++)
+        assert(tree_insert_sorted(&seq, &i, sizeof(int), cmpInt));
+    assert(checkAVL(seq, NULL) <= 12);
+
+    for (int i = 0; i < n; i++) {
+        int v = rand() % 500;
+        bool found = tree_search(root, &v, cmpInt) != NULL;
+        assert(tree_remove_sorted(&root, &v, cmpInt) == found);
+        checkAVL(root, NULL);
+    }
+    for (int i = 0; i < n; i += 2)
+        assert(tree_remove_sorted(&seq, &i, cmpInt));
+    assert(checkAVL(seq, NULL) <= 11);
+    assert(tree_size(seq) == (size_t)n / 2);
+    printf("OK\n");
+
+    tree_delete(root, NULL);
+    tree_delete(seq, NULL);
+}
+
+// Removing a node must not move the payload of any other node
+void testAVLRemoveStable(void) {
+    typedef struct {
+        int key;
+        double weight;
+        char name[20];
+    } Item;
+    Tree root = NULL;
+    Item *found[100];
+    int n = 100;
+
+    printf("\n===== Test AVL suppression stable =====\n");
+    for (int i = 0; i < n; i++) {
+        Item it = { (i * 37) % n, i / 2.0, "" };
+        snprintf(it.name, sizeof(it.name), "item-%d", it.key);
+        assert(tree_insert_sorted(&root, &it, sizeof(Item), cmpInt));
+    }
+    for (int i = 0; i < n; i++)
+        found[i] = tree_search(root, &i, cmpInt);
+
+    // Removing inner nodes first exercises the two children case
+    for (int i = 0; i < n; i += 3) {
+        int key = ((Item *)tree_get_data(root))->key;
+        assert(tree_remove_sorted(&root, &key, cmpInt));
+        found[key] = NULL;
+        checkAVL(root, NULL);
+    }
+    for (int i = 0; i < n; i++) {
+        if (!found[i])
+            continue;
+        char name[20];
+        snprintf(name, sizeof(name), "item-%d", i);
+        assert(tree_search(root, &i, cmpInt) == found[i]);
+        assert(found[i]->key == i && strcmp(found[i]->name, name) == 0);
+    }
+    printf("OK\n");
+
+    tree_delete(root, NULL);
+}
+
+void testAVLSlab(void) {
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+    Tree root = NULL;
+    int n = 1000;
+
+    printf("\n===== Test AVL avec slab =====\n");
+    assert(slab);
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n;
+        assert(tree_insert_sorted_slab(&root, slab, &v, sizeof(int), cmpInt));
+    }
+    checkAVL(root, NULL);
+
+    // A removed node is recycled by the next insertion
+    int key = 500;
+    int *data = tree_search(root, &key, cmpInt);
+    Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
+    assert(tree_remove_sorted_slab(&root, slab, &key, cmpInt));
+    key = n;
+    assert(tree_insert_sorted_slab(&root, slab, &key, sizeof(int), cmpInt));
+    assert(tree_search(root, &key, cmpInt) == node->data);
+    checkAVL(root, NULL);
+
+    // Payloads larger than the slab size are refused
+    double big = 1.0;
+    assert(!tree_insert_sorted_slab(&root, slab, &big, sizeof(big), cmpInt));
+    assert(tree_size(root) == (size_t)n);
+
+    int array[] = { 5, 3, 9, 1, 7 };
+    assert(tree_sort(array, 5, sizeof(int), cmpInt));
+    assert(array[0] == 1 && array[2] == 5 && array[4] == 9);
+    printf("OK\n");
+
+    tree_delete_slab(root, slab, NULL);
+    tree_slab_delete(slab);
+}
+
+// Check the in-order walk of a compact tree is sorted
+void checkSorted(void *data, void *extra_data) {
+    int *previous = extra_data;
+    assert(*previous <= *(int *)data);
+    *previous = *(int *)data;
+}
+
+// Links of node i in a compact snapshot: left, right, parent
+uint32_t *snapshotLinks(char *snapshot, uint32_t i) {
+    uint32_t *header = (uint32_t *)snapshot;
+    return (uint32_t *)(snapshot + 8 * sizeof(uint32_t) + i * header[6] +
+                        header[5]);
+}
+
+void testAVLCompact(void) {
+    CompactTree tree = compact_tree_new(sizeof(int));
+    size_t n = 0;
+
+    printf("\n===== Test AVL compact =====\n");
+    srand(7);
+    for (int i = 0; i < 3000; i++) {
+        int v = rand() % 1000;
+        if (rand() % 3) {
+            assert(compact_tree_insert_sorted(&tree, &v, cmpInt));
+            n++;
+        } else {
+            bool found = compact_tree_search(tree, &v, cmpInt) != NULL;
+            assert(compact_tree_remove_sorted(&tree, &v, cmpInt) == found);
+            n -= found;
+        }
+    }
+    int previous = -1;
+    compact_tree_in_order(tree, checkSorted, &previous);
+    assert(compact_tree_size(tree) == n);
+    assert(compact_tree_height(tree) <= 1.44 * 11); // n < 2048
+
+    // A snapshot is a plain copy of the bytes
+    size_t bytes = compact_tree_bytes(tree);
+    char *snapshot = malloc(bytes);
+    memcpy(snapshot, tree, bytes);
+    CompactTree copy = compact_tree_load(snapshot, bytes);
+    assert(copy && compact_tree_size(copy) == n);
+    for (int v = 0; v < 1000; v++)
+        assert((compact_tree_search(tree, &v, cmpInt) != NULL) ==
+               (compact_tree_search(copy, &v, cmpInt) != NULL));
+    int v = 1000;
+    assert(compact_tree_insert_sorted(&copy, &v, cmpInt));
+    assert(compact_tree_search(copy, &v, cmpInt));
+    assert(!compact_tree_load(snapshot, 16));
+    snapshot[0] ^= 1;
+    assert(!compact_tree_load(snapshot, bytes));
+    snapshot[0] ^= 1;
+
+    // Corrupt layouts and links are rejected rather than followed. Header:
+    // magic, root, count, capacity, size, links, stride, reserved; links of
+    // a node: left, right, parent.
+    uint32_t *header = (uint32_t *)snapshot;
+    uint32_t root = header[1];
+    uint32_t *top = snapshotLinks(snapshot, root);
+    uint32_t *first = snapshotLinks(snapshot, 0);
+    struct { uint32_t *field; uint32_t value; } corruptions[] = {
+        { &header[6], header[6] + 4 },          // stride of another size
+        { &header[1], header[2] },              // root out of range
+        { &top[0], header[2] + 1 },             // child out of range
+        { &top[0], root },                      // root its own child
+        { &first[0], 0 },                       // node 0 its own child
+        { &top[2], 0 },                         // root with a parent
+        { &top[2], top[2] | 3u << 30 },         // balance 2
+    };
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]);
+         i++) {
+        uint32_t saved = *corruptions[i].field;
+        *corruptions[i].field = corruptions[i].value;
+        assert(!compact_tree_load(snapshot, bytes));
+        *corruptions[i].field = saved;
+    }
+    CompactTree again = compact_tree_load(snapshot, bytes);
+    assert(again && compact_tree_size(again) == n);
+    compact_tree_delete(again, NULL);
+    printf("OK\n");
+
+    free(snapshot);
+    compact_tree_delete(copy, NULL);
+    compact_tree_delete(tree, NULL);
+}
+
+// Typed trees on int64 keys and on struct keys ordered by (major, minor)
+DEFINE_AVL(avl_i64, int64_t, (a > b) - (a < b))
+
+typedef struct {
+    int major;
+    int minor;
+} Version;
+
+DEFINE_AVL(avl_version, Version,
+           a.major != b.major ? a.major - b.major : a.minor - b.minor)
+
+void testAVLTyped(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test AVL typé =====\n");
+    for (int64_t i = 0; i < n; i++)
+        assert(avl_i64_insert(&tree, (i * 7) % n * 1000000007LL));
+    checkAVL(tree, NULL);
+    for (int64_t i = 0; i < n; i += 2)
+        assert(avl_i64_remove(&tree, i * 1000000007LL));
+    assert(!avl_i64_remove(&tree, 0));
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)n / 2);
+    assert(*avl_i64_search(tree, 1000000007LL) == 1000000007LL);
+    assert(!avl_i64_search(tree, 1));
+    tree_delete(tree, NULL);
+
+    tree = NULL;
+    for (int major = 3; major >= 0; major--)
+        for (int minor = 0; minor < 10; minor++)
+            assert(avl_version_insert(&tree, (Version){ major, minor }));
+    checkAVL(tree, NULL);
+    Version *v = avl_version_search(tree, (Version){ 2, 5 });
+    assert(v && v->major == 2 && v->minor == 5);
+    assert(avl_version_remove(&tree, (Version){ 2, 5 }));
+    assert(!avl_version_search(tree, (Version){ 2, 5 }));
+    assert(tree_size(tree) == 39);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testAVLIterate(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test AVL parcours par itérateur =====\n");
+    assert(!tree_first(tree) && !tree_last(tree));
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+
+    int expected = 0;
+    for (Tree node = tree_first(tree); node; node = tree_next(node))
+        assert(*(int *)tree_get_data(node) == expected++);
+    assert(expected == n);
+    for (Tree node = tree_last(tree); node; node = tree_prev(node))
+        assert(*(int *)tree_get_data(node) == --expected);
+    assert(expected == 0);
+
+    // Stop after k items
+    int k = 0;
+    for (Tree node = tree_first(tree); node && k < 10; node = tree_next(node))
+        k++;
+    assert(k == 10);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+// Sum the data of a range
+void sumInt(void *data, void *extra_data) {
+    *(long *)extra_data += *(int *)data;
+}
+
+void testAVLRange(void) {
+    Tree tree = NULL;
+    int n = 500;
+
+    printf("\n===== Test AVL recherches ordonnées =====\n");
+    // Even values 0, 2, ..., 2n - 2
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n * 2;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+    for (int v = -1; v <= 2 * n; v++) {
+        int even = v % 2 == 0;
+        Tree lower = tree_lower_bound(tree, &v, cmpInt);
+        Tree upper = tree_upper_bound(tree, &v, cmpInt);
+        Tree floor = tree_floor(tree, &v, cmpInt);
+        int next = even ? v : v + 1;
+        int previous = v >= 2 * n - 2 ? 2 * n - 2 : even ? v : v - 1;
+
+        assert(tree_ceil(tree, &v, cmpInt) == lower);
+        if (next < 2 * n)
+            assert(lower && *(int *)tree_get_data(lower) == next);
+        else
+            assert(!lower);
+        if (v + 1 < 2 * n - 1)
+            assert(upper && *(int *)tree_get_data(upper) == (v + 2) / 2 * 2);
+        else
+            assert(!upper);
+        if (previous >= 0)
+            assert(floor && *(int *)tree_get_data(floor) == previous);
+        else
+            assert(!floor);
+    }
+
+    // [10, 21) holds 10, 12, ..., 20
+    int lo = 10, hi = 21;
+    long sum = 0;
+    assert(tree_range(tree, &lo, &hi, cmpInt, sumInt, &sum) == 6);
+    assert(sum == 90);
+    assert(tree_range(tree, &hi, &lo, cmpInt, sumInt, &sum) == 0);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testAVLOrder(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test AVL rang et sélection =====\n");
+    // Even values 0, 2, ..., 2n - 2, then remove the multiples of 4
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n * 2;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+    for (int v = 0; v < 2 * n; v += 4)
+        assert(tree_remove_sorted(&tree, &v, cmpInt));
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)n / 2);
+
+    // The remaining values are 2, 6, 10, ...: rank k holds 4k + 2
+    for (size_t k = 0; k < (size_t)n / 2; k++) {
+        Tree node = tree_select(tree, k);
+        int v = 4 * (int)k + 2;
+        assert(node && *(int *)tree_get_data(node) == v);
+        assert(tree_rank(tree, &v, cmpInt) == k);
+        v++;
+        assert(tree_rank(tree, &v, cmpInt) == k + 1);
+    }
+    assert(!tree_select(tree, n / 2));
+    tree_delete(tree, NULL);
+
+    // Counts follow a tree built by hand, from the top
+    int i = 1, j = 2, k = 3;
+    Tree root = tree_create(&k, sizeof(int));
+    tree_set_left(root, tree_create(&i, sizeof(int)));
+    tree_set_right(tree_get_left(root), tree_create(&j, sizeof(int)));
+    assert(tree_size(root) == 3);
+    assert(*(int *)tree_get_data(tree_select(root, 1)) == 2);
+    printf("OK\n");
+
+    tree_delete(root, NULL);
+}
+
+void testAVLFromSorted(void) {
+    int n = 5000;
+    int *array = malloc(n * sizeof(int));
+
+    printf("\n===== Test AVL construit depuis un tableau trié =====\n");
+    for (int i = 0; i < n; i++)
+        array[i] = 2 * i;
+    assert(!tree_from_sorted(array, 0, sizeof(int)));
+    // Every shape of small tree, then a large one
+    for (int length = 1; length <= n;
+         length = length < 64 ? length + 1 : length * 8) {
+        Tree tree = tree_from_sorted(array, length, sizeof(int));
+        int height = 0;
+
+        while (length >> height)
+            height++;
+        checkAVL(tree, NULL);
+        assert(tree_size(tree) == (size_t)length);
+        assert(tree_height(tree) == (size_t)height);
+        int expected = 0;
+        for (Tree node = tree_first(tree); node; node = tree_next(node)) {
+            assert(*(int *)tree_get_data(node) == expected);
+            expected += 2;
+        }
+
+        // The tree takes insertions and removals as usual
+        int v = 3;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+        v = 0;
+        assert(tree_remove_sorted(&tree, &v, cmpInt));
+        checkAVL(tree, NULL);
+        tree_delete(tree, NULL);
+    }
+    printf("OK\n");
+
+    free(array);
+}
+
+void testAVLBatch(void) {
+    Tree tree = NULL;
+    int batch[3000];
+
+    printf("\n===== Test AVL insertion par lots =====\n");
+    srand(11);
+    for (int i = 0; i < 3000; i++)
+        batch[i] = rand() % 10000;
+    // Empty tree: built from the sorted batch
+    assert(tree_insert_batch(&tree, batch, 3000, sizeof(int), cmpInt) ==
+           TREE_BATCH_REBUILD);
+    checkAVL(tree, NULL);
+    // Small batches: inserted from the previous insertion point
+    for (int round = 0; round < 10; round++) {
+        int *small = batch + round * 30;
+        for (int i = 0; i < 30; i++)
+            small[i] = rand() % 10000;
+        assert(tree_insert_batch(&tree, small, 30, sizeof(int), cmpInt) ==
+               TREE_BATCH_FINGER);
+        checkAVL(tree, NULL);
+    }
+    assert(tree_size(tree) == 3300);
+    // Large batch: merged with the tree
+    assert(tree_insert_batch(&tree, batch, 1000, sizeof(int), cmpInt) ==
+           TREE_BATCH_REBUILD);
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == 4300);
+    int previous = -1;
+    tree_in_order(tree, checkSorted, &previous);
+    for (int i = 0; i < 1000; i++)
+        assert(tree_search(tree, &batch[i], cmpInt));
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testAVLJoinSplit(void) {
+    int n = 2000;
+    int *array = malloc(n * sizeof(int));
+
+    printf("\n===== Test AVL jointure et découpage =====\n");
+    for (int i = 0; i < n; i++)
+        array[i] = 2 * i;
+    srand(5);
+    for (int round = 0; round < 50; round++) {
+        Tree tree = NULL;
+        Tree lo, hi;
+        int length = rand() % n;
+        int key = rand() % (2 * n + 2) - 1;
+
+        // Trees built both ways, to vary the shapes
+        if (round % 2)
+            tree = tree_from_sorted(array, length, sizeof(int));
+        else
+            for (int i = 0; i < length; i++)
+                assert(tree_insert_sorted(&tree, &array[(i * 7) % length],
+                                          sizeof(int), cmpInt));
+        tree_split(tree, &key, cmpInt, &lo, &hi);
+        checkAVL(lo, NULL);
+        checkAVL(hi, NULL);
+        assert(tree_size(lo) + tree_size(hi) == (size_t)length);
+        assert(!lo || *(int *)tree_get_data(tree_last(lo)) < key);
+        assert(!hi || *(int *)tree_get_data(tree_first(hi)) >= key);
+
+        // Odd keys are absent: join back with a pivot, or without
+        if (key % 2) {
+            tree = tree_join(lo, tree_create(&key, sizeof(int)), hi);
+            assert(tree_size(tree) == (size_t)length + 1);
+        } else {
+            tree = tree_concat(lo, hi);
+            assert(tree_size(tree) == (size_t)length);
+        }
+        checkAVL(tree, NULL);
+        int previous = -2;
+        tree_in_order(tree, checkSorted, &previous);
+        tree_delete(tree, NULL);
+    }
+    printf("OK\n");
+
+    free(array);
+}
+
+// Tree of the keys i < n with member[i] set, and their number in *length
+Tree subsetTree(const bool *member, int n, int *keys, size_t *length) {
+    *length = 0;
+    for (int i = 0; i < n; i++)
+        if (member[i])
+            keys[(*length)++] = i;
+    return tree_from_sorted(keys, *length, sizeof(int));
+}
+
+void testAVLSetOps(void) {
+    int sizes[] = {0, 1, 50, 3000, 100000};
+    int n = 100000;
+    bool *in1 = malloc(n * sizeof(bool));
+    bool *in2 = malloc(n * sizeof(bool));
+    int *keys = malloc(n * sizeof(int));
+
+    printf("\n===== Test AVL union, intersection et différence =====\n");
+    srand(6);
+    for (int round = 0; round < 25; round++) {
+        int n1 = sizes[round % 5], n2 = sizes[round / 5];
+        size_t l1, l2, expected[3] = {0, 0, 0};
+        Tree result[3];
+
+        for (int i = 0; i < n; i++) {
+            in1[i] = i < n1 && rand() % 2;
+            in2[i] = i < n2 && rand() % 3 == 0;
+            expected[0] += in1[i] || in2[i];
+            expected[1] += in1[i] && in2[i];
+            expected[2] += in1[i] && !in2[i];
+        }
+        for (int op = 0; op < 3; op++) {
+            Tree t1 = subsetTree(in1, n, keys, &l1);
+            Tree t2 = subsetTree(in2, n, keys, &l2);
+
+            if (op == 0)
+                result[op] = tree_union(t1, t2, cmpInt, NULL);
+            else if (op == 1)
+                result[op] = tree_intersection(t1, t2, cmpInt, NULL);
+            else
+                result[op] = tree_difference(t1, t2, cmpInt, NULL);
+            checkAVL(result[op], NULL);
+            assert(tree_size(result[op]) == expected[op]);
+            int previous = -1;
+            tree_in_order(result[op], checkSorted, &previous);
+        }
+        for (int i = 0; i < n; i++) {
+            assert((tree_search(result[0], &i, cmpInt) != NULL) ==
+                   (in1[i] || in2[i]));
+            assert((tree_search(result[1], &i, cmpInt) != NULL) ==
+                   (in1[i] && in2[i]));
+            assert((tree_search(result[2], &i, cmpInt) != NULL) ==
+                   (in1[i] && !in2[i]));
+        }
+        for (int op = 0; op < 3; op++)
+            tree_delete(result[op], NULL);
+    }
+    printf("OK\n");
+
+    free(keys);
+    free(in2);
+    free(in1);
+}
+
+int comparisons = 0;
+
+int cmpIntCounted(const void *a, const void *b) {
+    comparisons++;
+    return cmpInt(a, b);
+}
+
+void testAVLHint(void) {
+    int n = 20000;
+    Tree tree = NULL;
+    Tree rightmost = NULL;
+    Tree node = NULL;
+
+    printf("\n===== Test AVL insertion avec indice =====\n");
+    // Increasing keys with a few late ones: appends cost one comparison
+    srand(7);
+    for (int i = 0; i < n; i++) {
+        int key = i % 10 == 9 ? i - rand() % 50 : i;
+        comparisons = 0;
+        node = tree_insert_rightmost(&tree, &rightmost, &key, sizeof(int),
+                                     cmpIntCounted);
+        assert(node && *(int *)tree_get_data(node) == key);
+        assert(rightmost == tree_last(tree));
+        assert(i % 10 == 9 || comparisons <= 1);
+    }
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)n);
+    int previous = -100;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete(tree, NULL);
+
+    // Decreasing keys, each one hinted by the previous node
+    tree = NULL;
+    node = NULL;
+    comparisons = 0;
+    for (int i = n; i > 0; i--)
+        node = tree_insert_hint(&tree, node, &i, sizeof(int), cmpIntCounted);
+    assert(comparisons <= 3 * n);
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)n);
+    assert(*(int *)tree_get_data(tree_first(tree)) == 1);
+
+    // Any node is a valid hint, even far from the data
+    for (int i = 0; i < n; i++) {
+        int key = rand() % (2 * n);
+        Tree hint = tree_select(tree, rand() % tree_size(tree));
+        node = tree_insert_hint(&tree, hint, &key, sizeof(int), cmpInt);
+        assert(*(int *)tree_get_data(node) == key);
+    }
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)2 * n);
+    previous = 0;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    int key;
+    int value;
+} Pair;
+
+int cmpPair(const void *a, const void *b) {
+    return cmpInt(&((const Pair *)a)->key, &((const Pair *)b)->key);
+}
+
+void testAVLUnique(void) {
+    int n = 1000;
+    int *counts = calloc(n, sizeof(int));
+    int *values = malloc(n * sizeof(int));
+    Tree set = NULL, map = NULL, multiset = NULL;
+    size_t distinct = 0;
+    bool inserted;
+    int height = 0;
+
+    printf("\n===== Test AVL insertion unique, mise à jour et multi-ensemble =====\n");
+    srand(8);
+    for (int i = 0; i < 20 * n; i++) {
+        int key = rand() % n;
+        Pair pair = {key, i};
+
+        // One descent each: no more comparisons than a search
+        comparisons = 0;
+        Tree node = tree_insert_unique(&set, &key, sizeof(int), cmpIntCounted,
+                                       &inserted);
+        assert(comparisons <= height);
+        assert(*(int *)tree_get_data(node) == key);
+        assert(inserted == (counts[key] == 0));
+        if (inserted) {
+            distinct++;
+            height = tree_height(set);
+        }
+
+        node = tree_upsert(&map, &pair, sizeof(Pair), cmpPair, &inserted);
+        assert(inserted == (counts[key] == 0));
+        assert(((Pair *)tree_get_data(node))->value == i);
+        values[key] = i;
+
+        node = tree_multiset_add(&multiset, &key, sizeof(int), cmpInt);
+        assert(*(int *)tree_multiset_get_data(node) == key);
+        assert(tree_multiset_get_count(node) == (size_t)++counts[key]);
+    }
+    assert(tree_size(set) == distinct && tree_size(map) == distinct);
+    assert(tree_size(multiset) == distinct);
+    checkAVL(set, NULL);
+    checkAVL(map, NULL);
+    for (Tree node = tree_first(map); node; node = tree_next(node)) {
+        Pair *pair = tree_get_data(node);
+        assert(pair->value == values[pair->key]);
+    }
+
+    // Remove occurrences one at a time: the node goes with the last one
+    for (int i = 0; i < 10 * n; i++) {
+        int key = rand() % n;
+        assert(tree_multiset_remove(&multiset, &key, cmpInt) ==
+               (counts[key] > 0));
+        if (counts[key] > 0 && --counts[key] == 0)
+            distinct--;
+        assert(tree_multiset_count(multiset, &key, cmpInt) ==
+               (size_t)counts[key]);
+    }
+    assert(tree_size(multiset) == distinct);
+    checkAVL(multiset, NULL);
+    int previous = -1;
+    for (Tree node = tree_first(multiset); node; node = tree_next(node)) {
+        int key = *(int *)tree_multiset_get_data(node);
+        assert(key > previous && counts[key] > 0);
+        assert(tree_multiset_get_count(node) == (size_t)counts[key]);
+        previous = key;
+    }
+    tree_delete(multiset, NULL);
+    tree_delete(map, NULL);
+    tree_delete(set, NULL);
+    printf("OK\n");
+
+    free(values);
+    free(counts);
+}
+
+void testAVLRemoveNode(void) {
+    int n = 5000;
+    Tree tree = NULL;
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+
+    printf("\n===== Test AVL suppression par noeud =====\n");
+    for (int i = 0; i < n; i++) {
+        int key = (i * 7) % n;
+        assert(tree_insert_sorted_slab(&tree, slab, &key, sizeof(int),
+                                       cmpInt));
+    }
+
+    // Evict while walking from the minimum, without any comparison
+    comparisons = 0;
+    for (Tree node = tree_first(tree); node;) {
+        int key = *(int *)tree_get_data(node);
+        if (key % 3)
+            node = tree_remove_node_slab(&tree, slab, node);
+        else
+            node = tree_next(node);
+        assert(!node || *(int *)tree_get_data(node) == key + 1);
+    }
+    assert(comparisons == 0);
+    checkAVL(tree, NULL);
+    assert(tree_size(tree) == (size_t)(n + 2) / 3);
+    int previous = -1;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete_slab(tree, slab, NULL);
+    tree_slab_delete(slab);
+
+    // Remove every node, from the maximum down
+    tree = NULL;
+    for (int i = 0; i < n; i++)
+        assert(tree_insert_sorted(&tree, &i, sizeof(int), cmpInt));
+    for (int i = n - 1; i >= 0; i--) {
+        Tree last = tree_last(tree);
+        assert(*(int *)tree_get_data(last) == i);
+        assert(tree_remove_node(&tree, last) == NULL);
+        if (i % 500 == 0)
+            checkAVL(tree, NULL);
+    }
+    assert(tree == NULL);
+    printf("OK\n");
+}
+
+void testAVLHandle(void) {
+    int n = 3000;
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+
+    printf("\n===== Test AVL avec poignée =====\n");
+    srand(9);
+    for (int round = 0; round < 2; round++) {
+        TreeHandle handle = tree_handle_new(sizeof(int), cmpInt,
+                                            round ? slab : NULL);
+        assert(tree_handle_size(handle) == 0);
+        assert(!tree_handle_first(handle) && !tree_handle_last(handle));
+
+        // Random insertions and removals, the cache checked against walks
+        for (int i = 0; i < 4 * n; i++) {
+            int key = rand() % n;
+            bool inserted;
+
+            if (rand() % 3)
+                assert(tree_handle_insert(handle, &key));
+            else if (rand() % 2)
+                tree_handle_remove(handle, &key);
+            else
+                assert(tree_handle_insert_unique(handle, &key, &inserted));
+            Tree root = tree_handle_root(handle);
+            assert(tree_handle_size(handle) == tree_size(root));
+            assert(tree_handle_first(handle) == tree_first(root));
+            assert(tree_handle_last(handle) == tree_last(root));
+        }
+        checkAVL(tree_handle_root(handle), NULL);
+        int key = *(int *)tree_get_data(tree_handle_last(handle));
+        assert(*(int *)tree_handle_search(handle, &key) == key);
+
+        // Pop the minimum until empty
+        int previous = -1;
+        while (tree_handle_size(handle) > 0) {
+            Tree first = tree_handle_first(handle);
+            assert(*(int *)tree_get_data(first) >= previous);
+            previous = *(int *)tree_get_data(first);
+            tree_handle_remove_node(handle, first);
+            assert(tree_handle_first(handle) ==
+                   tree_first(tree_handle_root(handle)));
+        }
+        assert(!tree_handle_root(handle) && !tree_handle_last(handle));
+        assert(tree_handle_insert(handle, &key));
+        tree_handle_delete(handle, NULL);
+    }
+
+    // Two trees on one slab: deleting one leaves the nodes of the other
+    TreeHandle one = tree_handle_new(sizeof(int), cmpInt, slab);
+    TreeHandle other = tree_handle_new(sizeof(int), cmpInt, slab);
+    for (int i = 0; i < n; i++) {
+        assert(tree_handle_insert(one, &i));
+        assert(tree_handle_insert(other, &i));
+    }
+    tree_handle_delete(one, NULL);
+    for (int i = 0; i < n; i++) {
+        int key = n + i; // on the nodes given back by one
+
+        assert(*(int *)tree_handle_search(other, &i) == i);
+        assert(tree_handle_insert(other, &key));
+    }
+    checkAVL(tree_handle_root(other), NULL);
+    assert(tree_handle_size(other) == 2 * (size_t)n);
+    tree_handle_delete(other, NULL);
+    tree_slab_delete(slab);
+    printf("OK\n");
+}
+
+void testAVLPriorityQueue(void) {
+    TreeHandle queue = tree_handle_new(sizeof(int), cmpInt, NULL);
+    int now = 0, key;
+
+    printf("\n===== Test AVL file de priorité =====\n");
+    assert(!tree_handle_peek_min(queue) && !tree_handle_pop_min(queue, &key));
+    // Timers: each expired one is rearmed later, the minimum never decreases
+    srand(10);
+    for (int i = 0; i < 1000; i++) {
+        key = rand() % 1000;
+        assert(tree_handle_insert(queue, &key));
+    }
+    for (int i = 0; i < 20000; i++) {
+        int peeked = *(int *)tree_handle_peek_min(queue);
+        assert(tree_handle_pop_min(queue, &key) && key == peeked);
+        assert(key >= now);
+        now = key;
+        key = now + 1 + rand() % 1000;
+        assert(tree_handle_insert(queue, &key));
+        assert(*(int *)tree_handle_peek_max(queue) >= key);
+    }
+    checkAVL(tree_handle_root(queue), NULL);
+    assert(tree_handle_size(queue) == 1000);
+
+    // Drain from the maximum
+    int previous = *(int *)tree_handle_peek_max(queue);
+    while (tree_handle_pop_max(queue, &key)) {
+        assert(key <= previous);
+        previous = key;
+    }
+    assert(tree_handle_size(queue) == 0 && !tree_handle_peek_max(queue));
+    tree_handle_delete(queue, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    SyncTree tree;
+    int n;
+    int id;
+} SyncJob;
+
+void *syncWriter(void *arg) {
+    SyncJob *job = arg;
+
+    // Batches of 100 insertions under one lock
+    for (int i = job->id; i < job->n; i += 200) {
+        TreeHandle handle = sync_tree_write_begin(job->tree);
+        for (int k = i; k < i + 200 && k < job->n; k += 2)
+            assert(tree_handle_insert(handle, &k));
+        sync_tree_write_end(job->tree);
+    }
+    // Then single removals of a quarter of the keys
+    for (int k = job->id; k < job->n; k += 4)
+        assert(sync_tree_remove(job->tree, &k));
+    return NULL;
+}
+
+void *syncReader(void *arg) {
+    SyncJob *job = arg;
+
+    // Short scans, in parallel with each other and between the writes
+    for (int i = 0; i < 2000; i++) {
+        int lo = (i * 97) % job->n, hi = lo + 100;
+        int previous = -1;
+        size_t count = sync_tree_range(job->tree, &lo, &hi, checkSorted,
+                                       &previous);
+        assert(count <= 100);
+
+        // A read section sees one consistent tree
+        TreeHandle handle = sync_tree_read_begin(job->tree);
+        assert(tree_handle_size(handle) ==
+               tree_size(tree_handle_root(handle)));
+        sync_tree_read_end(job->tree);
+    }
+    return NULL;
+}
+
+void *sortJob(void *arg) {
+    SyncJob *job = arg;
+    int *array = malloc(job->n * sizeof(int));
+
+    for (int i = 0; i < job->n; i++)
+        array[i] = (i * 7919 + job->id) % job->n;
+    assert(tree_sort(array, job->n, sizeof(int), cmpInt));
+    for (int i = 0; i < job->n; i++)
+        assert(array[i] == i);
+    free(array);
+    return NULL;
+}
+
+typedef struct {
+    SyncTree tree;
+    atomic_bool done;  // the writer got through
+    atomic_int starved; // readers that gave up waiting for it
+} WriterProgress;
+
+void *progressReader(void *arg) {
+    WriterProgress *progress = arg;
+
+    // Overlapping read sections: some reader always holds the lock
+    for (int i = 0; !atomic_load(&progress->done); i++) {
+        if (i == 100000) {
+            atomic_fetch_add(&progress->starved, 1);
+            break;
+        }
+        sync_tree_read_begin(progress->tree);
+        sched_yield();
+        sync_tree_read_end(progress->tree);
+    }
+    return NULL;
+}
+
+void *progressWriter(void *arg) {
+    WriterProgress *progress = arg;
+
+    for (int k = 0; k < 100; k++)
+        assert(sync_tree_insert(progress->tree, &k));
+    atomic_store(&progress->done, true);
+    return NULL;
+}
+
+void testAVLSync(void) {
+    int n = 20000;
+    SyncTree tree = sync_tree_new(sizeof(int), cmpInt);
+    pthread_t threads[4];
+    SyncJob jobs[4];
+
+    printf("\n===== Test AVL partagé entre threads =====\n");
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (SyncJob){tree, n, i % 2};
+        assert(pthread_create(&threads[i], NULL,
+                              i < 2 ? syncWriter : syncReader, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    assert(sync_tree_size(tree) == (size_t)n / 2);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(sync_tree_search(tree, &k, &found) == (k % 4 >= 2));
+        assert(k % 4 < 2 || found == k);
+    }
+    sync_tree_delete(tree, NULL);
+
+    // A writer among readers that keep the lock busy must get through
+    WriterProgress progress = { .tree = sync_tree_new(sizeof(int), cmpInt) };
+    atomic_init(&progress.done, false);
+    atomic_init(&progress.starved, 0);
+    for (int i = 0; i < 4; i++)
+        assert(pthread_create(&threads[i], NULL,
+                              i < 3 ? progressReader : progressWriter,
+                              &progress) == 0);
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    assert(atomic_load(&progress.starved) == 0);
+    assert(sync_tree_size(progress.tree) == 100);
+    sync_tree_delete(progress.tree, NULL);
+
+    // Concurrent sorts of distinct arrays
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (SyncJob){NULL, 1000 * (i + 1) + 1, i};
+        assert(pthread_create(&threads[i], NULL, sortJob, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    ConcurrentTree tree;
+    int n;
+    int id;
+    int *values;
+    bool *present;
+} ConcurrentJob;
+
+void *concurrentWorker(void *arg) {
+    ConcurrentJob *job = arg;
+    ConcurrentSlot slot = concurrent_tree_slot_new(job->tree);
+
+    // Each thread updates the keys k % 4 == id, and reads all of them
+    for (int round = 0; round < 3; round++) {
+        for (int k = job->id; k < job->n; k += 4) {
+            void *previous = &previous;
+            assert(concurrent_tree_put(slot, &k, &job->values[k],
+                                       &previous));
+            assert(previous == (job->present[k] ? &job->values[k] : NULL));
+            job->present[k] = true;
+        }
+        for (int k = job->id; k < job->n; k += 4) {
+            if ((k / 4 + round) % 3 == 0) {
+                assert(concurrent_tree_remove(slot, &k) ==
+                       (job->present[k] ? &job->values[k] : NULL));
+                job->present[k] = false;
+            }
+            int other = (k * 7919) % job->n;
+            int *value = concurrent_tree_get(slot, &other);
+            assert(!value || value == &job->values[other]);
+            assert(concurrent_tree_get(slot, &k) ==
+                   (job->present[k] ? &job->values[k] : NULL));
+        }
+    }
+    concurrent_tree_slot_delete(slot);
+    return NULL;
+}
+
+// Nodes waiting for their release during the churn: one thread preempted
+// in an operation holds back the epoch for its time slice
+#define CHURN_RETIRED_MAX 50000
+
+void *churnWorker(void *arg) {
+    ConcurrentJob *job = arg;
+    ConcurrentSlot slot = concurrent_tree_slot_new(job->tree);
+
+    // Add and remove the even keys k % 8 == 2 * id, between odd keys that
+    // stay: the removals unlink 4 * 50000 nodes in all
+    for (int i = 0; i < 50000; i++) {
+        int k = (i * 8 + 2 * job->id) % job->n;
+
+        assert(concurrent_tree_put(slot, &k, &job->values[k], NULL));
+        assert(concurrent_tree_get(slot, &k) == &job->values[k]);
+        assert(concurrent_tree_remove(slot, &k) == &job->values[k]);
+        assert(concurrent_tree_retired(job->tree) <= CHURN_RETIRED_MAX);
+    }
+    concurrent_tree_slot_delete(slot);
+    return NULL;
+}
+
+void checkConcurrent(const void *key, void *value, void *extra_data) {
+    int *previous = extra_data;
+
+    assert(*(const int *)key > *previous);
+    assert(*(int *)value == *(const int *)key);
+    *previous = *(const int *)key;
+}
+
+void testAVLConcurrent(void) {
+    int n = 40000;
+    ConcurrentTree tree = concurrent_tree_new(sizeof(int), cmpInt);
+    int *values = malloc(n * sizeof(int));
+    bool *present = calloc(n, sizeof(bool));
+    pthread_t threads[4];
+    ConcurrentJob jobs[4];
+    size_t count = 0, height = 0;
+    int previous = -1;
+
+    printf("\n===== Test AVL concurrent =====\n");
+    for (int k = 0; k < n; k++)
+        values[k] = k;
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (ConcurrentJob){tree, n, i, values, present};
+        assert(pthread_create(&threads[i], NULL, concurrentWorker,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int k = 0; k < n; k++)
+        count += present[k];
+    assert(concurrent_tree_size(tree) == count);
+    concurrent_tree_in_order(tree, checkConcurrent, &previous);
+
+    // Balanced once the updates are over, routing nodes included
+    for (size_t m = count; m > 0; m /= 2)
+        height++;
+    printf("%zu clés, hauteur %zu\n", count, concurrent_tree_height(tree));
+    assert(concurrent_tree_height(tree) <= 3 * height / 2 + 2);
+    concurrent_tree_delete(tree);
+
+    // Removed nodes are released while the tree is in use
+    tree = concurrent_tree_new(sizeof(int), cmpInt);
+    ConcurrentSlot slot = concurrent_tree_slot_new(tree);
+    for (int k = 1; k < n; k += 2)
+        assert(concurrent_tree_put(slot, &k, &values[k], NULL));
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (ConcurrentJob){tree, n, i, values, present};
+        assert(pthread_create(&threads[i], NULL, churnWorker,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    printf("%zu noeuds retirés pas encore libérés\n",
+           concurrent_tree_retired(tree));
+    assert(concurrent_tree_size(tree) == (size_t)n / 2);
+    concurrent_tree_slot_delete(slot);
+    concurrent_tree_delete(tree);
+    free(values);
+    free(present);
+    printf("OK\n");
+}
+
+typedef struct {
+    ShardTree tree;
+    int n;
+    int id;
+} ShardJob;
+
+void *shardWriter(void *arg) {
+    ShardJob *job = arg;
+
+    // Insertions of the keys k % 4 == id, then removal of half of them
+    for (int k = job->id; k < job->n; k += 4)
+        assert(shard_tree_insert(job->tree, &k));
+    for (int k = job->id; k < job->n; k += 8)
+        assert(shard_tree_remove(job->tree, &k));
+    return NULL;
+}
+
+void *shardRebuilder(void *arg) {
+    ShardJob *job = arg;
+
+    // Split points moved while the writers run
+    for (int i = 0; i < 20; i++) {
+        int points[3] = {i * 100, i * 200, i * 300};
+        assert(shard_tree_rebuild(job->tree, i % 2 ? NULL : points));
+    }
+    return NULL;
+}
+
+void testAVLShard(void) {
+    int n = 40000, points[3] = {10000, 20000, 30000};
+    ShardTree tree = shard_tree_new(sizeof(int), cmpInt, 4, points);
+    pthread_t threads[5];
+    ShardJob jobs[5];
+    int previous = -1, lo = 15000, hi = 25000;
+
+    printf("\n===== Test AVL réparti par intervalles de clés =====\n");
+    assert(shard_tree_count(tree) == 4);
+    for (int i = 0; i < 5; i++) {
+        jobs[i] = (ShardJob){tree, n, i};
+        assert(pthread_create(&threads[i], NULL,
+                              i < 4 ? shardWriter : shardRebuilder,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 5; i++)
+        pthread_join(threads[i], NULL);
+
+    // Keys k % 8 >= 4 are left, in order across the shards
+    assert(shard_tree_size(tree, 4) == (size_t)n / 2);
+    shard_tree_in_order(tree, checkSorted, &previous);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(shard_tree_search(tree, &k, &found) == (k % 8 >= 4));
+        assert(k % 8 < 4 || found == k);
+    }
+    previous = -1;
+    assert(shard_tree_range(tree, &lo, &hi, checkSorted, &previous) ==
+           (size_t)(hi - lo) / 2);
+
+    // Equal shards after a rebuild without split points
+    assert(shard_tree_rebuild(tree, NULL));
+    for (size_t i = 0; i < 4; i++)
+        assert(shard_tree_size(tree, i) == (size_t)n / 8);
+    assert(shard_tree_rebuild(tree, points));
+    assert(shard_tree_size(tree, 0) == (size_t)points[0] / 2);
+
+    // Points that move past the others: the payloads between the old and
+    // the new places change shards, none is lost or doubled
+    int crossing[3] = {2000, 36000, 38000}, sizes[4] = {1000, 17000, 1000,
+                                                        1000};
+    for (int round = 0; round < 2; round++) {
+        assert(shard_tree_rebuild(tree, round ? points : crossing));
+        for (size_t i = 0; i < 4; i++)
+            assert(shard_tree_size(tree, i) ==
+                   (round ? (size_t)n / 8 : (size_t)sizes[i]));
+        previous = -1;
+        shard_tree_in_order(tree, checkSorted, &previous);
+        for (int k = 4; k < n; k += 8)
+            assert(shard_tree_search(tree, &k, NULL));
+        assert(shard_tree_size(tree, 4) == (size_t)n / 2);
+    }
+    shard_tree_delete(tree, NULL);
+
+    // From a tree in a single shard, and back to it
+    tree = shard_tree_new(sizeof(int), cmpInt, 4, NULL);
+    assert(shard_tree_rebuild(tree, NULL) && shard_tree_size(tree, 0) == 0);
+    for (int k = 0; k < n; k++)
+        assert(shard_tree_insert(tree, &k));
+    assert(shard_tree_size(tree, 0) == (size_t)n);
+    assert(shard_tree_rebuild(tree, NULL));
+    for (size_t i = 0; i < 4; i++)
+        assert(shard_tree_size(tree, i) == (size_t)n / 4);
+    assert(shard_tree_search(tree, &(int){n / 4}, NULL));
+    assert(shard_tree_rebuild(tree, (int[3]){n, n, n}));
+    assert(shard_tree_size(tree, 0) == (size_t)n);
+    shard_tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    CombiningTree tree;
+    int n;
+    int id;
+} CombiningJob;
+
+void *combiningWorker(void *arg) {
+    CombiningJob *job = arg;
+    CombiningSlot slot = combining_tree_slot_new(job->tree);
+
+    // Insertions of the keys k % 4 == id, then removal of half of them
+    assert(slot);
+    for (int k = job->id; k < job->n; k += 4) {
+        int found = -1;
+        assert(combining_tree_insert(slot, &k));
+        assert(combining_tree_search(slot, &k, &found) && found == k);
+    }
+    for (int k = job->id; k < job->n; k += 8)
+        assert(combining_tree_remove(slot, &k));
+    combining_tree_slot_delete(slot);
+    return NULL;
+}
+
+void testAVLCombining(void) {
+    int n = 40000;
+    CombiningTree tree = combining_tree_new(sizeof(int), cmpInt);
+    pthread_t threads[4];
+    CombiningJob jobs[4];
+    CombiningSlot slot;
+
+    printf("\n===== Test AVL par combinaison des requêtes =====\n");
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (CombiningJob){tree, n, i};
+        assert(pthread_create(&threads[i], NULL, combiningWorker,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    // Keys k % 8 >= 4 are left; the slot of a finished thread is reused
+    assert(combining_tree_size(tree) == (size_t)n / 2);
+    slot = combining_tree_slot_new(tree);
+    assert(slot);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(combining_tree_search(slot, &k, &found) == (k % 8 >= 4));
+        assert(k % 8 < 4 || found == k);
+    }
+    assert(!combining_tree_remove(slot, &(int){0}));
+    assert(combining_tree_search(slot, &(int){4}, NULL));
+    combining_tree_slot_delete(slot);
+    assert(combining_tree_slot_new(tree) == slot);
+    combining_tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
 /// ------------------ MAIN ------------------
 
 int main(void) {
@@ -192,6 +1456,27 @@ int main(void) {
     testAVLInt();           // AVL with integers
     testAVLStr();           // AVL with strings
     testAVLEntry();         // AVL with structs
+    testAVLInvariants();    // AVL balance factors and parents
+    testAVLRemoveStable();  // AVL removal keeps other payloads in place
+    testAVLSlab();          // AVL with nodes from a slab
+    testAVLCompact();       // AVL on 32-bit indices
+    testAVLTyped();         // AVL specialized for a key type
+    testAVLIterate();       // AVL walked with first/next and last/prev
+    testAVLRange();         // AVL bounds and range scans
+    testAVLOrder();         // AVL rank and select
+    testAVLFromSorted();    // AVL built from a sorted array
+    testAVLBatch();         // AVL batch insertion
+    testAVLJoinSplit();     // AVL join and split
+    testAVLSetOps();        // AVL union, intersection and difference
+    testAVLHint();          // AVL insertion from a hint
+    testAVLUnique();        // AVL insert-or-find, upsert and multiset
+    testAVLRemoveNode();    // AVL removal of a node already found
+    testAVLHandle();        // AVL behind a handle caching size, first and last
+    testAVLPriorityQueue(); // AVL peek and pop of the minimum and maximum
+    testAVLSync();          // AVL shared between threads, concurrent sorts
+    testAVLConcurrent();    // AVL updated by threads without a global lock
+    testAVLShard();         // AVL split into shards by key range
+    testAVLCombining();     // AVL shared by flat combining
 
     printf("\nTous les tests sont terminés avec succès.\n");
     return EXIT_SUCCESS;
@@ -0,0 +1,275 @@
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "tree-avl-combining.h"
+#include "tree-avl.h"
+
+/*--------------------------------------------------------------------*/
+/* Flat combining, after Hendler, Incze, Shavit and Tzafrir, "Flat
+   Combining and the Synchronization-Parallelism Tradeoff" (SPAA 2010).
+
+   A request is the operation and its arguments in the slot of the caller;
+   storing the operation publishes it. The caller then waits until the
+   operation is reset to NONE, trying the combiner lock meanwhile: the
+   combiner collects the pending slots, sorts them by payload, applies
+   them to the tree and resets each operation once its result is stored.
+   Only the combiner touches the tree, its count and its slab.
+
+   Slots are pushed on a list that never shrinks: a deleted slot is marked
+   free for the next registration, the combiner may be walking it. */
+
+// Spins on a busy lock before yielding the processor
+#define SPIN_COUNT 100
+
+typedef enum { NONE, SEARCH, INSERT, REMOVE } Operation;
+
+struct _CombiningSlot
+  {
+    // One cache line per slot, written by its thread and the combiner only
+    _Alignas (64) atomic_int operation;
+    bool done;
+    const void *data;
+    void *result;
+    CombiningSlot batch; // next pending slot, combiner only
+    CombiningSlot next;
+    atomic_bool used;
+    CombiningTree tree;
+  };
+
+struct _CombiningTree
+  {
+    atomic_bool lock;
+    _Atomic (CombiningSlot) slots;
+    Tree root;
+    TreeSlab *slab;
+    atomic_size_t count;
+    size_t size;
+    int (*compare) (const void *, const void *);
+  };
+
+CombiningTree
+combining_tree_new (size_t size, int (*compare) (const void *, const void *))
+{
+  CombiningTree tree = malloc (sizeof (*tree));
+
+  if (!tree)
+    return NULL;
+
+  atomic_init (&tree->lock, false);
+  atomic_init (&tree->slots, NULL);
+  atomic_init (&tree->count, 0);
+  tree->root = NULL;
+  tree->slab = tree_slab_new (size); // NULL: fall back on malloc
+  tree->size = size;
+  tree->compare = compare;
+  return tree;
+}
+
+void
+combining_tree_delete (CombiningTree tree, void (*delete_data) (void *))
+{
+  CombiningSlot slot, next;
+
+  if (tree)
+    {
+      for (slot = atomic_load (&tree->slots); slot; slot = next)
+        {
+          next = slot->next;
+          free (slot);
+        }
+      tree_delete_slab (tree->root, tree->slab, delete_data);
+      tree_slab_delete (tree->slab);
+      free (tree);
+    }
+}
+
+CombiningSlot
+combining_tree_slot_new (CombiningTree tree)
+{
+  CombiningSlot slot;
+
+  // Reuse the slot of a deleted thread
+  for (slot = atomic_load (&tree->slots); slot; slot = slot->next)
+    {
+      bool used = false;
+
+      if (atomic_compare_exchange_strong (&slot->used, &used, true))
+        return slot;
+    }
+
+  slot = aligned_alloc (_Alignof (struct _CombiningSlot), sizeof (*slot));
+  if (!slot)
+    return NULL;
+  atomic_init (&slot->operation, NONE);
+  atomic_init (&slot->used, true);
+  slot->tree = tree;
+  slot->next = atomic_load (&tree->slots);
+  while (!atomic_compare_exchange_weak (&tree->slots, &slot->next, slot))
+    ;
+  return slot;
+}
+
+void
+combining_tree_slot_delete (CombiningSlot slot)
+{
+  if (slot)
+    atomic_store (&slot->used, false);
+}
+
+size_t
+combining_tree_size (CombiningTree tree)
+{
+  return atomic_load_explicit (&tree->count, memory_order_relaxed);
+}
+
+/*--------------------------------------------------------------------*/
+/* Combiner */
+
+static CombiningSlot
+merge_batches (CombiningTree tree, CombiningSlot a, CombiningSlot b)
+{
+  CombiningSlot head = NULL, *tail = &head;
+
+  // Stable: a goes first on equal payloads
+  while (a && b)
+    if (tree->compare (b->data, a->data) < 0)
+      {
+        *tail = b;
+        tail = &b->batch;
+        b = b->batch;
+      }
+    else
+      {
+        *tail = a;
+        tail = &a->batch;
+        a = a->batch;
+      }
+  *tail = a ? a : b;
+  return head;
+}
+
+// Merge sort of the list of pending slots, by payload
+static CombiningSlot
+sort_batch (CombiningTree tree, CombiningSlot batch)
+{
+  CombiningSlot slow, fast, half;
+
+  if (!batch || !batch->batch)
+    return batch;
+  for (slow = batch, fast = batch->batch; fast && fast->batch;
+       fast = fast->batch->batch)
+    slow = slow->batch;
+  half = slow->batch;
+  slow->batch = NULL;
+  return merge_batches (tree, sort_batch (tree, batch),
+                        sort_batch (tree, half));
+}
+
+static void
+combine (CombiningTree tree)
+{
+  CombiningSlot slot, next, batch = NULL, *tail = &batch;
+  size_t count = atomic_load_explicit (&tree->count, memory_order_relaxed);
+  Tree hint = NULL;
+
+  for (slot = atomic_load_explicit (&tree->slots, memory_order_acquire);
+       slot; slot = slot->next)
+    if (atomic_load_explicit (&slot->operation, memory_order_acquire) != NONE)
+      {
+        *tail = slot;
+        tail = &slot->batch;
+      }
+  *tail = NULL;
+
+  // In order, each insertion starts from the node of the one before
+  for (slot = sort_batch (tree, batch); slot; slot = next)
+    {
+      next = slot->batch; // The slot is the caller's again once released
+
+      switch (atomic_load_explicit (&slot->operation, memory_order_relaxed))
+        {
+        case SEARCH:
+          {
+            void *found = tree_search (tree->root, slot->data, tree->compare);
+
+            if (found && slot->result)
+              memcpy (slot->result, found, tree->size);
+            slot->done = found != NULL;
+            break;
+          }
+        case INSERT:
+          {
+            Tree node = tree_insert_hint_slab (&tree->root, tree->slab, hint,
+                                               slot->data, tree->size,
+                                               tree->compare);
+
+            slot->done = node != NULL;
+            if (node)
+              {
+                hint = node;
+                count++;
+              }
+            break;
+          }
+        case REMOVE:
+          slot->done = tree_remove_sorted_slab (&tree->root, tree->slab,
+                                                slot->data, tree->compare);
+          if (slot->done)
+            {
+              hint = NULL; // Maybe the removed node
+              count--;
+            }
+          break;
+        }
+      atomic_store_explicit (&slot->operation, NONE, memory_order_release);
+    }
+
+  atomic_store_explicit (&tree->count, count, memory_order_relaxed);
+}
+
+static bool
+request (CombiningSlot slot,
+         Operation operation,
+         const void *data,
+         void *result)
+{
+  CombiningTree tree = slot->tree;
+  int i = 0;
+
+  slot->data = data;
+  slot->result = result;
+  atomic_store_explicit (&slot->operation, operation, memory_order_release);
+
+  // Test before the exchange: waiting threads only read the lock
+  while (atomic_load_explicit (&slot->operation, memory_order_acquire)
+         != NONE)
+    if (!atomic_load_explicit (&tree->lock, memory_order_relaxed)
+        && !atomic_exchange_explicit (&tree->lock, true,
+                                      memory_order_acquire))
+      {
+        combine (tree);
+        atomic_store_explicit (&tree->lock, false, memory_order_release);
+      }
+    else if (++i % SPIN_COUNT == 0)
+      sched_yield (); // The combiner may have been preempted
+
+  return slot->done;
+}
+
+bool
+combining_tree_search (CombiningSlot slot, const void *data, void *result)
+{
+  return request (slot, SEARCH, data, result);
+}
+
+bool
+combining_tree_insert (CombiningSlot slot, const void *data)
+{
+  return request (slot, INSERT, data, NULL);
+}
+
+bool
+combining_tree_remove (CombiningSlot slot, const void *data)
+{
+  return request (slot, REMOVE, data, NULL);
+}
@@ -0,0 +1,48 @@
+#ifndef _TREE_AVL_COMBINING_H_
+#define _TREE_AVL_COMBINING_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* AVL tree shared between threads by flat combining: rather than taking
+   the lock of the tree in turn, each thread publishes its request in a
+   slot of its own, and whichever thread gets the lock (the combiner)
+   applies every pending request in one pass, sorted by payload, before
+   handing the results back. Under contention the tree and the lock stay in
+   the cache of one core, and neighbouring insertions share their descent
+   (tree_insert_hint()).
+
+   Each thread registers a slot once, then searches and modifies the tree
+   through it; a call returns once its request has been applied. Every
+   request, searches included, goes through the combiner. */
+typedef struct _CombiningTree *CombiningTree;
+
+typedef struct _CombiningSlot *CombiningSlot;
+
+CombiningTree combining_tree_new (size_t size,
+                                  int (*compare) (const void *,
+                                                  const void *));
+
+// Not thread-safe: no other thread may use the tree or its slots any more
+void combining_tree_delete (CombiningTree tree, void (*delete_data) (void *));
+
+// Register the calling thread, NULL if the allocation failed
+CombiningSlot combining_tree_slot_new (CombiningTree tree);
+
+void combining_tree_slot_delete (CombiningSlot slot);
+
+size_t combining_tree_size (CombiningTree tree);
+
+// Copy the payload equal to data to result (unless result is NULL),
+// return false if there is none
+bool combining_tree_search (CombiningSlot slot,
+                            const void *data,
+                            void *result);
+
+// Equal payloads go right of each other. false if the allocation failed.
+bool combining_tree_insert (CombiningSlot slot, const void *data);
+
+// Remove one payload equal to data, false if there is none
+bool combining_tree_remove (CombiningSlot slot, const void *data);
+
+#endif
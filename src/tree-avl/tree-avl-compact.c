@@ -0,0 +1,593 @@
+#include <string.h>
+#include <stdint.h>
+#include "tree-avl-compact.h"
+#include "min-max.h"
+
+/*--------------------------------------------------------------------*/
+/* Layout: a node is its payload followed by three 32-bit links. The
+   balance factor + 1 lives in the 2 high bits of the parent link, which
+   leaves 30 bits for indices. */
+
+#define COMPACT_MAGIC 0x31435641u // "AVC1"
+#define INDEX_BITS 30
+#define NIL ((uint32_t) ((1u << INDEX_BITS) - 1)) // also the node limit
+
+typedef struct
+  {
+    uint32_t left;
+    uint32_t right;
+    uint32_t parent; // balance + 1 in the high bits
+  } Links;
+
+struct _CompactTree
+  {
+    uint32_t magic;    // identifies a snapshot
+    uint32_t root;
+    uint32_t count;    // nodes in use, stored at indices [0, count)
+    uint32_t capacity; // nodes allocated
+    uint32_t size;     // payload size
+    uint32_t links;    // offset of the links in a node
+    uint32_t stride;   // size of a node
+    uint32_t reserved;
+    char nodes[];
+  };
+
+static inline char *
+node_data (CompactTree tree, uint32_t node)
+{
+  return tree->nodes + (size_t) node * tree->stride;
+}
+
+static inline Links *
+node_links (CompactTree tree, uint32_t node)
+{
+  return (Links *) (node_data (tree, node) + tree->links);
+}
+
+#define LEFT(node) (node_links (tree, node)->left)
+#define RIGHT(node) (node_links (tree, node)->right)
+
+static inline uint32_t
+node_parent (CompactTree tree, uint32_t node)
+{
+  return node_links (tree, node)->parent & NIL;
+}
+
+static inline void
+node_set_parent (CompactTree tree, uint32_t node, uint32_t parent)
+{
+  Links *links = node_links (tree, node);
+  links->parent = (links->parent & ~NIL) | parent;
+}
+
+static inline int
+node_balance (CompactTree tree, uint32_t node)
+{
+  return (int) (node_links (tree, node)->parent >> INDEX_BITS) - 1;
+}
+
+static inline void
+node_set_balance (CompactTree tree, uint32_t node, int balance)
+{
+  Links *links = node_links (tree, node);
+  links->parent = (links->parent & NIL)
+                  | (uint32_t) (balance + 1) << INDEX_BITS;
+}
+
+/*--------------------------------------------------------------------*/
+// Offset of the links and size of a node holding a payload of size bytes
+static void
+node_layout (uint32_t size, uint32_t *links, uint32_t *stride)
+{
+  uint32_t align = 4;
+
+  // Payloads keep the natural alignment of their size, up to 16
+  while (align < 16 && size % (2 * align) == 0)
+    align *= 2;
+
+  *links = (size + 3) / 4 * 4;
+  *stride = (*links + sizeof (Links) + align - 1) / align * align;
+}
+
+CompactTree
+compact_tree_new (size_t size)
+{
+  CompactTree tree;
+
+  if (size > UINT32_MAX / 2)
+    return NULL;
+
+  tree = malloc (sizeof (*tree));
+  if (tree)
+    {
+      tree->magic = COMPACT_MAGIC;
+      tree->root = NIL;
+      tree->count = 0;
+      tree->capacity = 0;
+      tree->size = size;
+      node_layout (size, &tree->links, &tree->stride);
+      tree->reserved = 0;
+    }
+
+  return tree;
+}
+
+void
+compact_tree_delete (CompactTree tree, void (*delete_data) (void *))
+{
+  uint32_t i;
+
+  if (tree)
+    {
+      // The array is dense: no walk needed
+      if (delete_data)
+        for (i = 0; i < tree->count; i++)
+          delete_data (node_data (tree, i));
+      free (tree);
+    }
+}
+
+static bool
+grow (CompactTree * ptree)
+{
+  CompactTree tree = *ptree;
+  uint32_t capacity;
+
+  if (tree->capacity == NIL)
+    return false;
+  capacity = tree->capacity ? MIN (2 * (uint64_t) tree->capacity, NIL) : 16;
+  tree = realloc (tree, sizeof (*tree) + (size_t) capacity * tree->stride);
+  if (!tree)
+    return false;
+  tree->capacity = capacity;
+  *ptree = tree;
+  return true;
+}
+
+size_t
+compact_tree_size (CompactTree tree)
+{
+  return tree ? tree->count : 0;
+}
+
+static size_t
+height (CompactTree tree, uint32_t node)
+{
+  if (node == NIL)
+    return 0;
+  return 1 + MAX (height (tree, LEFT (node)), height (tree, RIGHT (node)));
+}
+
+size_t
+compact_tree_height (CompactTree tree)
+{
+  return tree ? height (tree, tree->root) : 0;
+}
+
+size_t
+compact_tree_bytes (CompactTree tree)
+{
+  return tree ? sizeof (*tree) + (size_t) tree->count * tree->stride : 0;
+}
+
+/* A snapshot is checked before any use: the header must match its payload
+   size, every link must be NIL or an index below count, the links must
+   form one tree whose parent links agree with the child links, and every
+   balance factor must match the heights of the subtrees. The order of the
+   payloads is not checked, there is no comparison function here: a
+   misordered snapshot gives wrong answers, but no access out of bounds. */
+static bool
+valid_links (CompactTree tree)
+{
+  uint32_t i, node, next, previous, visited = 0, *heights;
+  bool valid = true;
+
+  if (tree->count == 0)
+    return tree->root == NIL;
+  if (tree->root >= tree->count || node_parent (tree, tree->root) != NIL)
+    return false;
+
+  // Each link agrees with the link back, in both directions
+  for (i = 0; i < tree->count; i++)
+    {
+      uint32_t left = LEFT (i), right = RIGHT (i), parent;
+
+      if (node_links (tree, i)->parent >> INDEX_BITS > 2 // balance + 1
+          || (left != NIL && (left >= tree->count
+                              || node_parent (tree, left) != i))
+          || (right != NIL && (right >= tree->count
+                               || node_parent (tree, right) != i))
+          || (left == right && left != NIL))
+        return false;
+      parent = node_parent (tree, i);
+      if (i != tree->root
+          && (parent >= tree->count
+              || (LEFT (parent) != i && RIGHT (parent) != i)))
+        return false;
+    }
+
+  /* Nodes below the root are then a tree: a second path to a node would
+     give it two parents. The walk counts them and checks the balance
+     factors in post-order, without recursion: the depth is unknown. */
+  heights = malloc ((size_t) tree->count * sizeof (*heights));
+  if (!heights)
+    return false;
+  for (node = tree->root, previous = NIL; valid && node != NIL;
+       previous = node, node = next)
+    {
+      uint32_t left = LEFT (node), right = RIGHT (node);
+      bool down = previous == node_parent (tree, node);
+
+      if (down && left != NIL)
+        next = left;
+      else if ((down || previous == left) && right != NIL)
+        next = right;
+      else
+        {
+          uint32_t hl = left == NIL ? 0 : heights[left];
+          uint32_t hr = right == NIL ? 0 : heights[right];
+
+          valid = node_balance (tree, node) == (int) hl - (int) hr;
+          heights[node] = MAX (hl, hr) + 1;
+          visited++;
+          next = node_parent (tree, node);
+        }
+    }
+  free (heights);
+  return valid && visited == tree->count;
+}
+
+CompactTree
+compact_tree_load (const void *buffer, size_t bytes)
+{
+  const struct _CompactTree *header = buffer;
+  uint32_t links, stride;
+  CompactTree tree;
+
+  if (bytes < sizeof (*header) || header->magic != COMPACT_MAGIC
+      || header->size > UINT32_MAX / 2 || header->count > NIL
+      || header->reserved != 0)
+    return NULL;
+  node_layout (header->size, &links, &stride);
+  if (header->links != links || header->stride != stride
+      || bytes < sizeof (*header) + (size_t) header->count * stride)
+    return NULL;
+
+  bytes = sizeof (*header) + (size_t) header->count * stride;
+  tree = malloc (bytes);
+  if (tree)
+    {
+      memcpy (tree, buffer, bytes);
+      tree->capacity = tree->count;
+      if (!valid_links (tree))
+        {
+          free (tree);
+          return NULL;
+        }
+    }
+
+  return tree;
+}
+
+static void
+in_order (CompactTree tree, uint32_t node,
+          void (*func) (void *, void *), void *extra_data)
+{
+  if (node != NIL)
+    {
+      in_order (tree, LEFT (node), func, extra_data);
+      func (node_data (tree, node), extra_data);
+      in_order (tree, RIGHT (node), func, extra_data);
+    }
+}
+
+void
+compact_tree_in_order (CompactTree tree,
+                       void (*func) (void *, void *),
+                       void *extra_data)
+{
+  if (tree)
+    in_order (tree, tree->root, func, extra_data);
+}
+
+static uint32_t
+search_node (CompactTree tree,
+             const void *data,
+             int (*compare) (const void *, const void *))
+{
+  uint32_t node = tree->root;
+
+  while (node != NIL)
+    {
+      int cmp = compare (data, node_data (tree, node));
+      if (cmp == 0)
+        break;
+      node = cmp < 0 ? LEFT (node) : RIGHT (node);
+    }
+  return node;
+}
+
+void *
+compact_tree_search (CompactTree tree,
+                     const void *data,
+                     int (*compare) (const void *, const void *))
+{
+  uint32_t node;
+
+  if (!tree)
+    return NULL;
+  node = search_node (tree, data, compare);
+  return node == NIL ? NULL : node_data (tree, node);
+}
+
+/*--------------------------------------------------------------------*/
+/* Rebalancing: same algorithms as tree-avl.c, on indices. */
+
+static void
+replace_child (CompactTree tree, uint32_t parent, uint32_t u, uint32_t v)
+{
+  if (parent == NIL)
+    tree->root = v;
+  else if (LEFT (parent) == u)
+    LEFT (parent) = v;
+  else
+    RIGHT (parent) = v;
+}
+
+static uint32_t
+rotate_left (CompactTree tree, uint32_t A)
+{
+  uint32_t B = RIGHT (A);
+  uint32_t b = LEFT (B);
+  uint32_t parent = node_parent (tree, A);
+
+  RIGHT (A) = b;
+  if (b != NIL)
+    node_set_parent (tree, b, A);
+  LEFT (B) = A;
+  node_set_parent (tree, A, B);
+  node_set_parent (tree, B, parent);
+  replace_child (tree, parent, A, B);
+
+  return B;
+}
+
+static uint32_t
+rotate_right (CompactTree tree, uint32_t B)
+{
+  uint32_t A = LEFT (B);
+  uint32_t b = RIGHT (A);
+  uint32_t parent = node_parent (tree, B);
+
+  LEFT (B) = b;
+  if (b != NIL)
+    node_set_parent (tree, b, B);
+  RIGHT (A) = B;
+  node_set_parent (tree, B, A);
+  node_set_parent (tree, A, parent);
+  replace_child (tree, parent, B, A);
+
+  return A;
+}
+
+// Restore the AVL property on a node whose balance reached +2 or -2
+static uint32_t
+rebalance (CompactTree tree, uint32_t node, int balance)
+{
+  if (balance > 1)
+    {
+      uint32_t A = LEFT (node);
+      int a = node_balance (tree, A);
+
+      if (a < 0)
+        {
+          uint32_t G = RIGHT (A);
+          int g = node_balance (tree, G);
+
+          rotate_left (tree, A);
+          rotate_right (tree, node);
+          node_set_balance (tree, A, g < 0 ? 1 : 0);
+          node_set_balance (tree, node, g > 0 ? -1 : 0);
+          node_set_balance (tree, G, 0);
+          return G;
+        }
+      rotate_right (tree, node);
+      node_set_balance (tree, node, 1 - a);
+      node_set_balance (tree, A, a - 1);
+      return A;
+    }
+  if (balance < -1)
+    {
+      uint32_t B = RIGHT (node);
+      int b = node_balance (tree, B);
+
+      if (b > 0)
+        {
+          uint32_t G = LEFT (B);
+          int g = node_balance (tree, G);
+
+          rotate_right (tree, B);
+          rotate_left (tree, node);
+          node_set_balance (tree, B, g > 0 ? -1 : 0);
+          node_set_balance (tree, node, g < 0 ? 1 : 0);
+          node_set_balance (tree, G, 0);
+          return G;
+        }
+      rotate_left (tree, node);
+      node_set_balance (tree, node, -1 - b);
+      node_set_balance (tree, B, b + 1);
+      return B;
+    }
+  node_set_balance (tree, node, balance);
+  return node;
+}
+
+static void
+insert_retrace (CompactTree tree, uint32_t node)
+{
+  uint32_t parent;
+
+  for (; (parent = node_parent (tree, node)) != NIL; node = parent)
+    {
+      int balance = node_balance (tree, parent)
+                    + (node == LEFT (parent) ? 1 : -1);
+
+      if (balance == 0)
+        {
+          node_set_balance (tree, parent, 0);
+          break;
+        }
+      if (balance > 1 || balance < -1)
+        {
+          rebalance (tree, parent, balance);
+          break;
+        }
+      node_set_balance (tree, parent, balance);
+    }
+}
+
+static void
+remove_retrace (CompactTree tree, uint32_t parent, bool left)
+{
+  while (parent != NIL)
+    {
+      uint32_t sub;
+      int balance = node_balance (tree, parent) + (left ? -1 : 1);
+
+      if (balance == 1 || balance == -1)
+        {
+          node_set_balance (tree, parent, balance);
+          break;
+        }
+      sub = rebalance (tree, parent, balance);
+      if (node_balance (tree, sub) != 0)
+        break;
+
+      parent = node_parent (tree, sub);
+      if (parent != NIL)
+        left = LEFT (parent) == sub;
+    }
+}
+
+bool
+compact_tree_insert_sorted (CompactTree * ptree,
+                            const void *data,
+                            int (*compare) (const void *, const void *))
+{
+  CompactTree tree;
+  uint32_t parent = NIL, node, new_node;
+  bool left = false;
+  Links *links;
+
+  if (!ptree || !*ptree)
+    return false;
+  if ((*ptree)->count == (*ptree)->capacity && !grow (ptree))
+    return false;
+  tree = *ptree;
+
+  node = tree->root;
+  while (node != NIL)
+    {
+      parent = node;
+      left = compare (data, node_data (tree, node)) < 0;
+      node = left ? LEFT (node) : RIGHT (node);
+    }
+
+  new_node = tree->count++;
+  memcpy (node_data (tree, new_node), data, tree->size);
+  links = node_links (tree, new_node);
+  links->left = NIL;
+  links->right = NIL;
+  links->parent = parent;
+  node_set_balance (tree, new_node, 0);
+
+  if (parent == NIL)
+    tree->root = new_node;
+  else if (left)
+    LEFT (parent) = new_node;
+  else
+    RIGHT (parent) = new_node;
+
+  insert_retrace (tree, new_node);
+  return true;
+}
+
+// Fill the slot of a removed node with the last node of the array
+static void
+fill_hole (CompactTree tree, uint32_t hole)
+{
+  uint32_t last = --tree->count;
+  uint32_t parent;
+
+  if (last == hole)
+    return;
+  memcpy (node_data (tree, hole), node_data (tree, last), tree->stride);
+
+  parent = node_parent (tree, hole);
+  replace_child (tree, parent, last, hole);
+  if (LEFT (hole) != NIL)
+    node_set_parent (tree, LEFT (hole), hole);
+  if (RIGHT (hole) != NIL)
+    node_set_parent (tree, RIGHT (hole), hole);
+}
+
+bool
+compact_tree_remove_sorted (CompactTree * ptree,
+                            const void *data,
+                            int (*compare) (const void *, const void *))
+{
+  CompactTree tree;
+  uint32_t node, parent;
+  bool left;
+
+  if (!ptree || !*ptree)
+    return false;
+  tree = *ptree;
+
+  node = search_node (tree, data, compare);
+  if (node == NIL)
+    return false;
+
+  if (LEFT (node) != NIL && RIGHT (node) != NIL)
+    {
+      // Splice the inorder successor in place of node
+      uint32_t succ = RIGHT (node);
+      while (LEFT (succ) != NIL)
+        succ = LEFT (succ);
+
+      if (node_parent (tree, succ) == node)
+        {
+          parent = succ;
+          left = false;
+        }
+      else
+        {
+          parent = node_parent (tree, succ);
+          left = true;
+          LEFT (parent) = RIGHT (succ);
+          if (RIGHT (succ) != NIL)
+            node_set_parent (tree, RIGHT (succ), parent);
+          RIGHT (succ) = RIGHT (node);
+          node_set_parent (tree, RIGHT (succ), succ);
+        }
+      LEFT (succ) = LEFT (node);
+      node_set_parent (tree, LEFT (succ), succ);
+      // Parent and balance of node
+      node_links (tree, succ)->parent = node_links (tree, node)->parent;
+      replace_child (tree, node_parent (tree, node), node, succ);
+    }
+  else
+    {
+      uint32_t child = LEFT (node) != NIL ? LEFT (node) : RIGHT (node);
+
+      parent = node_parent (tree, node);
+      left = parent != NIL && LEFT (parent) == node;
+      if (child != NIL)
+        node_set_parent (tree, child, parent);
+      replace_child (tree, parent, node, child);
+    }
+
+  remove_retrace (tree, parent, left);
+  fill_hole (tree, node);
+  return true;
+}
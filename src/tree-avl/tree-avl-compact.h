@@ -0,0 +1,53 @@
+#ifndef _TREE_AVL_COMPACT_H_
+#define _TREE_AVL_COMPACT_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Compact AVL tree: the nodes live in one growable array and refer to each
+   other with 32-bit indices instead of pointers. The whole tree, header
+   included, is a single relocatable allocation of compact_tree_bytes()
+   bytes: writing or copying those bytes is a complete snapshot, which
+   compact_tree_load() turns back into a tree.
+
+   Removing a node moves the last node of the array into its slot to keep
+   the array dense, so a pointer returned by compact_tree_search() is only
+   valid until the next insertion or removal. A tree holds at most
+   2^30 - 1 nodes: the 2 high bits of each 32-bit parent link are the
+   balance factor. */
+typedef struct _CompactTree *CompactTree;
+
+CompactTree compact_tree_new (size_t size);
+
+void compact_tree_delete (CompactTree tree, void (*delete_data) (void *));
+
+// Insertion may move the tree: *ptree is updated
+bool compact_tree_insert_sorted (CompactTree * ptree,
+                                 const void *data,
+                                 int (*compare) (const void *, const void *));
+
+bool compact_tree_remove_sorted (CompactTree * ptree,
+                                 const void *data,
+                                 int (*compare) (const void *, const void *));
+
+void *compact_tree_search (CompactTree tree,
+                           const void *data,
+                           int (*compare) (const void *, const void *));
+
+void compact_tree_in_order (CompactTree tree,
+                            void (*func) (void *, void *),
+                            void *extra_data);
+
+size_t compact_tree_size (CompactTree tree);
+
+size_t compact_tree_height (CompactTree tree);
+
+// Number of bytes starting at tree that make up a snapshot
+size_t compact_tree_bytes (CompactTree tree);
+
+// New tree from a snapshot, NULL if the bytes are not a valid one: the
+// header, every link and every balance factor are checked, not the order of
+// the payloads. O(n), whatever the bytes.
+CompactTree compact_tree_load (const void *buffer, size_t bytes);
+
+#endif
@@ -0,0 +1,1149 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "tree-avl-concurrent.h"
+#include "min-max.h"
+
+/*--------------------------------------------------------------------*/
+/* Optimistic concurrent AVL tree, after Bronson, Casper, Chafi and
+   Olukotun, "A Practical Concurrent Binary Search Tree" (PPoPP 2010).
+
+   Searches take no lock. Every node has a version that changes when a
+   rotation moves it down, i.e. shrinks the range of keys below it. A search
+   reads the version of a node before following one of its links, and
+   checks it again after reading the child (hand-over-hand): if it changed,
+   the child may not cover the key any more and the search retries from the
+   parent.
+
+   Updates lock only the nodes they link or rotate, always parents before
+   children: the node that gets a new leaf, the parent and the node for an
+   unlink, and the parent plus the two or three nodes of a rotation.
+
+   Balance is relaxed: each update repairs the heights and rotates on its
+   way back up, so the tree is an AVL tree once no update runs. A removed
+   node with two children stays in the tree as a routing node (NULL value)
+   until it has fewer children and can be unlinked.
+
+   Reclamation by epochs, as in tree-rbt-rcu.c but with any number of
+   writers: every operation announces the global epoch in the slot of its
+   thread while it runs. An unlinked node is retired on the slot that
+   unlinked it, in the epoch read after the unlink: a search still reading
+   it announced that epoch or an earlier one. The epoch advances once every
+   running operation has announced it, so two epochs later no operation can
+   see the node any more. Each slot keeps one limbo list per epoch mod 3,
+   and frees a list once it is two epochs old. */
+
+// Version: unlinked, a rotation in progress, count of rotations
+#define UNLINKED ((uint64_t) 1)
+#define SHRINKING ((uint64_t) 2)
+#define SHRINK_COUNT ((uint64_t) 4)
+
+// Spins on a busy node before yielding the processor
+#define SPIN_COUNT 100
+
+// Retirements on a slot between two attempts to advance the epoch
+#define ADVANCE_COUNT 64
+
+// Results of node_condition() that are not a new height
+#define NOTHING_REQUIRED -1
+#define REBALANCE_REQUIRED -2
+#define UNLINK_REQUIRED -3
+
+typedef struct _ConcurrentNode *ConcurrentNode;
+
+struct _ConcurrentNode
+  {
+    _Atomic (ConcurrentNode) left;
+    _Atomic (ConcurrentNode) right;
+    _Atomic (ConcurrentNode) parent;
+    atomic_int height;
+    _Atomic (uint64_t) version;
+    _Atomic (void *) value; // NULL: routing node
+    atomic_flag lock; // held for a few stores: a spin lock
+    ConcurrentNode retired; // next node of a limbo list
+    char key[];
+  };
+
+struct _ConcurrentSlot
+  {
+    // One cache line per slot, its epoch written by its thread only
+    _Alignas (64) atomic_ulong epoch; // (epoch << 1) | 1 in an operation,
+                                      // else 0
+    ConcurrentNode limbo[3]; // retired in the epoch limbo_epoch[i]
+    unsigned long limbo_epoch[3];
+    atomic_size_t retired; // nodes on the limbo lists
+    unsigned retirements;
+    atomic_bool used;
+    ConcurrentSlot next;
+    ConcurrentTree tree;
+  };
+
+struct _ConcurrentTree
+  {
+    ConcurrentNode holder; // the root is its right child
+    size_t size;
+    int (*compare) (const void *, const void *);
+    _Atomic (ConcurrentSlot) slots;
+    atomic_ulong epoch;
+  };
+
+// Distinct from any value: the attempt must be retried from higher up
+static char retry_token;
+#define RETRY ((void *) &retry_token)
+static char failed_token;
+#define FAILED ((void *) &failed_token)
+
+static inline _Atomic (ConcurrentNode) *
+child_link (ConcurrentNode node, int dir)
+{
+  return dir < 0 ? &node->left : &node->right;
+}
+
+static inline ConcurrentNode
+child_of (ConcurrentNode node, int dir)
+{
+  return atomic_load (child_link (node, dir));
+}
+
+static inline int
+link_height (ConcurrentNode node)
+{
+  return node ? atomic_load (&node->height) : 0;
+}
+
+static void
+lock_node (ConcurrentNode node)
+{
+  int i = 0;
+
+  // The holder may have been preempted: yield rather than spin forever
+  while (atomic_flag_test_and_set_explicit (&node->lock,
+                                            memory_order_acquire))
+    if (++i % SPIN_COUNT == 0)
+      sched_yield ();
+}
+
+static inline void
+unlock_node (ConcurrentNode node)
+{
+  atomic_flag_clear_explicit (&node->lock, memory_order_release);
+}
+
+static ConcurrentNode
+concurrent_node_new (ConcurrentTree tree, const void *key, void *value,
+                     ConcurrentNode parent)
+{
+  ConcurrentNode node = malloc (sizeof (*node) + tree->size);
+
+  if (!node)
+    return NULL;
+  atomic_init (&node->left, NULL);
+  atomic_init (&node->right, NULL);
+  atomic_init (&node->parent, parent);
+  atomic_init (&node->height, 1);
+  atomic_init (&node->version, 0);
+  atomic_init (&node->value, value);
+  atomic_flag_clear (&node->lock);
+  node->retired = NULL;
+  if (key)
+    memcpy (node->key, key, tree->size);
+  return node;
+}
+
+/*--------------------------------------------------------------------*/
+/* Epochs */
+
+static void
+free_limbo (ConcurrentSlot slot, int i)
+{
+  ConcurrentNode node, next;
+  size_t count = 0;
+
+  for (node = slot->limbo[i]; node; node = next)
+    {
+      next = node->retired;
+      free (node);
+      count++;
+    }
+  slot->limbo[i] = NULL;
+  atomic_fetch_sub_explicit (&slot->retired, count, memory_order_relaxed);
+}
+
+static void
+enter (ConcurrentSlot slot)
+{
+  // Acquire: the operations that ended before the epoch advanced are done
+  // with the nodes freed below
+  unsigned long epoch = atomic_load_explicit (&slot->tree->epoch,
+                                              memory_order_acquire);
+  int i;
+
+  // An exchange rather than a store: a thread reading the announcement
+  // synchronizes with the end of the previous operation too
+  atomic_exchange_explicit (&slot->epoch, (epoch << 1) | 1,
+                            memory_order_acq_rel);
+  // The announcement must be visible before the first link is read
+  atomic_thread_fence (memory_order_seq_cst);
+
+  // Nodes retired two epochs ago are unreachable
+  for (i = 0; i < 3; i++)
+    if (slot->limbo[i] && slot->limbo_epoch[i] + 2 <= epoch)
+      free_limbo (slot, i);
+}
+
+static inline void
+leave (ConcurrentSlot slot)
+{
+  atomic_store_explicit (&slot->epoch, 0, memory_order_release);
+}
+
+// Advance the epoch if every running operation has announced it
+static void
+try_advance (ConcurrentTree tree)
+{
+  unsigned long epoch;
+  ConcurrentSlot slot;
+
+  atomic_thread_fence (memory_order_seq_cst);
+  epoch = atomic_load_explicit (&tree->epoch, memory_order_relaxed);
+  for (slot = atomic_load (&tree->slots); slot; slot = slot->next)
+    {
+      unsigned long announced = atomic_load_explicit (&slot->epoch,
+                                                      memory_order_acquire);
+
+      if ((announced & 1) && announced >> 1 != epoch)
+        return;
+    }
+  atomic_compare_exchange_strong (&tree->epoch, &epoch, epoch + 1);
+}
+
+// node has just been unlinked
+static void
+retire (ConcurrentSlot slot, ConcurrentNode node)
+{
+  unsigned long epoch;
+  int i;
+
+  // Read after the unlink: whoever still sees node announced this epoch or
+  // an earlier one
+  atomic_thread_fence (memory_order_seq_cst);
+  epoch = atomic_load_explicit (&slot->tree->epoch, memory_order_acquire);
+  i = epoch % 3;
+  if (slot->limbo_epoch[i] != epoch)
+    {
+      // Retired three epochs ago at least
+      free_limbo (slot, i);
+      slot->limbo_epoch[i] = epoch;
+    }
+  node->retired = slot->limbo[i];
+  slot->limbo[i] = node;
+  atomic_fetch_add_explicit (&slot->retired, 1, memory_order_relaxed);
+
+  if (++slot->retirements % ADVANCE_COUNT == 0)
+    try_advance (slot->tree);
+}
+
+// Rotations hold the lock of the node they move down
+static void
+wait_until_not_changing (ConcurrentNode node)
+{
+  uint64_t version = atomic_load (&node->version);
+  int i;
+
+  if (!(version & SHRINKING))
+    return;
+  for (i = 0; i < SPIN_COUNT; i++)
+    if (atomic_load (&node->version) != version)
+      return;
+  lock_node (node);
+  unlock_node (node);
+}
+
+/*--------------------------------------------------------------------*/
+/* Searches. node covered the key when its version was version; dir is the
+   side of the key. */
+
+static void *
+attempt_get (ConcurrentTree tree, const void *key, ConcurrentNode node,
+             int dir, uint64_t version)
+{
+  for (;;)
+    {
+      ConcurrentNode child = child_of (node, dir);
+      uint64_t child_version;
+      int cmp;
+
+      if (!child)
+        return atomic_load (&node->version) != version ? RETRY : NULL;
+
+      cmp = tree->compare (key, child->key);
+      if (cmp == 0)
+        return atomic_load (&child->value);
+
+      child_version = atomic_load (&child->version);
+      if (child_version & (SHRINKING | UNLINKED))
+        {
+          wait_until_not_changing (child);
+          if (atomic_load (&node->version) != version)
+            return RETRY;
+          // Else node still covers the key: read its child again
+        }
+      else if (child != child_of (node, dir))
+        {
+          if (atomic_load (&node->version) != version)
+            return RETRY;
+        }
+      else
+        {
+          void *value;
+
+          if (atomic_load (&node->version) != version)
+            return RETRY;
+          value = attempt_get (tree, key, child, cmp, child_version);
+          if (value != RETRY)
+            return value;
+        }
+    }
+}
+
+void *
+concurrent_tree_get (ConcurrentSlot slot, const void *key)
+{
+  ConcurrentTree tree = slot->tree;
+  void *value;
+
+  enter (slot);
+  // The version of the holder never changes
+  do
+    value = attempt_get (tree, key, tree->holder, 1, 0);
+  while (value == RETRY);
+  leave (slot);
+  return value;
+}
+
+/*--------------------------------------------------------------------*/
+/* Rebalancing. The _locked functions are called with the lock of their
+   node (or nodes) held, and return the next node to repair, NULL when the
+   repairs are done. */
+
+// Repair needed at node: a new height, or one of the conditions above
+static int
+node_condition (ConcurrentNode node)
+{
+  ConcurrentNode left = atomic_load (&node->left);
+  ConcurrentNode right = atomic_load (&node->right);
+  int height, left_height, right_height, new_height, balance;
+
+  if ((!left || !right) && !atomic_load (&node->value))
+    return UNLINK_REQUIRED;
+
+  height = atomic_load (&node->height);
+  left_height = link_height (left);
+  right_height = link_height (right);
+  new_height = 1 + MAX (left_height, right_height);
+  balance = left_height - right_height;
+
+  if (balance < -1 || balance > 1)
+    return REBALANCE_REQUIRED;
+  return height != new_height ? new_height : NOTHING_REQUIRED;
+}
+
+static ConcurrentNode
+fix_height_locked (ConcurrentNode node)
+{
+  int condition = node_condition (node);
+
+  switch (condition)
+    {
+    case REBALANCE_REQUIRED:
+    case UNLINK_REQUIRED:
+      // Needs the lock of the parent as well
+      return node;
+    case NOTHING_REQUIRED:
+      return NULL;
+    default:
+      atomic_store (&node->height, condition);
+      return atomic_load (&node->parent);
+    }
+}
+
+// Replace node, which has at most one child, by that child
+static bool
+attempt_unlink_locked (ConcurrentSlot slot, ConcurrentNode parent,
+                       ConcurrentNode node)
+{
+  ConcurrentNode left = atomic_load (&node->left);
+  ConcurrentNode right = atomic_load (&node->right);
+  ConcurrentNode splice = left ? left : right;
+
+  if (atomic_load (&parent->left) != node
+      && atomic_load (&parent->right) != node)
+    return false;
+  if (left && right)
+    return false;
+
+  atomic_store (atomic_load (&parent->left) == node
+                ? &parent->left : &parent->right, splice);
+  if (splice)
+    atomic_store (&splice->parent, parent);
+  atomic_store (&node->version, UNLINKED);
+  atomic_store (&node->value, NULL);
+  retire (slot, node);
+  return true;
+}
+
+/* Rotations. The heights passed are the ones read under the locks: the
+   node moved down is marked shrinking while the links change, the node
+   moved up only grows and keeps its version. */
+
+static ConcurrentNode
+rotate_to_right_locked (ConcurrentNode parent, ConcurrentNode node,
+                        ConcurrentNode left, int right_height,
+                        int left_left_height, ConcurrentNode left_right,
+                        int left_right_height)
+{
+  uint64_t version = atomic_load (&node->version);
+  int node_height, balance;
+
+  atomic_store (&node->version, version | SHRINKING);
+
+  atomic_store (&node->left, left_right);
+  if (left_right)
+    atomic_store (&left_right->parent, node);
+  atomic_store (&left->right, node);
+  atomic_store (&node->parent, left);
+  atomic_store (atomic_load (&parent->left) == node
+                ? &parent->left : &parent->right, left);
+  atomic_store (&left->parent, parent);
+
+  node_height = 1 + MAX (left_right_height, right_height);
+  atomic_store (&node->height, node_height);
+  atomic_store (&left->height, 1 + MAX (left_left_height, node_height));
+
+  atomic_store (&node->version, version + SHRINK_COUNT);
+
+  // node may still need a repair, then left, then the parent
+  balance = left_right_height - right_height;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((!left_right || right_height == 0) && !atomic_load (&node->value))
+    return node;
+  balance = left_left_height - node_height;
+  if (balance < -1 || balance > 1)
+    return left;
+  if (left_left_height == 0 && !atomic_load (&left->value))
+    return left;
+  return fix_height_locked (parent);
+}
+
+static ConcurrentNode
+rotate_to_left_locked (ConcurrentNode parent, ConcurrentNode node,
+                       ConcurrentNode right, int left_height,
+                       int right_right_height, ConcurrentNode right_left,
+                       int right_left_height)
+{
+  uint64_t version = atomic_load (&node->version);
+  int node_height, balance;
+
+  atomic_store (&node->version, version | SHRINKING);
+
+  atomic_store (&node->right, right_left);
+  if (right_left)
+    atomic_store (&right_left->parent, node);
+  atomic_store (&right->left, node);
+  atomic_store (&node->parent, right);
+  atomic_store (atomic_load (&parent->left) == node
+                ? &parent->left : &parent->right, right);
+  atomic_store (&right->parent, parent);
+
+  node_height = 1 + MAX (right_left_height, left_height);
+  atomic_store (&node->height, node_height);
+  atomic_store (&right->height, 1 + MAX (right_right_height, node_height));
+
+  atomic_store (&node->version, version + SHRINK_COUNT);
+
+  balance = right_left_height - left_height;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((!right_left || left_height == 0) && !atomic_load (&node->value))
+    return node;
+  balance = right_right_height - node_height;
+  if (balance < -1 || balance > 1)
+    return right;
+  if (right_right_height == 0 && !atomic_load (&right->value))
+    return right;
+  return fix_height_locked (parent);
+}
+
+static ConcurrentNode
+rotate_right_over_left_locked (ConcurrentNode parent, ConcurrentNode node,
+                               ConcurrentNode left, int right_height,
+                               int left_left_height,
+                               ConcurrentNode left_right,
+                               int left_right_left_height)
+{
+  uint64_t version = atomic_load (&node->version);
+  uint64_t left_version = atomic_load (&left->version);
+  ConcurrentNode left_right_left = atomic_load (&left_right->left);
+  ConcurrentNode left_right_right = atomic_load (&left_right->right);
+  int left_right_right_height = link_height (left_right_right);
+  int node_height, left_height, balance;
+
+  atomic_store (&node->version, version | SHRINKING);
+  atomic_store (&left->version, left_version | SHRINKING);
+
+  atomic_store (&node->left, left_right_right);
+  if (left_right_right)
+    atomic_store (&left_right_right->parent, node);
+  atomic_store (&left->right, left_right_left);
+  if (left_right_left)
+    atomic_store (&left_right_left->parent, left);
+  atomic_store (&left_right->left, left);
+  atomic_store (&left->parent, left_right);
+  atomic_store (&left_right->right, node);
+  atomic_store (&node->parent, left_right);
+  atomic_store (atomic_load (&parent->left) == node
+                ? &parent->left : &parent->right, left_right);
+  atomic_store (&left_right->parent, parent);
+
+  node_height = 1 + MAX (left_right_right_height, right_height);
+  atomic_store (&node->height, node_height);
+  left_height = 1 + MAX (left_left_height, left_right_left_height);
+  atomic_store (&left->height, left_height);
+  atomic_store (&left_right->height, 1 + MAX (left_height, node_height));
+
+  atomic_store (&node->version, version + SHRINK_COUNT);
+  atomic_store (&left->version, left_version + SHRINK_COUNT);
+
+  balance = left_right_right_height - right_height;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((!left_right_right || right_height == 0)
+      && !atomic_load (&node->value))
+    return node;
+  balance = left_height - node_height;
+  if (balance < -1 || balance > 1)
+    return left_right;
+  return fix_height_locked (parent);
+}
+
+static ConcurrentNode
+rotate_left_over_right_locked (ConcurrentNode parent, ConcurrentNode node,
+                               ConcurrentNode right, int left_height,
+                               int right_right_height,
+                               ConcurrentNode right_left,
+                               int right_left_right_height)
+{
+  uint64_t version = atomic_load (&node->version);
+  uint64_t right_version = atomic_load (&right->version);
+  ConcurrentNode right_left_left = atomic_load (&right_left->left);
+  ConcurrentNode right_left_right = atomic_load (&right_left->right);
+  int right_left_left_height = link_height (right_left_left);
+  int node_height, right_height, balance;
+
+  atomic_store (&node->version, version | SHRINKING);
+  atomic_store (&right->version, right_version | SHRINKING);
+
+  atomic_store (&node->right, right_left_left);
+  if (right_left_left)
+    atomic_store (&right_left_left->parent, node);
+  atomic_store (&right->left, right_left_right);
+  if (right_left_right)
+    atomic_store (&right_left_right->parent, right);
+  atomic_store (&right_left->right, right);
+  atomic_store (&right->parent, right_left);
+  atomic_store (&right_left->left, node);
+  atomic_store (&node->parent, right_left);
+  atomic_store (atomic_load (&parent->left) == node
+                ? &parent->left : &parent->right, right_left);
+  atomic_store (&right_left->parent, parent);
+
+  node_height = 1 + MAX (right_left_left_height, left_height);
+  atomic_store (&node->height, node_height);
+  right_height = 1 + MAX (right_right_height, right_left_right_height);
+  atomic_store (&right->height, right_height);
+  atomic_store (&right_left->height, 1 + MAX (right_height, node_height));
+
+  atomic_store (&node->version, version + SHRINK_COUNT);
+  atomic_store (&right->version, right_version + SHRINK_COUNT);
+
+  balance = right_left_left_height - left_height;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((!right_left_left || left_height == 0)
+      && !atomic_load (&node->value))
+    return node;
+  balance = right_height - node_height;
+  if (balance < -1 || balance > 1)
+    return right_left;
+  return fix_height_locked (parent);
+}
+
+static ConcurrentNode rebalance_to_left_locked (ConcurrentNode parent,
+                                                ConcurrentNode node,
+                                                ConcurrentNode right,
+                                                int left_height);
+
+// The left subtree of node is too high
+static ConcurrentNode
+rebalance_to_right_locked (ConcurrentNode parent, ConcurrentNode node,
+                           ConcurrentNode left, int right_height)
+{
+  ConcurrentNode left_right, next = NULL;
+  int left_left_height, left_right_height;
+  bool rotate_left_first = false;
+
+  lock_node (left);
+  if (atomic_load (&left->height) - right_height <= 1)
+    {
+      unlock_node (left);
+      return node; // Changed meanwhile: check again
+    }
+  left_right = atomic_load (&left->right);
+  left_left_height = link_height (atomic_load (&left->left));
+  left_right_height = link_height (left_right);
+  if (left_left_height >= left_right_height)
+    {
+      next = rotate_to_right_locked (parent, node, left, right_height,
+                                     left_left_height, left_right,
+                                     left_right_height);
+      unlock_node (left);
+      return next;
+    }
+
+  lock_node (left_right);
+  left_right_height = atomic_load (&left_right->height);
+  if (left_left_height >= left_right_height)
+    next = rotate_to_right_locked (parent, node, left, right_height,
+                                   left_left_height, left_right,
+                                   left_right_height);
+  else
+    {
+      int left_right_left_height =
+        link_height (atomic_load (&left_right->left));
+      int balance = left_left_height - left_right_left_height;
+
+      // A double rotation only if it leaves left balanced and no routing
+      // node as a leaf
+      if (balance < -1 || balance > 1
+          || ((left_left_height == 0 || left_right_left_height == 0)
+              && !atomic_load (&left->value)))
+        rotate_left_first = true;
+      else
+        next = rotate_right_over_left_locked (parent, node, left,
+                                              right_height, left_left_height,
+                                              left_right,
+                                              left_right_left_height);
+    }
+  unlock_node (left_right);
+
+  // Else rotate left first, node being the parent
+  if (rotate_left_first)
+    next = rebalance_to_left_locked (node, left, left_right,
+                                     left_left_height);
+  unlock_node (left);
+  return next;
+}
+
+// The right subtree of node is too high
+static ConcurrentNode
+rebalance_to_left_locked (ConcurrentNode parent, ConcurrentNode node,
+                          ConcurrentNode right, int left_height)
+{
+  ConcurrentNode right_left, next = NULL;
+  int right_right_height, right_left_height;
+  bool rotate_right_first = false;
+
+  lock_node (right);
+  if (atomic_load (&right->height) - left_height <= 1)
+    {
+      unlock_node (right);
+      return node;
+    }
+  right_left = atomic_load (&right->left);
+  right_right_height = link_height (atomic_load (&right->right));
+  right_left_height = link_height (right_left);
+  if (right_right_height >= right_left_height)
+    {
+      next = rotate_to_left_locked (parent, node, right, left_height,
+                                    right_right_height, right_left,
+                                    right_left_height);
+      unlock_node (right);
+      return next;
+    }
+
+  lock_node (right_left);
+  right_left_height = atomic_load (&right_left->height);
+  if (right_right_height >= right_left_height)
+    next = rotate_to_left_locked (parent, node, right, left_height,
+                                  right_right_height, right_left,
+                                  right_left_height);
+  else
+    {
+      int right_left_right_height =
+        link_height (atomic_load (&right_left->right));
+      int balance = right_right_height - right_left_right_height;
+
+      if (balance < -1 || balance > 1
+          || ((right_right_height == 0 || right_left_right_height == 0)
+              && !atomic_load (&right->value)))
+        rotate_right_first = true;
+      else
+        next = rotate_left_over_right_locked (parent, node, right,
+                                              left_height, right_right_height,
+                                              right_left,
+                                              right_left_right_height);
+    }
+  unlock_node (right_left);
+
+  if (rotate_right_first)
+    next = rebalance_to_right_locked (node, right, right_left,
+                                      right_right_height);
+  unlock_node (right);
+  return next;
+}
+
+static ConcurrentNode
+rebalance_locked (ConcurrentSlot slot, ConcurrentNode parent,
+                  ConcurrentNode node)
+{
+  ConcurrentNode left = atomic_load (&node->left);
+  ConcurrentNode right = atomic_load (&node->right);
+  int height, left_height, right_height, new_height, balance;
+
+  if ((!left || !right) && !atomic_load (&node->value))
+    return attempt_unlink_locked (slot, parent, node)
+           ? fix_height_locked (parent) : node;
+
+  height = atomic_load (&node->height);
+  left_height = link_height (left);
+  right_height = link_height (right);
+  new_height = 1 + MAX (left_height, right_height);
+  balance = left_height - right_height;
+
+  if (balance > 1)
+    return rebalance_to_right_locked (parent, node, left, right_height);
+  if (balance < -1)
+    return rebalance_to_left_locked (parent, node, right, left_height);
+  if (new_height != height)
+    {
+      atomic_store (&node->height, new_height);
+      return fix_height_locked (parent);
+    }
+  return NULL;
+}
+
+// Repair node and its ancestors, up to the holder
+static void
+fix_height_and_rebalance (ConcurrentSlot slot, ConcurrentNode node)
+{
+  while (node && atomic_load (&node->parent))
+    {
+      int condition = node_condition (node);
+      ConcurrentNode parent;
+
+      if (condition == NOTHING_REQUIRED
+          || (atomic_load (&node->version) & UNLINKED))
+        return;
+
+      if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED)
+        {
+          ConcurrentNode locked = node;
+
+          lock_node (locked);
+          node = fix_height_locked (locked);
+          unlock_node (locked);
+          continue;
+        }
+
+      parent = atomic_load (&node->parent);
+      lock_node (parent);
+      if (!(atomic_load (&parent->version) & UNLINKED)
+          && atomic_load (&node->parent) == parent)
+        {
+          ConcurrentNode locked = node;
+
+          lock_node (locked);
+          node = rebalance_locked (slot, parent, locked);
+          unlock_node (locked);
+        }
+      unlock_node (parent);
+    }
+}
+
+/*--------------------------------------------------------------------*/
+/* Updates: the same descent as attempt_get(), then locks. */
+
+static void *
+attempt_insert (ConcurrentSlot slot, const void *key, void *value,
+                ConcurrentNode node, int dir, uint64_t version)
+{
+  // Allocated before locking, released if the attempt fails
+  ConcurrentNode child = concurrent_node_new (slot->tree, key, value, node);
+
+  if (!child)
+    return FAILED;
+
+  lock_node (node);
+  if (atomic_load (&node->version) != version || child_of (node, dir))
+    {
+      unlock_node (node);
+      free (child);
+      return RETRY;
+    }
+  atomic_store (child_link (node, dir), child);
+  unlock_node (node);
+
+  fix_height_and_rebalance (slot, node);
+  return NULL;
+}
+
+// Replace the value of node, a routing node getting its key back
+static void *
+attempt_update (ConcurrentNode node, void *value)
+{
+  void *previous;
+
+  lock_node (node);
+  if (atomic_load (&node->version) == UNLINKED)
+    {
+      unlock_node (node);
+      return RETRY;
+    }
+  previous = atomic_exchange (&node->value, value);
+  unlock_node (node);
+  return previous;
+}
+
+static void *
+attempt_put (ConcurrentSlot slot, const void *key, void *value,
+             ConcurrentNode node, int dir, uint64_t version)
+{
+  void *result = RETRY;
+
+  do
+    {
+      ConcurrentNode child = child_of (node, dir);
+
+      if (atomic_load (&node->version) != version)
+        return RETRY;
+
+      if (!child)
+        result = attempt_insert (slot, key, value, node, dir, version);
+      else
+        {
+          int cmp = slot->tree->compare (key, child->key);
+          uint64_t child_version;
+
+          if (cmp == 0)
+            {
+              result = attempt_update (child, value);
+              continue;
+            }
+
+          child_version = atomic_load (&child->version);
+          if (child_version & SHRINKING)
+            wait_until_not_changing (child);
+          else if (!(child_version & UNLINKED)
+                   && child == child_of (node, dir))
+            {
+              if (atomic_load (&node->version) != version)
+                return RETRY;
+              result = attempt_put (slot, key, value, child, cmp,
+                                    child_version);
+            }
+        }
+    }
+  while (result == RETRY);
+
+  return result;
+}
+
+bool
+concurrent_tree_put (ConcurrentSlot slot,
+                     const void *key,
+                     void *value,
+                     void **previous)
+{
+  void *result;
+
+  enter (slot);
+  do
+    result = attempt_put (slot, key, value, slot->tree->holder, 1, 0);
+  while (result == RETRY);
+  leave (slot);
+
+  if (result == FAILED)
+    return false;
+  if (previous)
+    *previous = result;
+  return true;
+}
+
+// Remove the value of node, a child of parent
+static void *
+attempt_remove_node (ConcurrentSlot slot, ConcurrentNode parent,
+                     ConcurrentNode node)
+{
+  void *previous;
+
+  if (!atomic_load (&node->value))
+    return NULL;
+
+  if (atomic_load (&node->left) && atomic_load (&node->right))
+    {
+      // Two children: keep the node for routing
+      lock_node (node);
+      if (atomic_load (&node->version) == UNLINKED)
+        {
+          unlock_node (node);
+          return RETRY;
+        }
+      previous = atomic_exchange (&node->value, NULL);
+      unlock_node (node);
+    }
+  else
+    {
+      lock_node (parent);
+      if ((atomic_load (&parent->version) & UNLINKED)
+          || atomic_load (&node->parent) != parent)
+        {
+          unlock_node (parent);
+          return RETRY;
+        }
+      lock_node (node);
+      if (atomic_load (&node->version) == UNLINKED)
+        {
+          unlock_node (node);
+          unlock_node (parent);
+          return RETRY;
+        }
+      previous = atomic_exchange (&node->value, NULL);
+      // Two children meanwhile: the node stays for routing
+      if (previous)
+        attempt_unlink_locked (slot, parent, node);
+      unlock_node (node);
+      unlock_node (parent);
+      node = parent;
+    }
+
+  // Unlinking leaves its parent to repair, routing may allow an unlink
+  if (previous)
+    fix_height_and_rebalance (slot, node);
+  return previous;
+}
+
+static void *
+attempt_remove (ConcurrentSlot slot, const void *key, ConcurrentNode node,
+                int dir, uint64_t version)
+{
+  void *result = RETRY;
+
+  do
+    {
+      ConcurrentNode child = child_of (node, dir);
+
+      if (atomic_load (&node->version) != version)
+        return RETRY;
+
+      if (!child)
+        return NULL;
+      else
+        {
+          int cmp = slot->tree->compare (key, child->key);
+          uint64_t child_version;
+
+          if (cmp == 0)
+            {
+              result = attempt_remove_node (slot, node, child);
+              continue;
+            }
+
+          child_version = atomic_load (&child->version);
+          if (child_version & SHRINKING)
+            wait_until_not_changing (child);
+          else if (!(child_version & UNLINKED)
+                   && child == child_of (node, dir))
+            {
+              if (atomic_load (&node->version) != version)
+                return RETRY;
+              result = attempt_remove (slot, key, child, cmp, child_version);
+            }
+        }
+    }
+  while (result == RETRY);
+
+  return result;
+}
+
+void *
+concurrent_tree_remove (ConcurrentSlot slot, const void *key)
+{
+  void *result;
+
+  enter (slot);
+  do
+    result = attempt_remove (slot, key, slot->tree->holder, 1, 0);
+  while (result == RETRY);
+  leave (slot);
+  return result;
+}
+
+/*--------------------------------------------------------------------*/
+ConcurrentTree
+concurrent_tree_new (size_t size,
+                     int (*compare) (const void *, const void *))
+{
+  ConcurrentTree tree = malloc (sizeof (*tree));
+
+  if (!tree)
+    return NULL;
+
+  tree->size = size;
+  tree->compare = compare;
+  atomic_init (&tree->slots, NULL);
+  atomic_init (&tree->epoch, 0);
+  tree->holder = concurrent_node_new (tree, NULL, NULL, NULL);
+  if (!tree->holder)
+    {
+      free (tree);
+      return NULL;
+    }
+  atomic_init (&tree->holder->height, 0);
+  return tree;
+}
+
+static void
+delete_nodes (ConcurrentNode node)
+{
+  if (node)
+    {
+      delete_nodes (atomic_load (&node->left));
+      delete_nodes (atomic_load (&node->right));
+      free (node);
+    }
+}
+
+void
+concurrent_tree_delete (ConcurrentTree tree)
+{
+  ConcurrentSlot slot, next;
+
+  if (tree)
+    {
+      delete_nodes (tree->holder);
+      for (slot = atomic_load (&tree->slots); slot; slot = next)
+        {
+          next = slot->next;
+          free_limbo (slot, 0);
+          free_limbo (slot, 1);
+          free_limbo (slot, 2);
+          free (slot);
+        }
+      free (tree);
+    }
+}
+
+ConcurrentSlot
+concurrent_tree_slot_new (ConcurrentTree tree)
+{
+  ConcurrentSlot slot;
+
+  // Reuse the slot of a deleted thread, with its limbo lists
+  for (slot = atomic_load (&tree->slots); slot; slot = slot->next)
+    {
+      bool used = false;
+
+      if (atomic_compare_exchange_strong (&slot->used, &used, true))
+        return slot;
+    }
+
+  slot = aligned_alloc (_Alignof (struct _ConcurrentSlot), sizeof (*slot));
+  if (!slot)
+    return NULL;
+  atomic_init (&slot->epoch, 0);
+  slot->limbo[0] = slot->limbo[1] = slot->limbo[2] = NULL;
+  slot->limbo_epoch[0] = slot->limbo_epoch[1] = slot->limbo_epoch[2] = 0;
+  atomic_init (&slot->retired, 0);
+  slot->retirements = 0;
+  atomic_init (&slot->used, true);
+  slot->tree = tree;
+  slot->next = atomic_load (&tree->slots);
+  while (!atomic_compare_exchange_weak (&tree->slots, &slot->next, slot))
+    ;
+  return slot;
+}
+
+void
+concurrent_tree_slot_delete (ConcurrentSlot slot)
+{
+  if (slot)
+    atomic_store (&slot->used, false);
+}
+
+static size_t
+count_nodes (ConcurrentNode node)
+{
+  if (!node)
+    return 0;
+  return (atomic_load (&node->value) != NULL)
+         + count_nodes (atomic_load (&node->left))
+         + count_nodes (atomic_load (&node->right));
+}
+
+size_t
+concurrent_tree_size (ConcurrentTree tree)
+{
+  return count_nodes (atomic_load (&tree->holder->right));
+}
+
+static size_t
+height_of_nodes (ConcurrentNode node)
+{
+  if (!node)
+    return 0;
+  return 1 + MAX (height_of_nodes (atomic_load (&node->left)),
+                  height_of_nodes (atomic_load (&node->right)));
+}
+
+size_t
+concurrent_tree_height (ConcurrentTree tree)
+{
+  return height_of_nodes (atomic_load (&tree->holder->right));
+}
+
+size_t
+concurrent_tree_retired (ConcurrentTree tree)
+{
+  ConcurrentSlot slot;
+  size_t count = 0;
+
+  for (slot = atomic_load (&tree->slots); slot; slot = slot->next)
+    count += atomic_load_explicit (&slot->retired, memory_order_relaxed);
+  return count;
+}
+
+static void
+in_order (ConcurrentNode node, void (*func) (const void *, void *, void *),
+          void *extra_data)
+{
+  void *value;
+
+  if (node)
+    {
+      in_order (atomic_load (&node->left), func, extra_data);
+      value = atomic_load (&node->value);
+      if (value)
+        func (node->key, value, extra_data);
+      in_order (atomic_load (&node->right), func, extra_data);
+    }
+}
+
+void
+concurrent_tree_in_order (ConcurrentTree tree,
+                          void (*func) (const void *, void *, void *),
+                          void *extra_data)
+{
+  in_order (atomic_load (&tree->holder->right), func, extra_data);
+}
@@ -0,0 +1,64 @@
+#ifndef _TREE_AVL_CONCURRENT_H_
+#define _TREE_AVL_CONCURRENT_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Concurrent AVL map: any number of threads search and update it at the
+   same time. Searches take no lock, updates lock a few nodes around the
+   place they change (see tree-avl-concurrent.c).
+
+   Keys are size bytes, copied into the nodes and sorted by compare; each
+   key maps to a value pointer, which must not be NULL. The tree does not
+   own the values.
+
+   Each thread registers a slot once, and passes it to the searches and
+   updates. A removed node is released once no operation that could still
+   be reading it runs any more (epoch-based reclamation): an operation
+   preempted for long delays the release of the nodes removed meanwhile,
+   never the other operations. */
+typedef struct _ConcurrentTree *ConcurrentTree;
+
+typedef struct _ConcurrentSlot *ConcurrentSlot;
+
+ConcurrentTree concurrent_tree_new (size_t size,
+                                    int (*compare) (const void *,
+                                                    const void *));
+
+// Not thread-safe: no other thread may use the tree or its slots any more
+void concurrent_tree_delete (ConcurrentTree tree);
+
+// Register the calling thread, NULL if the allocation failed
+ConcurrentSlot concurrent_tree_slot_new (ConcurrentTree tree);
+
+// No operation may use the slot any more; a later thread may reuse it
+void concurrent_tree_slot_delete (ConcurrentSlot slot);
+
+// Value of key, NULL if key is absent
+void *concurrent_tree_get (ConcurrentSlot slot, const void *key);
+
+// Map key to value. *previous (unless previous is NULL) receives the old
+// value of key, NULL if it was absent. false if the allocation failed.
+bool concurrent_tree_put (ConcurrentSlot slot,
+                          const void *key,
+                          void *value,
+                          void **previous);
+
+// Remove key, return its value, NULL if it was absent
+void *concurrent_tree_remove (ConcurrentSlot slot, const void *key);
+
+/* Walks, exact only when no update runs concurrently: number of keys,
+   height (removed nodes still routing searches included), and func called
+   on the keys and values in order. */
+size_t concurrent_tree_size (ConcurrentTree tree);
+
+size_t concurrent_tree_height (ConcurrentTree tree);
+
+void concurrent_tree_in_order (ConcurrentTree tree,
+                               void (*func) (const void *, void *, void *),
+                               void *extra_data);
+
+// Removed nodes not released yet
+size_t concurrent_tree_retired (ConcurrentTree tree);
+
+#endif
@@ -0,0 +1,241 @@
+#include <string.h>
+#include "tree-avl-handle.h"
+
+/*--------------------------------------------------------------------*/
+/* The first and last nodes are kept up to date on the way: a new node is
+   the first one only if it is linked left of the old first one, and
+   removing the first node makes its successor the first one. Rotations
+   never change the order, and a removal never moves the other payloads,
+   so both pointers stay valid. */
+
+struct _TreeHandle
+  {
+    Tree root;
+    Tree first;
+    Tree last;
+    size_t count;
+    size_t size;
+    int (*compare) (const void *, const void *);
+    TreeSlab *slab;
+  };
+
+TreeHandle
+tree_handle_new (size_t size,
+                 int (*compare) (const void *, const void *),
+                 TreeSlab *slab)
+{
+  TreeHandle handle = malloc (sizeof (*handle));
+
+  if (handle)
+    {
+      handle->root = NULL;
+      handle->first = NULL;
+      handle->last = NULL;
+      handle->count = 0;
+      handle->size = size;
+      handle->compare = compare;
+      handle->slab = slab;
+    }
+
+  return handle;
+}
+
+void
+tree_handle_delete (TreeHandle handle, void (*delete_data) (void *))
+{
+  if (handle)
+    {
+      tree_delete_into_slab (handle->root, handle->slab, delete_data);
+      free (handle);
+    }
+}
+
+Tree
+tree_handle_root (TreeHandle handle)
+{
+  return handle->root;
+}
+
+size_t
+tree_handle_size (TreeHandle handle)
+{
+  return handle->count;
+}
+
+Tree
+tree_handle_first (TreeHandle handle)
+{
+  return handle->first;
+}
+
+Tree
+tree_handle_last (TreeHandle handle)
+{
+  return handle->last;
+}
+
+Tree
+tree_handle_release (TreeHandle handle)
+{
+  Tree tree = handle->root;
+
+  handle->root = NULL;
+  handle->first = NULL;
+  handle->last = NULL;
+  handle->count = 0;
+  return tree;
+}
+
+void
+tree_handle_adopt (TreeHandle handle, Tree tree, size_t count)
+{
+  handle->root = tree;
+  handle->first = tree_first (tree);
+  handle->last = tree_last (tree);
+  handle->count = count;
+}
+
+static Tree
+link_new (TreeHandle handle, Tree parent, bool left, const void *data)
+{
+  Tree node = tree_slab_create (handle->slab, data, handle->size);
+
+  if (!node)
+    return NULL;
+
+  if (!parent || (parent == handle->first && left))
+    handle->first = node;
+  if (!parent || (parent == handle->last && !left))
+    handle->last = node;
+  tree_insert_node (&handle->root, parent, left, node);
+  handle->count++;
+  return node;
+}
+
+Tree
+tree_handle_insert (TreeHandle handle, const void *data)
+{
+  Tree parent = NULL;
+  bool left = false;
+  Tree node;
+
+  for (node = handle->root; node; node = left ? node->left : node->right)
+    {
+      parent = node;
+      left = handle->compare (data, node->data) < 0; // equal values go right
+    }
+
+  return link_new (handle, parent, left, data);
+}
+
+Tree
+tree_handle_insert_unique (TreeHandle handle,
+                           const void *data,
+                           bool *inserted)
+{
+  Tree parent = NULL;
+  bool left = false;
+  Tree node;
+
+  if (inserted)
+    *inserted = false;
+
+  for (node = handle->root; node; node = left ? node->left : node->right)
+    {
+      int cmp = handle->compare (data, node->data);
+
+      if (cmp == 0)
+        return node;
+      parent = node;
+      left = cmp < 0;
+    }
+
+  node = link_new (handle, parent, left, data);
+  if (node && inserted)
+    *inserted = true;
+  return node;
+}
+
+Tree
+tree_handle_find (TreeHandle handle, const void *data)
+{
+  Tree node = handle->root;
+
+  while (node)
+    {
+      int cmp = handle->compare (data, node->data);
+
+      if (cmp == 0)
+        return node;
+      node = cmp < 0 ? node->left : node->right;
+    }
+
+  return NULL;
+}
+
+void *
+tree_handle_search (TreeHandle handle, const void *data)
+{
+  return tree_get_data (tree_handle_find (handle, data));
+}
+
+bool
+tree_handle_remove (TreeHandle handle, const void *data)
+{
+  Tree node = tree_handle_find (handle, data);
+
+  if (!node)
+    return false;
+  tree_handle_remove_node (handle, node);
+  return true;
+}
+
+Tree
+tree_handle_remove_node (TreeHandle handle, Tree node)
+{
+  bool first = node == handle->first;
+  Tree next;
+
+  if (node == handle->last)
+    handle->last = tree_prev (node);
+  next = tree_remove_node_slab (&handle->root, handle->slab, node);
+  if (first)
+    handle->first = next;
+  handle->count--;
+  return next;
+}
+
+void *
+tree_handle_peek_min (TreeHandle handle)
+{
+  return tree_get_data (handle->first);
+}
+
+void *
+tree_handle_peek_max (TreeHandle handle)
+{
+  return tree_get_data (handle->last);
+}
+
+static bool
+pop (TreeHandle handle, Tree node, void *data)
+{
+  if (!node)
+    return false;
+  if (data)
+    memcpy (data, node->data, handle->size);
+  tree_handle_remove_node (handle, node);
+  return true;
+}
+
+bool
+tree_handle_pop_min (TreeHandle handle, void *data)
+{
+  return pop (handle, handle->first, data);
+}
+
+bool
+tree_handle_pop_max (TreeHandle handle, void *data)
+{
+  return pop (handle, handle->last, data);
+}
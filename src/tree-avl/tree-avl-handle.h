@@ -0,0 +1,78 @@
+#ifndef _TREE_AVL_HANDLE_H_
+#define _TREE_AVL_HANDLE_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "tree-avl.h"
+
+/* AVL tree behind a handle that remembers what the bare Tree cannot: the
+   payload size, the comparison function, the node allocator, the number of
+   nodes and the first and last nodes. Size, first and last are O(1), and
+   the calls do not take size and compare.
+
+   The nodes are ordinary tree nodes: tree_handle_root() can be searched,
+   walked or scanned with the functions of tree-avl.h, but the tree must
+   only be modified through the handle. */
+typedef struct _TreeHandle *TreeHandle;
+
+// Empty tree of payloads of size bytes sorted by compare, its nodes
+// allocated from slab (NULL: malloc). The slab is not owned by the tree and
+// may be shared with other trees: tree_handle_delete() gives the nodes of
+// this tree back to it one by one, and the caller deletes the slab.
+TreeHandle tree_handle_new (size_t size,
+                            int (*compare) (const void *, const void *),
+                            TreeSlab *slab);
+
+void tree_handle_delete (TreeHandle handle, void (*delete_data) (void *));
+
+Tree tree_handle_root (TreeHandle handle);
+
+size_t tree_handle_size (TreeHandle handle);
+
+Tree tree_handle_first (TreeHandle handle);
+
+Tree tree_handle_last (TreeHandle handle);
+
+/* Move whole trees in and out of a handle, e.g. to split or join them in
+   O(log n) with tree_split() and tree_concat(): tree_handle_release()
+   empties the handle and returns its tree, tree_handle_adopt() gives tree,
+   of count nodes sorted by the compare function of the handle, to an empty
+   handle. A removed node goes back to the slab of the handle that removes
+   it: the slabs of handles that trade nodes must outlive all of them. */
+Tree tree_handle_release (TreeHandle handle);
+
+void tree_handle_adopt (TreeHandle handle, Tree tree, size_t count);
+
+// Insert a copy of data, after its equals; return the new node, NULL if
+// the allocation failed
+Tree tree_handle_insert (TreeHandle handle, const void *data);
+
+// Return the node equal to data, inserting a copy of data if there is none
+// (see tree_insert_unique())
+Tree tree_handle_insert_unique (TreeHandle handle,
+                                const void *data,
+                                bool *inserted);
+
+// Node whose payload equals data, NULL if there is none
+Tree tree_handle_find (TreeHandle handle, const void *data);
+
+void *tree_handle_search (TreeHandle handle, const void *data);
+
+bool tree_handle_remove (TreeHandle handle, const void *data);
+
+// Remove a node of the tree, return the node that followed it
+Tree tree_handle_remove_node (TreeHandle handle, Tree node);
+
+/* Priority queue: the first and last payloads are peeked in O(1), and
+   popped without any search, the cached node being removed directly. A
+   pop copies the payload to data (unless data is NULL) before releasing
+   the node, and returns false if the tree is empty. */
+void *tree_handle_peek_min (TreeHandle handle);
+
+void *tree_handle_peek_max (TreeHandle handle);
+
+bool tree_handle_pop_min (TreeHandle handle, void *data);
+
+bool tree_handle_pop_max (TreeHandle handle, void *data);
+
+#endif
@@ -0,0 +1,410 @@
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tree-avl-shard.h"
+#include "../shard-map.h"
+
+/*--------------------------------------------------------------------*/
+/* The split points and the way operations read them are in
+   shard-map.h, shared with the red-black tree. */
+
+typedef struct
+  {
+    // Shards on distinct cache lines, so that the locks of neighbours do
+    // not share one
+    _Alignas (64) pthread_rwlock_t lock;
+    TreeHandle handle;
+    TreeSlab *slab;
+  } Shard;
+
+struct _ShardTree
+  {
+    ShardIndex index;
+    pthread_mutex_t rebuild_lock;
+    Shard *shards;
+  };
+
+ShardTree
+shard_tree_new (size_t size,
+                int (*compare) (const void *, const void *),
+                size_t count,
+                const void *split_points)
+{
+  ShardTree tree;
+  size_t i;
+
+  if (count == 0)
+    return NULL;
+  tree = aligned_alloc (_Alignof (struct _ShardTree), sizeof (*tree));
+  if (!tree)
+    return NULL;
+
+  tree->shards = aligned_alloc (_Alignof (Shard), count * sizeof (Shard));
+  if (!shard_index_init (&tree->index, count, size, compare, split_points)
+      || !tree->shards
+      || pthread_mutex_init (&tree->rebuild_lock, NULL) != 0)
+    {
+      shard_index_destroy (&tree->index);
+      free (tree->shards);
+      free (tree);
+      return NULL;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      Shard *shard = &tree->shards[i];
+
+      // Nodes move between shards: they all come from slabs, never a mix
+      // of slabs and malloc()
+      shard->slab = tree_slab_new (size);
+      shard->handle = shard->slab
+                      ? tree_handle_new (size, compare, shard->slab) : NULL;
+      if (!shard->handle || pthread_rwlock_init (&shard->lock, NULL) != 0)
+        {
+          tree_handle_delete (shard->handle, NULL);
+          tree_slab_delete (shard->slab);
+          tree->index.count = i;
+          shard_tree_delete (tree, NULL);
+          return NULL;
+        }
+    }
+
+  return tree;
+}
+
+void
+shard_tree_delete (ShardTree tree, void (*delete_data) (void *))
+{
+  size_t i;
+
+  if (tree)
+    {
+      // A shard may hold nodes of the slab of another: no slab goes
+      // before every node is released
+      for (i = 0; i < tree->index.count; i++)
+        {
+          tree_handle_delete (tree->shards[i].handle, delete_data);
+          pthread_rwlock_destroy (&tree->shards[i].lock);
+        }
+      for (i = 0; i < tree->index.count; i++)
+        tree_slab_delete (tree->shards[i].slab);
+      shard_index_destroy (&tree->index);
+      pthread_mutex_destroy (&tree->rebuild_lock);
+      free (tree->shards);
+      free (tree);
+    }
+}
+
+size_t
+shard_tree_count (ShardTree tree)
+{
+  return tree->index.count;
+}
+
+static void
+lock_shard (Shard *shard, bool write)
+{
+  if (write)
+    pthread_rwlock_wrlock (&shard->lock);
+  else
+    pthread_rwlock_rdlock (&shard->lock);
+}
+
+// Lock the shard of data, which stays its shard until unlocked
+static Shard *
+lock_shard_of (ShardTree tree, const void *data, bool write)
+{
+  atomic_size_t *active = shard_index_enter (&tree->index);
+  Shard *shard;
+
+  for (;;)
+    {
+      ShardMap *map = atomic_load (&tree->index.map);
+
+      shard = &tree->shards[shard_of (&tree->index, map, data)];
+      lock_shard (shard, write);
+      if (atomic_load (&tree->index.map) == map)
+        break;
+      pthread_rwlock_unlock (&shard->lock); // Rebuilt meanwhile
+    }
+  shard_index_leave (active);
+  return shard;
+}
+
+// Lock the shards first to last, in order; return false and lock nothing
+// if a rebuild published another map than map meanwhile
+static bool
+lock_shards (ShardTree tree, ShardMap *map, size_t first, size_t last)
+{
+  size_t i;
+
+  for (i = first; i <= last; i++)
+    lock_shard (&tree->shards[i], false);
+  if (atomic_load (&tree->index.map) == map)
+    return true;
+  for (i = first; i <= last; i++)
+    pthread_rwlock_unlock (&tree->shards[i].lock);
+  return false;
+}
+
+static void
+unlock_shards (ShardTree tree, size_t first, size_t last)
+{
+  size_t i;
+
+  for (i = first; i <= last; i++)
+    pthread_rwlock_unlock (&tree->shards[i].lock);
+}
+
+// With every shard locked, no rebuild can run: any map is the right one
+static void
+lock_all_shards (ShardTree tree)
+{
+  size_t i;
+
+  for (i = 0; i < tree->index.count; i++)
+    lock_shard (&tree->shards[i], false);
+}
+
+size_t
+shard_tree_size (ShardTree tree, size_t i)
+{
+  size_t count = 0;
+
+  if (i < tree->index.count)
+    {
+      pthread_rwlock_rdlock (&tree->shards[i].lock);
+      count = tree_handle_size (tree->shards[i].handle);
+      pthread_rwlock_unlock (&tree->shards[i].lock);
+      return count;
+    }
+
+  lock_all_shards (tree);
+  for (i = 0; i < tree->index.count; i++)
+    count += tree_handle_size (tree->shards[i].handle);
+  unlock_shards (tree, 0, tree->index.count - 1);
+  return count;
+}
+
+bool
+shard_tree_search (ShardTree tree, const void *data, void *result)
+{
+  Shard *shard = lock_shard_of (tree, data, false);
+  void *found = tree_handle_search (shard->handle, data);
+
+  if (found && result)
+    memcpy (result, found, tree->index.size);
+  pthread_rwlock_unlock (&shard->lock);
+  return found != NULL;
+}
+
+size_t
+shard_tree_range (ShardTree tree,
+                  const void *lo,
+                  const void *hi,
+                  void (*func) (void *, void *),
+                  void *extra_data)
+{
+  ShardMap *map;
+  atomic_size_t *active;
+  size_t first, last, i, count = 0;
+
+  if (tree->index.compare (lo, hi) >= 0)
+    return 0;
+
+  // hi is excluded, but its shard may hold smaller payloads
+  active = shard_index_enter (&tree->index);
+  do
+    {
+      map = atomic_load (&tree->index.map);
+      first = shard_of (&tree->index, map, lo);
+      last = shard_of (&tree->index, map, hi);
+    }
+  while (!lock_shards (tree, map, first, last));
+  shard_index_leave (active);
+
+  for (i = first; i <= last; i++)
+    count += tree_range (tree_handle_root (tree->shards[i].handle), lo, hi,
+                         tree->index.compare, func, extra_data);
+  unlock_shards (tree, first, last);
+  return count;
+}
+
+void
+shard_tree_in_order (ShardTree tree,
+                     void (*func) (void *, void *),
+                     void *extra_data)
+{
+  size_t i;
+
+  lock_all_shards (tree);
+  for (i = 0; i < tree->index.count; i++)
+    tree_in_order (tree_handle_root (tree->shards[i].handle), func,
+                   extra_data);
+  unlock_shards (tree, 0, tree->index.count - 1);
+}
+
+bool
+shard_tree_insert (ShardTree tree, const void *data)
+{
+  Shard *shard = lock_shard_of (tree, data, true);
+  bool inserted = tree_handle_insert (shard->handle, data) != NULL;
+
+  pthread_rwlock_unlock (&shard->lock);
+  return inserted;
+}
+
+bool
+shard_tree_remove (ShardTree tree, const void *data)
+{
+  Shard *shard = lock_shard_of (tree, data, true);
+  bool removed = tree_handle_remove (shard->handle, data);
+
+  pthread_rwlock_unlock (&shard->lock);
+  return removed;
+}
+
+/*--------------------------------------------------------------------*/
+/* Rebuild: the split points that move come in runs of consecutive ones,
+   and each run only concerns the shards on both sides of its points. The
+   trees of those shards are joined into one, which is split again at the
+   new points: O(log n) per shard. The sizes of the new shards come from
+   the number of payloads between the old and the new place of each point,
+   O(log n) with the subtree counts, else one step per payload counted.
+   Only these shards are locked, the others stay in use. Nodes thus move
+   to other shards, whose slabs get them back on removal. */
+
+// Split points at ranks total / count, 2 total / count... of the shards as
+// they are, false if they are empty
+static bool
+balanced_split_points (ShardTree tree, ShardMap *map)
+{
+  size_t count = tree->index.count, size = tree->index.size;
+  size_t i, j, before = 0, total = 0;
+#if !TREE_ORDER_STATISTICS
+  Tree node = NULL;
+  size_t at = 0; // rank of node
+#endif
+
+  lock_all_shards (tree);
+  for (i = 0; i < count; i++)
+    total += tree_handle_size (tree->shards[i].handle);
+
+  for (i = 0, j = 1; total > 0 && j < count; j++)
+    {
+      size_t rank = j * total / count;
+      TreeHandle handle;
+
+      // before: the payloads of the shards left of shard i
+      while (rank >= before + tree_handle_size (tree->shards[i].handle))
+        before += tree_handle_size (tree->shards[i++].handle);
+      handle = tree->shards[i].handle;
+#if TREE_ORDER_STATISTICS
+      memcpy (map->split_points + (j - 1) * size,
+              tree_get_data (tree_select (tree_handle_root (handle),
+                                          rank - before)), size);
+#else
+      if (!node || at < before)
+        {
+          node = tree_handle_first (handle);
+          at = before;
+        }
+      for (; at < rank; at++)
+        node = tree_next (node);
+      memcpy (map->split_points + (j - 1) * size, tree_get_data (node),
+              size);
+#endif
+    }
+
+  unlock_shards (tree, 0, count - 1);
+  map->split = total > 0;
+  return map->split;
+}
+
+// Move the payloads of shards first to last to their shards in map;
+// below[i] is scratch room for each split point i of the run
+static void
+move_run (ShardTree tree,
+          const ShardMap *old,
+          const ShardMap *map,
+          size_t first,
+          size_t last,
+          size_t *below)
+{
+  ShardIndex *index = &tree->index;
+  Tree joined = NULL, lo;
+  size_t i, total = 0;
+
+  for (i = first; i <= last; i++)
+    {
+      total += tree_handle_size (tree->shards[i].handle);
+      below[i] = total;
+      joined = tree_concat (joined,
+                            tree_handle_release (tree->shards[i].handle));
+    }
+  for (i = first; i < last; i++)
+    below[i] = shard_count_below (index, joined, old, map, i, below[i]);
+
+  for (i = first; i < last; i++)
+    {
+      tree_split (joined, shard_split_point (index, map, i), index->compare,
+                  &lo, &joined);
+      tree_handle_adopt (tree->shards[i].handle, lo,
+                         below[i] - (i > first ? below[i - 1] : 0));
+    }
+  tree_handle_adopt (tree->shards[last].handle, joined,
+                     total - (last > first ? below[last - 1] : 0));
+}
+
+bool
+shard_tree_rebuild (ShardTree tree, const void *split_points)
+{
+  ShardIndex *index = &tree->index;
+  size_t count = index->count, first, last, i;
+  ShardMap *map = shard_map_new (index, split_points), *old;
+  size_t *below = malloc (count * sizeof (*below));
+  bool *moved = malloc (count * sizeof (*moved));
+
+  if (!map || !below || !moved)
+    {
+      free (map);
+      free (below);
+      free (moved);
+      return false;
+    }
+
+  pthread_mutex_lock (&tree->rebuild_lock);
+  if (split_points || balanced_split_points (tree, map))
+    {
+      // moved[i]: split point i moves, the last one stays for the loops
+      old = atomic_load (&index->map);
+      for (i = 0; i + 1 < count; i++)
+        moved[i] = shard_boundary_moved (index, old, map, i);
+      moved[count - 1] = false;
+
+      for (i = 0; i < count; i++)
+        if (moved[i] || (i > 0 && moved[i - 1]))
+          pthread_rwlock_wrlock (&tree->shards[i].lock);
+      for (first = 0; first + 1 < count; first = last + 1)
+        {
+          for (last = first; moved[last]; last++)
+            ;
+          if (last > first)
+            move_run (tree, old, map, first, last, below);
+        }
+      shard_index_publish (index, map);
+      for (i = count; i-- > 0;)
+        if (moved[i] || (i > 0 && moved[i - 1]))
+          pthread_rwlock_unlock (&tree->shards[i].lock);
+
+      shard_index_reclaim (index, old);
+    }
+  else
+    free (map); // Nothing to balance
+
+  pthread_mutex_unlock (&tree->rebuild_lock);
+  free (below);
+  free (moved);
+  return true;
+}
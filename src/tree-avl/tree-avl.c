@@ -1,10 +1,210 @@
-
-
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 #include "tree-avl.h"
 #include <stdbool.h>
 #include "min-max.h"
 
+/*--------------------------------------------------------------------*/
+/* Node layout: the balance factor lives in the 2 low bits of the parent
+   link, which are always 0 since nodes are at least 4-byte aligned. */
+
+#define BALANCE_MASK ((uintptr_t) 3)
+
+// Bytes needed by a node carrying a payload of the given size
+#define NODE_SIZE(size) (offsetof (struct _TreeNode, data) + (size))
+
+static inline Tree
+node_parent (Tree node)
+{
+  return (Tree) (node->parent & ~BALANCE_MASK);
+}
+
+static inline void
+node_set_parent (Tree node, Tree parent)
+{
+  node->parent = (uintptr_t) parent | (node->parent & BALANCE_MASK);
+}
+
+// balance = height(left) - height(right), stored as balance + 1
+static inline int
+node_balance (Tree node)
+{
+  return (int) (node->parent & BALANCE_MASK) - 1;
+}
+
+static inline void
+node_set_balance (Tree node, int balance)
+{
+  node->parent = (node->parent & ~BALANCE_MASK) | (uintptr_t) (balance + 1);
+}
+
+/* Subtree counts (TREE_ORDER_STATISTICS): node_update() recounts a node
+   from its children, update_path() every node from node up to the root. */
+#if TREE_ORDER_STATISTICS
+static inline size_t
+node_count (Tree node)
+{
+  return node ? node->count : 0;
+}
+
+static inline void
+node_update (Tree node)
+{
+  node->count = 1 + node_count (node->left) + node_count (node->right);
+}
+#else
+static inline void
+node_update (Tree node)
+{
+  (void) node;
+}
+#endif
+
+static void
+update_path (Tree node)
+{
+#if TREE_ORDER_STATISTICS
+  for (; node; node = node_parent (node))
+    node_update (node);
+#else
+  (void) node;
+#endif
+}
+
+// Link child below node, without touching the counts
+static inline void
+link_left (Tree node, Tree child)
+{
+  node->left = child;
+  if (child)
+    node_set_parent (child, node);
+}
+
+static inline void
+link_right (Tree node, Tree child)
+{
+  node->right = child;
+  if (child)
+    node_set_parent (child, node);
+}
+
+/*--------------------------------------------------------------------*/
+/* Node allocator: a slab carves the nodes of a tree out of large chunks
+   and recycles removed nodes through a free list. Every function taking a
+   slab falls back on malloc/free when it is NULL. */
+
+#define TREE_SLAB_CHUNK 65536
+
+typedef union _TreeSlabChunk
+  {
+    union _TreeSlabChunk *next;
+    max_align_t align; // the nodes follow the header, suitably aligned
+  } TreeSlabChunk;
+
+struct _TreeSlab
+  {
+    size_t size;           // payload size the slab was created for
+    size_t node_size;      // size of a node, rounded up for alignment
+    size_t chunk_nodes;    // number of nodes per chunk
+    TreeSlabChunk *chunks; // every chunk, most recent first
+    char *next;            // first never used node of the current chunk
+    char *end;             // end of the current chunk
+    void *free_list;       // released nodes, linked through their first word
+  };
+
+TreeSlab *
+tree_slab_new (size_t size)
+{
+  TreeSlab *slab = malloc (sizeof (*slab));
+  size_t align = _Alignof (max_align_t);
+
+  if (slab)
+    {
+      slab->size = size;
+      slab->node_size = (NODE_SIZE (size) + align - 1) / align * align;
+      slab->chunk_nodes = MAX (TREE_SLAB_CHUNK / slab->node_size, 16);
+      slab->chunks = NULL;
+      slab->next = NULL;
+      slab->end = NULL;
+      slab->free_list = NULL;
+    }
+
+  return slab;
+}
+
+// Give every chunk back to the system: all the nodes are released at once
+static void
+tree_slab_release (TreeSlab *slab)
+{
+  while (slab->chunks)
+    {
+      TreeSlabChunk *next = slab->chunks->next;
+      free (slab->chunks);
+      slab->chunks = next;
+    }
+  slab->next = NULL;
+  slab->end = NULL;
+  slab->free_list = NULL;
+}
+
+void
+tree_slab_delete (TreeSlab *slab)
+{
+  if (slab)
+    {
+      tree_slab_release (slab);
+      free (slab);
+    }
+}
+
+static Tree
+node_alloc (TreeSlab *slab, size_t size)
+{
+  void *node;
+
+  if (!slab)
+    return malloc (NODE_SIZE (size));
+  if (size > slab->size)
+    return NULL;
+
+  if (slab->free_list)
+    {
+      node = slab->free_list;
+      slab->free_list = *(void **) node;
+      return node;
+    }
+
+  if (slab->next == slab->end)
+    {
+      TreeSlabChunk *chunk = malloc (sizeof (*chunk)
+                                     + slab->chunk_nodes * slab->node_size);
+      if (!chunk)
+        return NULL;
+      chunk->next = slab->chunks;
+      slab->chunks = chunk;
+      slab->next = (char *) (chunk + 1);
+      slab->end = slab->next + slab->chunk_nodes * slab->node_size;
+    }
+  node = slab->next;
+  slab->next += slab->node_size;
+  return node;
+}
+
+static void
+node_free (TreeSlab *slab, Tree node)
+{
+  if (!slab)
+    free (node);
+  else
+    {
+      *(void **) node = slab->free_list;
+      slab->free_list = node;
+    }
+}
+
 /*--------------------------------------------------------------------*/
 Tree
 tree_new ()
@@ -25,10 +225,54 @@ tree_delete (Tree tree, void (*delete) (void *))
     }
 }
 
+static void
+delete_payloads (Tree tree, void (*delete) (void *))
+{
+  if (tree)
+    {
+      delete_payloads (tree->left, delete);
+      delete_payloads (tree->right, delete);
+      delete (tree->data);
+    }
+}
+
+void
+tree_delete_slab (Tree tree, TreeSlab *slab, void (*delete) (void *))
+{
+  if (!slab)
+    tree_delete (tree, delete);
+  else
+    {
+      // Only the payloads need a walk, the nodes go with their chunks
+      if (delete)
+        delete_payloads (tree, delete);
+      tree_slab_release (slab);
+    }
+}
+
+void
+tree_delete_into_slab (Tree tree, TreeSlab *slab, void (*delete) (void *))
+{
+  if (tree)
+    {
+      tree_delete_into_slab (tree->left, slab, delete);
+      tree_delete_into_slab (tree->right, slab, delete);
+      if (delete)
+        delete (tree->data);
+      node_free (slab, tree);
+    }
+}
+
 Tree
 tree_create (const void *data, size_t size)
 {
-  Tree tree = malloc(sizeof(*tree) - sizeof(tree->data) + size); //Allocate more data for the parent and the balance
+  return tree_slab_create (NULL, data, size);
+}
+
+Tree
+tree_slab_create (TreeSlab *slab, const void *data, size_t size)
+{
+  Tree tree = node_alloc(slab, size);
   if (tree)
     {
 
@@ -36,9 +280,10 @@ tree_create (const void *data, size_t size)
       tree->right = NULL;
 
       //NEW: Parent node and balance
-      tree->parent = NULL;
-      tree->balance = 0;
-      
+      tree->parent = 0;
+      node_set_balance (tree, 0);
+      node_update (tree);
+
       memcpy (tree->data, data, size);
     }
 
@@ -63,6 +308,24 @@ tree_get_right (Tree tree)
     return NULL;
 }
 
+Tree
+tree_get_parent (Tree tree)
+{
+  if (tree)
+    return node_parent (tree);
+  else
+    return NULL;
+}
+
+int
+tree_get_balance (Tree tree)
+{
+  if (tree)
+    return node_balance (tree);
+  else
+    return 0;
+}
+
 void *
 tree_get_data (Tree tree)
 {
@@ -77,11 +340,8 @@ tree_set_left (Tree tree, Tree left)
 {
   if (tree)
     {
-      tree->left = left;
-
-      //NEW: set the parent pointer for the child
-      if (left) left->parent=tree;
-
+      link_left (tree, left);
+      update_path (tree);
       return true;
     }
   else
@@ -93,11 +353,8 @@ tree_set_right (Tree tree, Tree right)
 {
   if (tree)
     {
-      tree->right = right;
-
-      //NEW: set the parent pointer for the child
-      if (right) right->parent=tree;
-
+      link_right (tree, right);
+      update_path (tree);
       return true;
     }
   else
@@ -156,6 +413,58 @@ tree_post_order (Tree tree,
     }
 }
 
+Tree
+tree_first (Tree tree)
+{
+  if (tree)
+    while (tree->left)
+      tree = tree->left;
+  return tree;
+}
+
+Tree
+tree_last (Tree tree)
+{
+  if (tree)
+    while (tree->right)
+      tree = tree->right;
+  return tree;
+}
+
+Tree
+tree_next (Tree node)
+{
+  Tree parent;
+
+  if (node->right)
+    return tree_first (node->right);
+  // Climb until coming from a left child
+  parent = node_parent (node);
+  while (parent && node == parent->right)
+    {
+      node = parent;
+      parent = node_parent (node);
+    }
+  return parent;
+}
+
+Tree
+tree_prev (Tree node)
+{
+  Tree parent;
+
+  if (node->left)
+    return tree_last (node->left);
+  // Climb until coming from a right child
+  parent = node_parent (node);
+  while (parent && node == parent->left)
+    {
+      node = parent;
+      parent = node_parent (node);
+    }
+  return parent;
+}
+
 size_t
 tree_height (Tree tree)
 {
@@ -169,11 +478,66 @@ tree_height (tree->right));
 size_t
 tree_size (Tree tree)
 {
+#if TREE_ORDER_STATISTICS
+  return node_count (tree);
+#else
   if (tree)
     return 1 + tree_size (tree->left) + tree_size
 (tree->right);
   else
     return 0;
+#endif
+}
+
+Tree
+tree_select (Tree tree, size_t k)
+{
+#if TREE_ORDER_STATISTICS
+  while (tree)
+    {
+      size_t left = node_count (tree->left);
+
+      if (k == left)
+        return tree;
+      if (k < left)
+        tree = tree->left;
+      else
+        {
+          k -= left + 1;
+          tree = tree->right;
+        }
+    }
+  return NULL;
+#else
+  for (tree = tree_first (tree); tree && k > 0; k--)
+    tree = tree_next (tree);
+  return tree;
+#endif
+}
+
+size_t
+tree_rank (Tree tree,
+           const void *data,
+           int (*compare) (const void *, const void *))
+{
+  size_t rank = 0;
+
+#if TREE_ORDER_STATISTICS
+  while (tree)
+    if (compare (tree->data, data) < 0)
+      {
+        rank += node_count (tree->left) + 1;
+        tree = tree->right;
+      }
+    else
+      tree = tree->left;
+#else
+  for (tree = tree_first (tree);
+       tree && compare (tree->data, data) < 0;
+       tree = tree_next (tree))
+    rank++;
+#endif
+  return rank;
 }
 
 void *
@@ -182,40 +546,115 @@ tree_search (Tree tree,
              int (*compare) (const void *, const void
 *))
 {
-  if (tree)
+  while (tree)
     {
-      switch (compare (data, tree->data))
-        {
-        case -1:
-          return tree_search (tree->left, data, compare);
-        case 0:
-          return tree->data;
-        case 1:
-          return tree_search (tree->right, data, compare);
-        default:
-            return NULL; // RAJOUTE CAR WARNING !!!
-        }
+      int cmp = compare (data, tree->data);
+
+      if (cmp == 0)
+        return tree->data;
+      tree = cmp < 0 ? tree->left : tree->right;
     }
-  else
-    return NULL;
+  return NULL;
 }
 
-static void
-set (void *data,void *array)
+Tree
+tree_lower_bound (Tree tree,
+                  const void *data,
+                  int (*compare) (const void *, const void *))
 {
-  static size_t size;
-  static size_t offset;
+  Tree bound = NULL;
 
-  if (data)
-    {
-      memcpy (array + offset, data, size);
-      offset += size;
-    }
-  else
+  while (tree)
+    if (compare (tree->data, data) < 0)
+      tree = tree->right;
+    else
+      {
+        bound = tree;
+        tree = tree->left;
+      }
+  return bound;
+}
+
+Tree
+tree_upper_bound (Tree tree,
+                  const void *data,
+                  int (*compare) (const void *, const void *))
+{
+  Tree bound = NULL;
+
+  while (tree)
+    if (compare (tree->data, data) <= 0)
+      tree = tree->right;
+    else
+      {
+        bound = tree;
+        tree = tree->left;
+      }
+  return bound;
+}
+
+Tree
+tree_floor (Tree tree,
+            const void *data,
+            int (*compare) (const void *, const void *))
+{
+  Tree bound = NULL;
+
+  while (tree)
+    if (compare (tree->data, data) > 0)
+      tree = tree->left;
+    else
+      {
+        bound = tree;
+        tree = tree->right;
+      }
+  return bound;
+}
+
+Tree
+tree_ceil (Tree tree,
+           const void *data,
+           int (*compare) (const void *, const void *))
+{
+  return tree_lower_bound (tree, data, compare);
+}
+
+size_t
+tree_range (Tree tree,
+            const void *lo,
+            const void *hi,
+            int (*compare) (const void *, const void *),
+            void (*func) (void *, void *),
+            void *extra_data)
+{
+  size_t count = 0;
+  Tree node;
+
+  for (node = tree_lower_bound (tree, lo, compare);
+       node && compare (node->data, hi) < 0;
+       node = tree_next (node))
     {
-      offset = 0;
-      size = *(size_t *) array;
+      func (node->data, extra_data);
+      count++;
     }
+  return count;
+}
+
+// Where tree_sort() copies the next payload: per call, so that sorts can
+// run concurrently
+typedef struct
+  {
+    char *next;
+    size_t size;
+  } SortCursor;
+
+static void
+set (void *data, void *extra_data)
+{
+  SortCursor *cursor = extra_data;
+
+  memcpy (cursor->next, data, cursor->size);
+  cursor->next += cursor->size;
 }
 
 int
@@ -226,36 +665,51 @@ tree_sort (void *array,
 {
   size_t i;
   Tree tree = tree_new ();
+  TreeSlab *slab = tree_slab_new (size); // NULL: fall back on malloc
   void *pointer;
 
   pointer = array;
   for (i = 0; i < length; i++)
     {
-      if (tree_insert_sorted (&tree, pointer, size,
+      if (tree_insert_sorted_slab (&tree, slab, pointer, size,
 compare))
         pointer += size;
       else
         {
-          tree_delete (tree, NULL);
+          tree_delete_slab (tree, slab, NULL);
+          tree_slab_delete (slab);
           return false;
         }
     }
-  set (NULL, &size);
-  tree_in_order (tree, set, array);
-  tree_delete (tree, NULL);
+  SortCursor cursor = { array, size };
+  tree_in_order (tree, set, &cursor);
+  tree_delete_slab (tree, slab, NULL);
+  tree_slab_delete (slab);
   return true;
 }
 
 
 
 // ========================== ALL OF MY WORK ARE BELOW ========================================
-//NEW: Recomputing balance for a node = height left - height right
-static void recompute_balance(Tree tree)
+/* Balance factors are maintained incrementally: a rotation only needs the
+   old factors of the two nodes it moves, so no call to tree_height() is
+   ever made while inserting or removing. */
+
+// Make the link that pointed to u (from its parent, or the root) point to v
+static void replace_child(Tree *root, Tree parent, Tree u, Tree v)
 {
-  if (!tree) return;
-  int hl = (int)tree_height(tree->left);
-  int hr = (int)tree_height(tree->right);
-  tree->balance = hl-hr;
+  if (parent == NULL)
+  {
+    *root = v;
+  }
+  else if (parent->left == u)
+  {
+    parent->left = v;
+  }
+  else
+  {
+    parent->right = v;
+  }
 }
 
 /* rotate left:
@@ -266,20 +720,20 @@ static void recompute_balance(Tree tree)
     b   c           a   b
     
 */
-static Tree rotate_left(Tree A) {
+static Tree rotate_left(Tree *root, Tree A) {
   Tree B = A->right;
   Tree b = B->left;
+  Tree parent = node_parent(A);
 
   // Perform rotation
-  tree_set_left(B, A);
-  tree_set_right(A, b);
+  link_right(A, b);
+  link_left(B, A);
+  node_update(A);
+  node_update(B);
 
   // Update parents
-  B->parent = A->parent;
-
-  // Recalculate balance factors for the affected nodes
-  recompute_balance(A);
-  recompute_balance(B);
+  node_set_parent(B, parent);
+  replace_child(root, parent, A, B);
 
   return B; // Return new root of this subtree
 }
@@ -291,185 +745,1254 @@ static Tree rotate_left(Tree A) {
      / \                   / \
     a   b                 b   c
 */
-static Tree rotate_right(Tree B) {
+static Tree rotate_right(Tree *root, Tree B) {
   Tree A = B->left;
   Tree b = A->right;
+  Tree parent = node_parent(B);
 
   // Perform rotation
-  tree_set_right(A, B);
-  tree_set_left(B, b);
-  
-  // Update parents
-  A->parent = B->parent;
+  link_left(B, b);
+  link_right(A, B);
+  node_update(B);
+  node_update(A);
 
-  // Recalculate balance factors for the affected nodes
-  recompute_balance(B);
-  recompute_balance(A);
+  // Update parents
+  node_set_parent(A, parent);
+  replace_child(root, parent, B, A);
 
   return A; // Return new root of this subtree
 }
 
-bool
-tree_insert_sorted (Tree * ptree,
-                    const void *data,
-                    size_t size,
-                    int (*compare) (const void *, const void *))
+/* Restore the AVL property on a node whose balance reached +2 or -2. That
+   balance cannot be stored in a node, so it is passed along; the final
+   balance factors only depend on the old ones of the child (and grandchild
+   for a double rotation). */
+static Tree rebalance(Tree *root, Tree node, int balance)
 {
- if (!*ptree) {
-        // Base case: insert new node here
-        Tree new_node = tree_create(data, size);
-        if (!new_node) {
-            return false;
-        }
-        *ptree = new_node;
-        return true;
-    }
+  // Left Heavy
+  if (balance > 1) {
+    Tree A = node->left;
+    int a = node_balance(A);
 
-    Tree root = *ptree;
-    int cmp = compare(data, root->data);
+    // Left-Right case
+    if (a < 0) {
+      Tree G = A->right;
+      int g = node_balance(G);
 
-    if (cmp < 0) {
-        // Go Left
-        if (!tree_insert_sorted(&root->left, data, size, compare)) {
-            return false;
-        }
-        if (root->left) root->left->parent = root;
-    } else {
-        // Go Right (handles equal values too)
-        if (!tree_insert_sorted(&root->right, data, size, compare)) {
-            return false;
-        }
-        if (root->right) root->right->parent = root;
+      rotate_left(root, A);
+      rotate_right(root, node);
+      node_set_balance(A, g < 0 ? 1 : 0);
+      node_set_balance(node, g > 0 ? -1 : 0);
+      node_set_balance(G, 0);
+      return G;
     }
+    // Left-Left case
+    rotate_right(root, node);
+    node_set_balance(node, 1 - a);
+    node_set_balance(A, a - 1);
+    return A;
+  }
+  // Right Heavy
+  if (balance < -1) {
+    Tree B = node->right;
+    int b = node_balance(B);
 
-    // After insertion, update balance and rebalance if needed
-    recompute_balance(root);
-    
-    // Left Heavy
-    if (root->balance > 1) {
-        // Left-Right case
-        if (root->left && root->left->balance < 0) {
-            root->left = rotate_left(root->left);
-        }
-        // Left-Left case (or after fixing LR)
-        *ptree = rotate_right(root);
-    }
-    // Right Heavy
-    else if (root->balance < -1) {
-        // Right-Left case
-        if (root->right && root->right->balance > 0) {
-            root->right = rotate_right(root->right);
-        }
-        // Right-Right case (or after fixing RL)
-        *ptree = rotate_left(root);
-    } else {
-        // No rotation needed, just update the pointer
-        *ptree = root;
-    }
+    // Right-Left case
+    if (b > 0) {
+      Tree G = B->left;
+      int g = node_balance(G);
 
-    return true;
+      rotate_right(root, B);
+      rotate_left(root, node);
+      node_set_balance(B, g > 0 ? -1 : 0);
+      node_set_balance(node, g < 0 ? 1 : 0);
+      node_set_balance(G, 0);
+      return G;
+    }
+    // Right-Right case
+    rotate_left(root, node);
+    node_set_balance(node, -1 - b);
+    node_set_balance(B, b + 1);
+    return B;
+  }
+  node_set_balance(node, balance);
+  return node;
 }
 
-// helper: find minimum node in subtree
-static Tree min_value_node(Tree node) {
-    Tree current = node;
-    while (current && current->left)
-        current = current->left;
-    return current;
-}
-bool tree_remove_sorted(Tree *ptree,
-                        const void *data,
-                        int (*compare)(const void *, const void *)) 
+/* Walk up from a freshly inserted node. The height of the subtree grew by
+   one: stop as soon as an ancestor absorbs it (balance back to 0) or after
+   the single rotation an insertion can ever need. */
+static void insert_retrace(Tree *root, Tree node)
 {
-    // Base case: data not found in this branch
-    if (!ptree || !*ptree) {
-        return false;
-    }
-
-    Tree root = *ptree;
-    int cmp = compare(data, root->data);
-
-    if (cmp < 0) {
-        // Recurse left
-        if (!tree_remove_sorted(&root->left, data, compare)) {
-            return false; // Node not found
-        }
-    } else if (cmp > 0) {
-        // Recurse right
-        if (!tree_remove_sorted(&root->right, data, compare)) {
-            return false; // Node not found
-        }
-    } else {
-        // Node found, start deletion logic
-        Tree node_to_delete = root;
-
-        if (!root->left || !root->right) {
-            // Case 1 & 2: Node has 0 or 1 child
-            Tree child = root->left ? root->left : root->right;
-            
-            if (child) {
-                child->parent = root->parent;
-            }
-            
-            *ptree = child; // Parent's pointer now points to the child (or NULL)
-            free(node_to_delete);
-            // The function will continue to the rebalancing part below
-            
-        } else {
-            // Case 3: Node has 2 children
-            // Find inorder successor (smallest node in the right subtree)
-            Tree succ = root->right;
-            while (succ->left) {
-                succ = succ->left;
-            }
+  Tree parent;
 
-            *(int*)root->data = *(int*)succ->data;
+  for (; (parent = node_parent(node)) != NULL; node = parent) {
+    int balance = node_balance(parent) + (node == parent->left ? 1 : -1);
 
-            // Recursively delete the successor node from the right subtree
-            tree_remove_sorted(&root->right, succ->data, compare);
-        }
+    if (balance == 0) {
+      node_set_balance(parent, 0);
+      break; // Height of parent unchanged
     }
-
-    // If the tree became empty after deletion ==> removing the last node
-    if (*ptree == NULL) {
-        return true;
+    if (balance > 1 || balance < -1) {
+      rebalance(root, parent, balance); // Back to the height before the insertion
+      break;
     }
-    
-    root = *ptree; 
+    node_set_balance(parent, balance);
+  }
+}
 
-    // --- Update balance and rebalance the tree ---
-    int leftH = root->left ? tree_height(root->left) + 1 : 0;
-    int rightH = root->right ? tree_height(root->right) + 1 : 0;
-    root->balance = leftH - rightH;
-    
-    // Left Heavy
-    if (root->balance > 1) { 
-        // Left-Left Case
-        if (root->left && root->left->balance >= 0) {
-            *ptree = rotate_right(root);
-        } 
-        // Left-Right Case
-        else {
-            root->left = rotate_left(root->left);
-            *ptree = rotate_right(root);
-        }
-    } 
-    // Right Heavy
-    else if (root->balance < -1) {
-        // Right-Right Case
-        if (root->right && root->right->balance <= 0) {
-            *ptree = rotate_left(root);
-        }
-        // Right-Left Case
-        else {
-            root->right = rotate_right(root->right);
-            *ptree = rotate_left(root);
-        }
+/* Walk up after a node was unlinked from the left (or right) of parent. The
+   height of that subtree shrank by one: stop as soon as an ancestor keeps
+   its height. */
+static void remove_retrace(Tree *root, Tree parent, bool left)
+{
+  while (parent) {
+    Tree sub = parent;
+    int balance = node_balance(parent) + (left ? -1 : 1);
+
+    if (balance == 1 || balance == -1) {
+      node_set_balance(parent, balance);
+      break; // Was balanced: height unchanged
     }
-    
-    // Update parent pointers after potential rotations
-    if ((*ptree)->left) (*ptree)->left->parent = *ptree;
-    if ((*ptree)->right) (*ptree)->right->parent = *ptree;
+    sub = rebalance(root, parent, balance);
+    if (node_balance(sub) != 0)
+      break; // Rotation kept the height
 
-    return true;
-}
\ No newline at end of file
+    // Height of sub shrank: report it to its own parent
+    parent = node_parent(sub);
+    if (parent)
+      left = parent->left == sub;
+  }
+}
+
+bool
+tree_insert_sorted (Tree * ptree,
+                    const void *data,
+                    size_t size,
+                    int (*compare) (const void *, const void *))
+{
+    return tree_insert_sorted_slab(ptree, NULL, data, size, compare);
+}
+
+bool
+tree_insert_sorted_slab (Tree * ptree,
+                         TreeSlab *slab,
+                         const void *data,
+                         size_t size,
+                         int (*compare) (const void *, const void *))
+{
+    Tree parent = NULL;
+    bool left = false;
+
+    if (!ptree) {
+        return false;
+    }
+
+    // Descend to the empty link where the data belongs
+    for (Tree node = *ptree; node; node = left ? node->left : node->right) {
+        parent = node;
+        left = compare(data, node->data) < 0; // equal values go right
+    }
+
+    Tree new_node = tree_slab_create(slab, data, size);
+    if (!new_node) {
+        return false;
+    }
+
+    tree_insert_node(ptree, parent, left, new_node);
+    return true;
+}
+
+/* Hinted insertion, a finger search from a node near the data: climb from
+   hint to the lowest subtree that must hold data, comparing only at the
+   ancestors that could bound it, then descend from the lowest climbed node
+   the descent would pass through anyway. Inserting next to the hint costs
+   O(1) comparisons. */
+static void hint_link(Tree hint, const void *data,
+                      int (*compare)(const void *, const void *),
+                      Tree *pparent, bool *pleft)
+{
+    bool after = compare(data, hint->data) >= 0;
+    Tree start = hint;
+    Tree x = hint;
+    Tree parent;
+
+    while ((parent = node_parent(x)) != NULL) {
+        if (x == (after ? parent->left : parent->right)) {
+            if ((compare(data, parent->data) >= 0) != after)
+                break; // parent bounds the subtree of x
+            start = parent;
+        }
+        x = parent;
+    }
+
+    // From start the descent goes to the side of data relative to hint
+    bool left = !after;
+    for (x = left ? start->left : start->right; x;
+         x = left ? x->left : x->right) {
+        start = x;
+        left = compare(data, x->data) < 0;
+    }
+    *pparent = start;
+    *pleft = left;
+}
+
+Tree tree_insert_hint(Tree *ptree,
+                      Tree hint,
+                      const void *data,
+                      size_t size,
+                      int (*compare)(const void *, const void *))
+{
+    return tree_insert_hint_slab(ptree, NULL, hint, data, size, compare);
+}
+
+Tree tree_insert_hint_slab(Tree *ptree,
+                           TreeSlab *slab,
+                           Tree hint,
+                           const void *data,
+                           size_t size,
+                           int (*compare)(const void *, const void *))
+{
+    Tree parent = NULL;
+    bool left = false;
+
+    if (!ptree)
+        return NULL;
+
+    if (hint) {
+        hint_link(hint, data, compare, &parent, &left);
+    } else {
+        for (Tree x = *ptree; x; x = left ? x->left : x->right) {
+            parent = x;
+            left = compare(data, x->data) < 0;
+        }
+    }
+
+    Tree node = tree_slab_create(slab, data, size);
+    if (!node)
+        return NULL;
+    tree_insert_node(ptree, parent, left, node);
+    return node;
+}
+
+Tree tree_insert_rightmost(Tree *ptree,
+                           Tree *prightmost,
+                           const void *data,
+                           size_t size,
+                           int (*compare)(const void *, const void *))
+{
+    return tree_insert_rightmost_slab(ptree, NULL, prightmost, data, size,
+                                      compare);
+}
+
+Tree tree_insert_rightmost_slab(Tree *ptree,
+                                TreeSlab *slab,
+                                Tree *prightmost,
+                                const void *data,
+                                size_t size,
+                                int (*compare)(const void *, const void *))
+{
+    if (!ptree || !prightmost)
+        return NULL;
+
+    Tree rightmost = *prightmost ? *prightmost : tree_last(*ptree);
+    Tree node;
+
+    if (rightmost && compare(data, rightmost->data) < 0)
+        return tree_insert_hint_slab(ptree, slab, rightmost, data, size,
+                                     compare);
+
+    // Appending: the data goes right of the last node, no descent
+    node = tree_slab_create(slab, data, size);
+    if (!node)
+        return NULL;
+    tree_insert_node(ptree, rightmost, false, node);
+    *prightmost = node;
+    return node;
+}
+
+/* Insert-or-find in one descent. compare() is three-way, so the descent
+   stops on an equal payload instead of running to a leaf and searching
+   again. */
+
+// Node whose payload, offset bytes into the data, equals data, or NULL and
+// the link where data belongs
+static Tree find_link(Tree tree, const void *data, size_t offset,
+                      int (*compare)(const void *, const void *),
+                      Tree *pparent, bool *pleft)
+{
+    Tree parent = NULL;
+    bool left = false;
+
+    while (tree) {
+        int cmp = compare(data, tree->data + offset);
+
+        if (cmp == 0)
+            return tree;
+        parent = tree;
+        left = cmp < 0;
+        tree = left ? tree->left : tree->right;
+    }
+    *pparent = parent;
+    *pleft = left;
+    return NULL;
+}
+
+Tree tree_insert_unique(Tree *ptree,
+                        const void *data,
+                        size_t size,
+                        int (*compare)(const void *, const void *),
+                        bool *inserted)
+{
+    return tree_insert_unique_slab(ptree, NULL, data, size, compare,
+                                   inserted);
+}
+
+Tree tree_insert_unique_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             size_t size,
+                             int (*compare)(const void *, const void *),
+                             bool *inserted)
+{
+    Tree parent;
+    bool left;
+    Tree node;
+
+    if (inserted)
+        *inserted = false;
+    if (!ptree)
+        return NULL;
+
+    node = find_link(*ptree, data, 0, compare, &parent, &left);
+    if (node)
+        return node;
+    node = tree_slab_create(slab, data, size);
+    if (!node)
+        return NULL;
+    tree_insert_node(ptree, parent, left, node);
+    if (inserted)
+        *inserted = true;
+    return node;
+}
+
+Tree tree_upsert(Tree *ptree,
+                 const void *data,
+                 size_t size,
+                 int (*compare)(const void *, const void *),
+                 bool *inserted)
+{
+    return tree_upsert_slab(ptree, NULL, data, size, compare, inserted);
+}
+
+Tree tree_upsert_slab(Tree *ptree,
+                      TreeSlab *slab,
+                      const void *data,
+                      size_t size,
+                      int (*compare)(const void *, const void *),
+                      bool *inserted)
+{
+    bool added;
+    Tree node = tree_insert_unique_slab(ptree, slab, data, size, compare,
+                                        &added);
+
+    // The payload compares equal: overwriting it keeps the tree sorted
+    if (node && !added)
+        memcpy(node->data, data, size);
+    if (inserted)
+        *inserted = added;
+    return node;
+}
+
+/* Multiset: equal payloads share one node holding their multiplicity, a
+   size_t stored before the payload. */
+#define MULTISET_HEADER sizeof(size_t)
+
+static size_t *multiset_count(Tree node)
+{
+    return (size_t *)node->data;
+}
+
+void *tree_multiset_get_data(Tree node)
+{
+    return node ? node->data + MULTISET_HEADER : NULL;
+}
+
+size_t tree_multiset_get_count(Tree node)
+{
+    return node ? *multiset_count(node) : 0;
+}
+
+Tree tree_multiset_add(Tree *ptree,
+                       const void *data,
+                       size_t size,
+                       int (*compare)(const void *, const void *))
+{
+    Tree parent;
+    bool left;
+    Tree node;
+
+    if (!ptree)
+        return NULL;
+
+    node = find_link(*ptree, data, MULTISET_HEADER, compare, &parent, &left);
+    if (node) {
+        (*multiset_count(node))++;
+        return node;
+    }
+    node = malloc(NODE_SIZE(MULTISET_HEADER + size));
+    if (!node)
+        return NULL;
+    *multiset_count(node) = 1;
+    memcpy(node->data + MULTISET_HEADER, data, size);
+    tree_insert_node(ptree, parent, left, node);
+    return node;
+}
+
+bool tree_multiset_remove(Tree *ptree,
+                          const void *data,
+                          int (*compare)(const void *, const void *))
+{
+    Tree parent;
+    bool left;
+    Tree node;
+
+    if (!ptree)
+        return false;
+
+    node = find_link(*ptree, data, MULTISET_HEADER, compare, &parent, &left);
+    if (!node)
+        return false;
+    if (--*multiset_count(node) == 0) {
+        tree_detach_node(ptree, node);
+        free(node);
+    }
+    return true;
+}
+
+size_t tree_multiset_count(Tree tree,
+                           const void *data,
+                           int (*compare)(const void *, const void *))
+{
+    Tree parent;
+    bool left;
+
+    return tree_multiset_get_count(find_link(tree, data, MULTISET_HEADER,
+                                             compare, &parent, &left));
+}
+
+void
+tree_insert_node (Tree * ptree, Tree parent, bool left, Tree node)
+{
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = 0;
+    node_set_parent(node, parent);
+    node_set_balance(node, 0);
+    node_update(node);
+
+    if (!parent)
+        *ptree = node;
+    else if (left)
+        parent->left = node;
+    else
+        parent->right = node;
+
+    update_path(parent);
+    insert_retrace(ptree, node);
+}
+
+bool tree_remove_sorted(Tree *ptree,
+                        const void *data,
+                        int (*compare)(const void *, const void *)) 
+{
+    return tree_remove_sorted_slab(ptree, NULL, data, compare);
+}
+
+bool tree_remove_sorted_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             int (*compare)(const void *, const void *))
+{
+    if (!ptree) {
+        return false;
+    }
+
+    Tree node = *ptree;
+    while (node) {
+        int cmp = compare(data, node->data);
+        if (cmp == 0)
+            break;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    if (!node) {
+        return false; // Node not found
+    }
+
+    tree_detach_node(ptree, node);
+    node_free(slab, node);
+    return true;
+}
+
+Tree tree_remove_node(Tree *ptree, Tree node)
+{
+    return tree_remove_node_slab(ptree, NULL, node);
+}
+
+// No search: the links are fixed from the node up, through the parents
+Tree tree_remove_node_slab(Tree *ptree, TreeSlab *slab, Tree node)
+{
+    Tree next;
+
+    if (!ptree || !node)
+        return NULL;
+
+    next = tree_next(node);
+    tree_detach_node(ptree, node);
+    node_free(slab, node);
+    return next;
+}
+
+void tree_detach_node(Tree *ptree, Tree node)
+{
+    Tree parent;
+    bool left;
+
+    if (node->left && node->right) {
+        // Case 3: Node has 2 children
+        // Splice its inorder successor (smallest node in the right subtree)
+        // into its place: no payload is moved, whatever its size
+        Tree succ = node->right;
+        while (succ->left) {
+            succ = succ->left;
+        }
+
+        if (node_parent(succ) == node) {
+            // The right subtree of succ took its place
+            parent = succ;
+            left = false;
+        } else {
+            parent = node_parent(succ);
+            left = true;
+            link_left(parent, succ->right);
+            link_right(succ, node->right);
+        }
+        link_left(succ, node->left);
+        succ->parent = node->parent; // Parent and balance of node
+        replace_child(ptree, node_parent(node), node, succ);
+    } else {
+        // Case 1 & 2: Node has 0 or 1 child
+        Tree child = node->left ? node->left : node->right;
+
+        parent = node_parent(node);
+        left = parent && parent->left == node;
+        if (child) {
+            node_set_parent(child, parent);
+        }
+        replace_child(ptree, parent, node, child);
+    }
+
+    update_path(parent); // Every subtree from parent up lost a node
+    remove_retrace(ptree, parent, left);
+}
+
+/* Bulk building: the nodes of a sorted sequence are linked by splitting it
+   in the middle, recursively. A subtree of n nodes built that way has
+   height bit_length(n), which gives the balance factors without walking
+   the subtrees. */
+static int sorted_height(size_t length)
+{
+    int height = 0;
+
+    for (; length; length >>= 1)
+        height++;
+    return height;
+}
+
+// Link nodes[0..length), in order, below parent and return their root
+static Tree link_sorted(Tree *nodes, size_t length, Tree parent)
+{
+    if (length == 0)
+        return NULL;
+
+    size_t mid = length / 2;
+    Tree node = nodes[mid];
+
+    node->parent = 0;
+    node_set_parent(node, parent);
+    node->left = link_sorted(nodes, mid, node);
+    node->right = link_sorted(nodes + mid + 1, length - mid - 1, node);
+    node_set_balance(node, sorted_height(mid) -
+                           sorted_height(length - mid - 1));
+    node_update(node);
+    return node;
+}
+
+Tree tree_from_sorted(const void *array, size_t length, size_t size)
+{
+    return tree_from_sorted_slab(NULL, array, length, size);
+}
+
+Tree tree_from_sorted_slab(TreeSlab *slab,
+                           const void *array,
+                           size_t length,
+                           size_t size)
+{
+    Tree *nodes = malloc(length * sizeof(Tree));
+    Tree tree = NULL;
+    size_t i;
+
+    if (!nodes)
+        return NULL;
+    for (i = 0; i < length; i++) {
+        nodes[i] = tree_slab_create(slab, (const char *)array + i * size,
+                                    size);
+        if (!nodes[i])
+            break;
+    }
+    if (i == length) {
+        tree = link_sorted(nodes, length, NULL);
+    } else {
+        while (i > 0)
+            node_free(slab, nodes[--i]);
+    }
+    free(nodes);
+    return tree;
+}
+
+/* Batch insertion. Below this fraction of the tree (batch * fraction <
+   tree size) the new nodes are inserted one by one; above it, walking the
+   whole tree to merge and relink it is cheaper than the descents. */
+#define TREE_BATCH_REBUILD_FRACTION 8
+
+/* Size of the tree if it is at most limit, else some size above limit:
+   without subtree counts, the walk stops there, so that a small batch
+   never walks a large tree. */
+static size_t tree_size_up_to(Tree tree, size_t limit)
+{
+#if TREE_ORDER_STATISTICS
+    (void)limit;
+    return tree_size(tree);
+#else
+    size_t count = 0;
+
+    for (tree = tree_first(tree); tree && count <= limit;
+         tree = tree_next(tree))
+        count++;
+    return count;
+#endif
+}
+
+/* Stable merge sort of items[0..length), pointers to payloads, tmp holds
+   length pointers. Return the array holding the result, items or tmp. */
+static const void **sort_items(const void **items, const void **tmp,
+                               size_t length,
+                               int (*compare)(const void *, const void *))
+{
+    for (size_t width = 1; width < length; width *= 2) {
+        for (size_t lo = 0; lo < length; lo += 2 * width) {
+            size_t mid = MIN(lo + width, length);
+            size_t hi = MIN(lo + 2 * width, length);
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi)
+                tmp[k++] = compare(items[j], items[i]) < 0
+                           ? items[j++] : items[i++];
+            while (i < mid)
+                tmp[k++] = items[i++];
+            while (j < hi)
+                tmp[k++] = items[j++];
+        }
+        const void **swap = items;
+        items = tmp;
+        tmp = swap;
+    }
+    return items;
+}
+
+/* Insert sorted nodes, each one from the previous: climb from it while the
+   new payload does not sort before the lowest ancestor it is left of, then
+   descend as usual. Equal payloads go right, like tree_insert_sorted(). */
+static void insert_finger(Tree *ptree, Tree *nodes, size_t length,
+                          int (*compare)(const void *, const void *))
+{
+    Tree finger = NULL;
+
+    for (size_t i = 0; i < length; i++) {
+        Tree node = nodes[i];
+        Tree x = *ptree;
+        Tree parent = NULL;
+        bool left = false;
+
+        if (finger) {
+            x = finger;
+            while ((parent = node_parent(x)) != NULL &&
+                   (x == parent->right ||
+                    compare(node->data, parent->data) >= 0))
+                x = parent;
+        }
+        for (; x; x = left ? x->left : x->right) {
+            parent = x;
+            left = compare(node->data, x->data) < 0;
+        }
+        tree_insert_node(ptree, parent, left, node);
+        finger = node;
+    }
+}
+
+TreeBatchStrategy tree_insert_batch(Tree *ptree,
+                                    const void *array,
+                                    size_t length,
+                                    size_t size,
+                                    int (*compare)(const void *, const void *))
+{
+    return tree_insert_batch_slab(ptree, NULL, array, length, size, compare);
+}
+
+TreeBatchStrategy tree_insert_batch_slab(Tree *ptree,
+                                         TreeSlab *slab,
+                                         const void *array,
+                                         size_t length,
+                                         size_t size,
+                                         int (*compare)(const void *,
+                                                        const void *))
+{
+    size_t count = tree_size_up_to(*ptree,
+                                   length * TREE_BATCH_REBUILD_FRACTION);
+    bool rebuild = length * TREE_BATCH_REBUILD_FRACTION >= count;
+    const void **items = malloc(2 * length * sizeof(void *));
+    // The new nodes, then the merged nodes when rebuilding
+    Tree *nodes = malloc((rebuild ? count + 2 * length : length)
+                         * sizeof(Tree));
+    size_t i;
+
+    if (!items || !nodes) {
+        free(items);
+        free(nodes);
+        return TREE_BATCH_FAILED;
+    }
+    // Sort pointers to the payloads: the nodes are then allocated in order
+    for (i = 0; i < length; i++)
+        items[i] = (const char *)array + i * size;
+    const void **sorted = sort_items(items, items + length, length, compare);
+    for (i = 0; i < length; i++) {
+        nodes[i] = tree_slab_create(slab, sorted[i], size);
+        if (!nodes[i]) {
+            while (i > 0)
+                node_free(slab, nodes[--i]);
+            free(items);
+            free(nodes);
+            return TREE_BATCH_FAILED;
+        }
+    }
+    free(items);
+
+    if (!rebuild) {
+        insert_finger(ptree, nodes, length, compare);
+        free(nodes);
+        return TREE_BATCH_FINGER;
+    }
+
+    // Merge the nodes of the tree with the new ones, the tree first on ties
+    Tree *merged = nodes + length;
+    Tree old = tree_first(*ptree);
+    size_t j = 0, k = 0;
+
+    while (old || j < length) {
+        if (old && (j == length || compare(nodes[j]->data, old->data) >= 0)) {
+            merged[k++] = old;
+            old = tree_next(old);
+        } else {
+            merged[k++] = nodes[j++];
+        }
+    }
+    *ptree = link_sorted(merged, count + length, NULL);
+    free(nodes);
+    return TREE_BATCH_REBUILD;
+}
+
+/* Join and split. Heights are passed along so that a join only walks down
+   the spine of the higher tree to the height of the other one:
+   O(difference + 1), and a split, which joins subtrees of increasing
+   heights, stays O(log n) overall. */
+
+// Height of a tree in O(log n), following the higher child
+static int height_of(Tree tree)
+{
+    int height = 0;
+
+    for (; tree; tree = node_balance(tree) < 0 ? tree->right : tree->left)
+        height++;
+    return height;
+}
+
+/* Walk up from a subtree that grew by one level when joining. Unlike after
+   an insertion, a rotation on a balanced child leaves the subtree one
+   level higher, then the walk goes on. Return whether the whole tree grew. */
+static bool join_retrace(Tree *root, Tree node)
+{
+    Tree parent;
+
+    while ((parent = node_parent(node)) != NULL) {
+        int balance = node_balance(parent) + (node == parent->left ? 1 : -1);
+
+        if (balance == 0) {
+            node_set_balance(parent, 0);
+            return false;
+        }
+        if (balance > 1 || balance < -1) {
+            node = rebalance(root, parent, balance);
+            if (node_balance(node) == 0)
+                return false; // Back to the height before the join
+        } else {
+            node_set_balance(parent, balance);
+            node = parent;
+        }
+    }
+    return true;
+}
+
+/* Join left (height hl), the node pivot and right (height hr) into one
+   tree, store its height in *height and return it. */
+static Tree join_with(Tree left, int hl, Tree pivot, Tree right, int hr,
+                      int *height)
+{
+    pivot->parent = 0;
+    if (left)
+        node_set_parent(left, NULL);
+    if (right)
+        node_set_parent(right, NULL);
+
+    if (hl - hr <= 1 && hr - hl <= 1) {
+        link_left(pivot, left);
+        link_right(pivot, right);
+        node_set_balance(pivot, hl - hr);
+        node_update(pivot);
+        *height = MAX(hl, hr) + 1;
+        return pivot;
+    }
+
+    // Walk down the inner spine of the higher tree to a subtree c at most
+    // one level higher than the other tree, which pivot replaces
+    Tree root = hl > hr ? left : right;
+    Tree c = root, p = NULL;
+    int h = MAX(hl, hr);
+
+    if (hl > hr) {
+        while (h > hr + 1) {
+            h -= node_balance(c) > 0 ? 2 : 1;
+            p = c;
+            c = c->right;
+        }
+        link_left(pivot, c);
+        link_right(pivot, right);
+        node_set_balance(pivot, h - hr);
+        link_right(p, pivot);
+    } else {
+        while (h > hl + 1) {
+            h -= node_balance(c) < 0 ? 2 : 1;
+            p = c;
+            c = c->left;
+        }
+        link_left(pivot, left);
+        link_right(pivot, c);
+        node_set_balance(pivot, hl - h);
+        link_left(p, pivot);
+    }
+    node_update(pivot);
+    update_path(p);
+
+    // The subtree of pivot is one level higher than c was
+    *height = MAX(hl, hr) + join_retrace(&root, pivot);
+    return root;
+}
+
+/* Split tree (height height) into the nodes before data, stored in *lo,
+   and the others, stored in *hi, with their heights. When equal is not
+   NULL, the first node found equal to data is kept out of both trees and
+   stored there. */
+static void split_with(Tree tree, int height,
+                       const void *data,
+                       int (*compare)(const void *, const void *),
+                       Tree *lo, int *hlo, Tree *hi, int *hhi, Tree *equal)
+{
+    if (!tree) {
+        *lo = *hi = NULL;
+        *hlo = *hhi = 0;
+        return;
+    }
+
+    Tree left = tree->left;
+    Tree right = tree->right;
+    int balance = node_balance(tree);
+    int hleft = height - (balance < 0 ? 2 : 1);
+    int hright = height - (balance > 0 ? 2 : 1);
+    int cmp = compare(tree->data, data);
+
+    if (equal && cmp == 0) {
+        *equal = tree;
+        *lo = left;
+        *hi = right;
+        *hlo = hleft;
+        *hhi = hright;
+        if (left)
+            node_set_parent(left, NULL);
+        if (right)
+            node_set_parent(right, NULL);
+        tree->left = tree->right = NULL;
+        tree->parent = 0;
+        node_update(tree);
+    } else if (cmp < 0) {
+        Tree rlo;
+        int hrlo;
+
+        split_with(right, hright, data, compare, &rlo, &hrlo, hi, hhi, equal);
+        *lo = join_with(left, hleft, tree, rlo, hrlo, hlo);
+    } else {
+        Tree lhi;
+        int hlhi;
+
+        split_with(left, hleft, data, compare, lo, hlo, &lhi, &hlhi, equal);
+        *hi = join_with(lhi, hlhi, tree, right, hright, hhi);
+    }
+}
+
+Tree tree_join(Tree left, Tree pivot, Tree right)
+{
+    int height;
+
+    return join_with(left, height_of(left), pivot,
+                     right, height_of(right), &height);
+}
+
+Tree tree_concat(Tree left, Tree right)
+{
+    Tree pivot = tree_last(left);
+
+    if (!pivot)
+        return right;
+    tree_detach_node(&left, pivot);
+    return tree_join(left, pivot, right);
+}
+
+void tree_split(Tree tree,
+                const void *data,
+                int (*compare)(const void *, const void *),
+                Tree *lo,
+                Tree *hi)
+{
+    int hlo, hhi;
+
+    split_with(tree, height_of(tree), data, compare,
+               lo, &hlo, hi, &hhi, NULL);
+}
+
+/* Set operations, by divide and conquer over join and split: split one
+   tree around the root of the other, recurse on both sides, join the
+   results. This costs O(m log(n / m + 1)) for trees of m <= n nodes.
+
+   The two recursive calls on large subtrees run in parallel: the first one
+   is queued for a pool of at most one worker per other online processor,
+   started on the first fork and joined at the end of the operation, and
+   the caller runs the second one. A caller that finds its first task still
+   queued takes it back and runs it, so a fork costs a lock and no thread
+   creation, and no thread waits on a task that nobody runs. */
+
+// Subtrees below this height are not worth a hand-off to a worker
+#define TREE_SET_PARALLEL_HEIGHT 16
+
+typedef enum { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE } SetOperation;
+
+typedef enum { TASK_QUEUED, TASK_RUNNING, TASK_DONE } TaskState;
+
+typedef struct _SetTask SetTask;
+
+typedef struct {
+    int (*compare)(const void *, const void *);
+    void (*delete_data)(void *);
+    pthread_mutex_t lock;   // guards everything below
+    pthread_cond_t work;    // a task was queued, or stop
+    pthread_cond_t done;    // a task is done
+    SetTask *head, *tail;   // queued tasks, oldest (largest) first
+    int queued;
+    int idle;               // workers waiting for a task
+    int workers, max_workers;
+    pthread_t *threads;
+    bool stop;
+} SetContext;
+
+struct _SetTask {
+    SetContext *context;
+    SetOperation operation;
+    Tree t1, t2;
+    int h1, h2;
+    Tree result;
+    int height;
+    TaskState state;
+    SetTask *prev, *next;
+};
+
+static Tree set_with(SetContext *context, SetOperation operation,
+                     Tree t1, int h1, Tree t2, int h2, int *height);
+
+static void set_task_run(SetTask *task)
+{
+    task->result = set_with(task->context, task->operation,
+                            task->t1, task->h1, task->t2, task->h2,
+                            &task->height);
+}
+
+static void unqueue(SetContext *context, SetTask *task)
+{
+    if (task->prev)
+        task->prev->next = task->next;
+    else
+        context->head = task->next;
+    if (task->next)
+        task->next->prev = task->prev;
+    else
+        context->tail = task->prev;
+    context->queued--;
+}
+
+static void *set_worker(void *arg)
+{
+    SetContext *context = arg;
+
+    pthread_mutex_lock(&context->lock);
+    while (!context->stop) {
+        SetTask *task = context->head;
+
+        if (!task) {
+            pthread_cond_wait(&context->work, &context->lock);
+            continue;
+        }
+        unqueue(context, task);
+        task->state = TASK_RUNNING;
+        context->idle--;
+        pthread_mutex_unlock(&context->lock);
+
+        set_task_run(task);
+
+        pthread_mutex_lock(&context->lock);
+        task->state = TASK_DONE;
+        context->idle++;
+        pthread_cond_broadcast(&context->done);
+    }
+    pthread_mutex_unlock(&context->lock);
+    return NULL;
+}
+
+// Queue task if a worker is, or can be made, idle for it
+static bool offer(SetContext *context, SetTask *task)
+{
+    bool queued = false;
+
+    pthread_mutex_lock(&context->lock);
+    if (context->queued >= context->idle &&
+        context->workers < context->max_workers &&
+        pthread_create(&context->threads[context->workers], NULL,
+                       set_worker, context) == 0) {
+        context->workers++;
+        context->idle++;
+    }
+    if (context->queued < context->idle) {
+        task->state = TASK_QUEUED;
+        task->prev = context->tail;
+        task->next = NULL;
+        if (context->tail)
+            context->tail->next = task;
+        else
+            context->head = task;
+        context->tail = task;
+        context->queued++;
+        pthread_cond_signal(&context->work);
+        queued = true;
+    }
+    pthread_mutex_unlock(&context->lock);
+    return queued;
+}
+
+// Run both tasks, the first one on a worker if allowed and possible
+static void run_both(SetContext *context, SetTask *a, SetTask *b,
+                     bool parallel)
+{
+    if (!parallel || context->max_workers == 0 || !offer(context, a)) {
+        set_task_run(a);
+        set_task_run(b);
+        return;
+    }
+    set_task_run(b);
+
+    pthread_mutex_lock(&context->lock);
+    if (a->state == TASK_QUEUED) {
+        unqueue(context, a);
+        pthread_mutex_unlock(&context->lock);
+        set_task_run(a);
+        return;
+    }
+    while (a->state != TASK_DONE)
+        pthread_cond_wait(&context->done, &context->lock);
+    pthread_mutex_unlock(&context->lock);
+}
+
+static void free_node(SetContext *context, Tree node)
+{
+    if (context->delete_data)
+        context->delete_data(node->data);
+    free(node);
+}
+
+// Remove the last node of tree (height height) into *last, return the rest
+static Tree split_last(Tree tree, int height, Tree *last, int *hrest)
+{
+    int balance = node_balance(tree);
+    int hleft = height - (balance < 0 ? 2 : 1);
+    int hright = height - (balance > 0 ? 2 : 1);
+
+    if (!tree->right) {
+        *last = tree;
+        *hrest = hleft;
+        return tree->left;
+    }
+    int h;
+    Tree rest = split_last(tree->right, hright, last, &h);
+    return join_with(tree->left, hleft, tree, rest, h, hrest);
+}
+
+// Join two trees without pivot
+static Tree join2_with(Tree left, int hl, Tree right, int hr, int *height)
+{
+    Tree last;
+
+    if (!left) {
+        if (right)
+            node_set_parent(right, NULL);
+        *height = hr;
+        return right;
+    }
+    left = split_last(left, hl, &last, &hl);
+    return join_with(left, hl, last, right, hr, height);
+}
+
+static Tree set_with(SetContext *context, SetOperation operation,
+                     Tree t1, int h1, Tree t2, int h2, int *height)
+{
+    if (!t1 || !t2) {
+        Tree kept = NULL;
+
+        *height = 0;
+        switch (operation) {
+        case SET_UNION:
+            kept = t1 ? t1 : t2;
+            *height = t1 ? h1 : h2;
+            break;
+        case SET_INTERSECTION:
+            tree_delete(t1 ? t1 : t2, context->delete_data);
+            break;
+        case SET_DIFFERENCE:
+            tree_delete(t2, context->delete_data);
+            kept = t1;
+            *height = h1;
+            break;
+        }
+        if (kept)
+            node_set_parent(kept, NULL);
+        return kept;
+    }
+
+    // Split the other tree around the root of t1 (of t2 for a difference)
+    bool difference = operation == SET_DIFFERENCE;
+    Tree pivot = difference ? t2 : t1;
+    Tree other = difference ? t1 : t2;
+    int hpivot = difference ? h2 : h1;
+    int balance = node_balance(pivot);
+    int hleft = hpivot - (balance < 0 ? 2 : 1);
+    int hright = hpivot - (balance > 0 ? 2 : 1);
+    Tree lo, hi, equal = NULL;
+    int hlo, hhi;
+
+    split_with(other, difference ? h1 : h2, pivot->data, context->compare,
+               &lo, &hlo, &hi, &hhi, &equal);
+
+    // The pieces of t1 stay first
+    Tree left = pivot->left, right = pivot->right;
+    SetTask first = { .context = context, .operation = operation,
+                      .t1 = left, .t2 = lo, .h1 = hleft, .h2 = hlo };
+    SetTask second = { .context = context, .operation = operation,
+                       .t1 = right, .t2 = hi, .h1 = hright, .h2 = hhi };
+    if (difference) {
+        first = (SetTask){ .context = context, .operation = operation,
+                           .t1 = lo, .t2 = left, .h1 = hlo, .h2 = hleft };
+        second = (SetTask){ .context = context, .operation = operation,
+                            .t1 = hi, .t2 = right, .h1 = hhi, .h2 = hright };
+    }
+    run_both(context, &first, &second,
+             MAX(h1, h2) >= TREE_SET_PARALLEL_HEIGHT);
+
+    bool keep = operation == SET_UNION ||
+                (operation == SET_INTERSECTION && equal);
+    if (equal)
+        free_node(context, equal);
+    if (keep)
+        return join_with(first.result, first.height, pivot,
+                         second.result, second.height, height);
+    free_node(context, pivot);
+    return join2_with(first.result, first.height,
+                      second.result, second.height, height);
+}
+
+static Tree set_operation(SetOperation operation, Tree t1, Tree t2,
+                          int (*compare)(const void *, const void *),
+                          void (*delete_data)(void *))
+{
+    SetContext context = { .compare = compare, .delete_data = delete_data };
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int height;
+    Tree result;
+
+    pthread_mutex_init(&context.lock, NULL);
+    pthread_cond_init(&context.work, NULL);
+    pthread_cond_init(&context.done, NULL);
+    if (processors > 1) {
+        context.threads = malloc((processors - 1) * sizeof(pthread_t));
+        if (context.threads)
+            context.max_workers = (int)processors - 1;
+    }
+
+    result = set_with(&context, operation, t1, height_of(t1),
+                      t2, height_of(t2), &height);
+
+    pthread_mutex_lock(&context.lock);
+    context.stop = true;
+    pthread_cond_broadcast(&context.work);
+    pthread_mutex_unlock(&context.lock);
+    for (int i = 0; i < context.workers; i++)
+        pthread_join(context.threads[i], NULL);
+    free(context.threads);
+    pthread_cond_destroy(&context.done);
+    pthread_cond_destroy(&context.work);
+    pthread_mutex_destroy(&context.lock);
+    return result;
+}
+
+Tree tree_union(Tree t1, Tree t2,
+                int (*compare)(const void *, const void *),
+                void (*delete_data)(void *))
+{
+    return set_operation(SET_UNION, t1, t2, compare, delete_data);
+}
+
+Tree tree_intersection(Tree t1, Tree t2,
+                       int (*compare)(const void *, const void *),
+                       void (*delete_data)(void *))
+{
+    return set_operation(SET_INTERSECTION, t1, t2, compare, delete_data);
+}
+
+Tree tree_difference(Tree t1, Tree t2,
+                     int (*compare)(const void *, const void *),
+                     void (*delete_data)(void *))
+{
+    return set_operation(SET_DIFFERENCE, t1, t2, compare, delete_data);
+}
@@ -0,0 +1,94 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "tree-rbt.hpp"
+
+// Counts the live objects and the copies made by the map
+struct Tracked {
+    static int alive;
+    static int copies;
+    int value;
+
+    explicit Tracked(int v) : value(v) { alive++; }
+    Tracked(const Tracked &other) : value(other.value) { alive++; copies++; }
+    Tracked(Tracked &&other) noexcept : value(other.value) { alive++; }
+    ~Tracked() { alive--; }
+};
+
+int Tracked::alive = 0;
+int Tracked::copies = 0;
+
+// iterator converts to const_iterator, which never drops its constness
+using IntMap = rbt::map<int, int>;
+static_assert(std::is_convertible_v<IntMap::iterator, IntMap::const_iterator>);
+static_assert(!std::is_convertible_v<IntMap::const_iterator, IntMap::iterator>);
+static_assert(!std::is_constructible_v<IntMap::iterator, IntMap::const_iterator>);
+
+void testMapMoveOnly() {
+    rbt::map<int, std::unique_ptr<int>> map;
+
+    printf("\n===== Test rbt::map avec valeurs non copiables =====\n");
+    for (int i = 0; i < 1000; i++) {
+        int k = (i * 7) % 1000;
+        assert(map.try_emplace(k, std::make_unique<int>(k * 2)).second);
+    }
+    assert(!map.try_emplace(3, std::make_unique<int>(0)).second);
+    assert(*map.at(3) == 6);
+    assert(map.size() == 1000);
+    assert(tree_height(map.tree()) <= 2 * std::log2(1001.0));
+
+    // Erasing while iterating keeps the iteration in order
+    int previous = -1;
+    for (auto it = map.begin(); it != map.end();) {
+        assert(it->first > previous);
+        previous = it->first;
+        it = it->first % 2 ? map.erase(it) : std::next(it);
+    }
+    assert(map.size() == 500);
+    assert(map.erase(2) == 1 && map.erase(2) == 0);
+    assert(!map.contains(2) && map.contains(4));
+
+    rbt::map<int, std::unique_ptr<int>> moved = std::move(map);
+    assert(map.empty() && moved.size() == 499);
+    printf("OK\n");
+}
+
+void testMapInPlace() {
+    printf("\n===== Test rbt::map construction en place =====\n");
+    {
+        rbt::map<std::string, Tracked> map;
+
+        for (int i = 0; i < 100; i++)
+            map.try_emplace("key" + std::to_string(i), i);
+        map.emplace(std::piecewise_construct, std::forward_as_tuple("key5"),
+                    std::forward_as_tuple(-1));
+        assert(map.at("key5").value == 5);
+        assert(Tracked::copies == 0);
+        assert(Tracked::alive == 100);
+        map.erase("key7");
+        assert(Tracked::alive == 99);
+    }
+    // The destructor of the map destroys every value
+    assert(Tracked::alive == 0);
+
+    rbt::map<std::string, std::vector<int>, std::greater<std::string>> map;
+    map["b"].push_back(1);
+    map["a"].push_back(2);
+    map["b"].push_back(3);
+    assert(map.begin()->first == "b" && map.begin()->second.size() == 2);
+    printf("OK\n");
+}
+
+/// ------------------ MAIN ------------------
+
+int main() {
+    testMapMoveOnly();      // rbt::map with std::unique_ptr values
+    testMapInPlace();       // rbt::map without copies
+
+    printf("\nTous les tests sont terminés avec succès.\n");
+    return EXIT_SUCCESS;
+}
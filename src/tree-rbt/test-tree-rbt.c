@@ -2,7 +2,17 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "tree-rbt.h"
+#include "tree-rbt-compact.h"
+#include "tree-rbt-handle.h"
+#include "tree-rbt-sync.h"
+#include "tree-rbt-rcu.h"
+#include "tree-rbt-shard.h"
+#include "tree-rbt-combining.h"
+#include "tree-rbt-typed.h"
 #include <stddef.h>
 
 void monPrintF (void * a, void * b){
@@ -52,7 +62,7 @@ void printIntWithColor(void *data, void *extra_data) {
     Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
     int value = *(int*)data;
     // Print "RED" or "BLACK" based on the color enum
-    printf("Valeur : %2d (Color: %s)\n", value, node->color == RED ? "RED" : "BLACK");
+    printf("Valeur : %2d (Color: %s)\n", value, tree_get_color(node) == RED ? "RED" : "BLACK");
 }
 
 // You can update the other print functions similarly if you want
@@ -60,7 +70,7 @@ void printStrWithColor(void *data, void *extra_data) {
     (void) extra_data;
     Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
     char *value = *(char **)data;
-    printf("Valeur : %-10s (Color: %s)\n", value, node->color == RED ? "RED" : "BLACK");
+    printf("Valeur : %-10s (Color: %s)\n", value, tree_get_color(node) == RED ? "RED" : "BLACK");
 }
 
 int cmpInt(const void *a, const void *b) {
@@ -83,7 +93,7 @@ void printEntry(void *data, void *extra_data) {
 
     // Access the data and balance
     Entry *e = (Entry *)data;
-    printf("{%-7s : %-18s} (COLOR: %s)\n", e->mot, e->definition, node->color == RED ? "RED" : "BLACK");
+    printf("{%-7s : %-18s} (COLOR: %s)\n", e->mot, e->definition, tree_get_color(node) == RED ? "RED" : "BLACK");
 }
 
 
@@ -182,6 +192,1214 @@ void testAVLEntry(void) {
 }
 
 
+/// ------------------ RBT INVARIANTS ------------------
+
+// Check parent links and the red-black rules, return the black height
+int checkRBT(Tree tree, Tree parent) {
+    if (!tree)
+        return 1;
+    assert(tree_get_parent(tree) == parent);
+    if (!parent)
+        assert(tree_get_color(tree) == BLACK);
+    if (tree_get_color(tree) == RED) {
+        assert(tree_get_color(tree->left) == BLACK);
+        assert(tree_get_color(tree->right) == BLACK);
+    }
+    int bl = checkRBT(tree->left, tree);
+    int br = checkRBT(tree->right, tree);
+    assert(bl == br);
+#if TREE_ORDER_STATISTICS
+    assert(tree->count == 1 + tree_size(tree->left) + tree_size(tree->right));
+#endif
+    return bl + (tree_get_color(tree) == BLACK);
+}
+
+void testRBTInvariants(void) {
+    Tree root = NULL;
+    int n = 2000;
+
+    printf("\n===== Test RBT invariants =====\n");
+    srand(42);
+    for (int i = 0; i < n; i++) {
+        int v = rand() % 500;
+        assert(tree_insert_sorted(&root, &v, sizeof(int), cmpInt));
+        checkRBT(root, NULL);
+    }
+    assert(tree_size(root) == (size_t)n);
+    for (int i = 0; i < n; i++) {
+        int v = rand() % 500;
+        bool found = tree_search(root, &v, cmpInt) != NULL;
+        assert(tree_remove_sorted(&root, &v, cmpInt) == found);
+        checkRBT(root, NULL);
+    }
+    printf("OK\n");
+
+    tree_delete(root, NULL);
+}
+
+void testRBTSlab(void) {
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+    Tree root = NULL;
+    int n = 1000;
+
+    printf("\n===== Test RBT avec slab =====\n");
+    assert(slab);
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n;
+        assert(tree_insert_sorted_slab(&root, slab, &v, sizeof(int), cmpInt));
+    }
+    checkRBT(root, NULL);
+
+    // A removed node is recycled by the next insertion
+    int key = 500;
+    int *data = tree_search(root, &key, cmpInt);
+    Tree node = (Tree)((char *)data - offsetof(struct _TreeNode, data));
+    assert(tree_remove_sorted_slab(&root, slab, &key, cmpInt));
+    key = n;
+    assert(tree_insert_sorted_slab(&root, slab, &key, sizeof(int), cmpInt));
+    assert(tree_search(root, &key, cmpInt) == node->data);
+    checkRBT(root, NULL);
+
+    // Payloads larger than the slab size are refused
+    double big = 1.0;
+    assert(!tree_insert_sorted_slab(&root, slab, &big, sizeof(big), cmpInt));
+    assert(tree_size(root) == (size_t)n);
+
+    int array[] = { 5, 3, 9, 1, 7 };
+    assert(tree_sort(array, 5, sizeof(int), cmpInt));
+    assert(array[0] == 1 && array[2] == 5 && array[4] == 9);
+    printf("OK\n");
+
+    tree_delete_slab(root, slab, NULL);
+    tree_slab_delete(slab);
+}
+
+// Check the in-order walk of a compact tree is sorted
+void checkSorted(void *data, void *extra_data) {
+    int *previous = extra_data;
+    assert(*previous <= *(int *)data);
+    *previous = *(int *)data;
+}
+
+// Links of node i in a compact snapshot: left, right, parent
+uint32_t *snapshotLinks(char *snapshot, uint32_t i) {
+    uint32_t *header = (uint32_t *)snapshot;
+    return (uint32_t *)(snapshot + 8 * sizeof(uint32_t) + i * header[6] +
+                        header[5]);
+}
+
+void testRBTCompact(void) {
+    CompactTree tree = compact_tree_new(sizeof(int));
+    size_t n = 0;
+
+    printf("\n===== Test RBT compact =====\n");
+    srand(7);
+    for (int i = 0; i < 3000; i++) {
+        int v = rand() % 1000;
+        if (rand() % 3) {
+            assert(compact_tree_insert_sorted(&tree, &v, cmpInt));
+            n++;
+        } else {
+            bool found = compact_tree_search(tree, &v, cmpInt) != NULL;
+            assert(compact_tree_remove_sorted(&tree, &v, cmpInt) == found);
+            n -= found;
+        }
+    }
+    int previous = -1;
+    compact_tree_in_order(tree, checkSorted, &previous);
+    assert(compact_tree_size(tree) == n);
+    assert(compact_tree_height(tree) <= 2 * 11); // n < 2048
+
+    // A snapshot is a plain copy of the bytes
+    size_t bytes = compact_tree_bytes(tree);
+    char *snapshot = malloc(bytes);
+    memcpy(snapshot, tree, bytes);
+    CompactTree copy = compact_tree_load(snapshot, bytes);
+    assert(copy && compact_tree_size(copy) == n);
+    for (int v = 0; v < 1000; v++)
+        assert((compact_tree_search(tree, &v, cmpInt) != NULL) ==
+               (compact_tree_search(copy, &v, cmpInt) != NULL));
+    int v = 1000;
+    assert(compact_tree_insert_sorted(&copy, &v, cmpInt));
+    assert(compact_tree_search(copy, &v, cmpInt));
+    assert(!compact_tree_load(snapshot, 16));
+    snapshot[0] ^= 1;
+    assert(!compact_tree_load(snapshot, bytes));
+    snapshot[0] ^= 1;
+
+    // Corrupt layouts and links are rejected rather than followed. Header:
+    // magic, root, count, capacity, size, links, stride, reserved; links of
+    // a node: left, right, parent.
+    uint32_t *header = (uint32_t *)snapshot;
+    uint32_t root = header[1];
+    uint32_t *top = snapshotLinks(snapshot, root);
+    uint32_t *first = snapshotLinks(snapshot, 0);
+    uint32_t *below = snapshotLinks(snapshot, top[0] < header[2] ? top[0]
+                                                                 : top[1]);
+    struct { uint32_t *field; uint32_t value; } corruptions[] = {
+        { &header[6], header[6] + 4 },          // stride of another size
+        { &header[1], header[2] },              // root out of range
+        { &top[0], header[2] + 1 },             // child out of range
+        { &top[0], root },                      // root its own child
+        { &first[0], 0 },                       // node 0 its own child
+        { &top[2], 0 },                         // root with a parent
+        { &below[2], below[2] ^ 1u << 31 },     // other color
+    };
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]);
+         i++) {
+        uint32_t saved = *corruptions[i].field;
+        *corruptions[i].field = corruptions[i].value;
+        assert(!compact_tree_load(snapshot, bytes));
+        *corruptions[i].field = saved;
+    }
+    CompactTree again = compact_tree_load(snapshot, bytes);
+    assert(again && compact_tree_size(again) == n);
+    compact_tree_delete(again, NULL);
+    printf("OK\n");
+
+    free(snapshot);
+    compact_tree_delete(copy, NULL);
+    compact_tree_delete(tree, NULL);
+}
+
+// Typed trees on int64 keys and on struct keys ordered by (major, minor)
+DEFINE_RBT(rbt_i64, int64_t, (a > b) - (a < b))
+
+typedef struct {
+    int major;
+    int minor;
+} Version;
+
+DEFINE_RBT(rbt_version, Version,
+           a.major != b.major ? a.major - b.major : a.minor - b.minor)
+
+void testRBTTyped(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test RBT typé =====\n");
+    for (int64_t i = 0; i < n; i++)
+        assert(rbt_i64_insert(&tree, (i * 7) % n * 1000000007LL));
+    checkRBT(tree, NULL);
+    for (int64_t i = 0; i < n; i += 2)
+        assert(rbt_i64_remove(&tree, i * 1000000007LL));
+    assert(!rbt_i64_remove(&tree, 0));
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)n / 2);
+    assert(*rbt_i64_search(tree, 1000000007LL) == 1000000007LL);
+    assert(!rbt_i64_search(tree, 1));
+    tree_delete(tree, NULL);
+
+    tree = NULL;
+    for (int major = 3; major >= 0; major--)
+        for (int minor = 0; minor < 10; minor++)
+            assert(rbt_version_insert(&tree, (Version){ major, minor }));
+    checkRBT(tree, NULL);
+    Version *v = rbt_version_search(tree, (Version){ 2, 5 });
+    assert(v && v->major == 2 && v->minor == 5);
+    assert(rbt_version_remove(&tree, (Version){ 2, 5 }));
+    assert(!rbt_version_search(tree, (Version){ 2, 5 }));
+    assert(tree_size(tree) == 39);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testRBTIterate(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test RBT parcours par itérateur =====\n");
+    assert(!tree_first(tree) && !tree_last(tree));
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+
+    int expected = 0;
+    for (Tree node = tree_first(tree); node; node = tree_next(node))
+        assert(*(int *)tree_get_data(node) == expected++);
+    assert(expected == n);
+    for (Tree node = tree_last(tree); node; node = tree_prev(node))
+        assert(*(int *)tree_get_data(node) == --expected);
+    assert(expected == 0);
+
+    // Stop after k items
+    int k = 0;
+    for (Tree node = tree_first(tree); node && k < 10; node = tree_next(node))
+        k++;
+    assert(k == 10);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+// Sum the data of a range
+void sumInt(void *data, void *extra_data) {
+    *(long *)extra_data += *(int *)data;
+}
+
+void testRBTRange(void) {
+    Tree tree = NULL;
+    int n = 500;
+
+    printf("\n===== Test RBT recherches ordonnées =====\n");
+    // Even values 0, 2, ..., 2n - 2
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n * 2;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+    for (int v = -1; v <= 2 * n; v++) {
+        int even = v % 2 == 0;
+        Tree lower = tree_lower_bound(tree, &v, cmpInt);
+        Tree upper = tree_upper_bound(tree, &v, cmpInt);
+        Tree floor = tree_floor(tree, &v, cmpInt);
+        int next = even ? v : v + 1;
+        int previous = v >= 2 * n - 2 ? 2 * n - 2 : even ? v : v - 1;
+
+        assert(tree_ceil(tree, &v, cmpInt) == lower);
+        if (next < 2 * n)
+            assert(lower && *(int *)tree_get_data(lower) == next);
+        else
+            assert(!lower);
+        if (v + 1 < 2 * n - 1)
+            assert(upper && *(int *)tree_get_data(upper) == (v + 2) / 2 * 2);
+        else
+            assert(!upper);
+        if (previous >= 0)
+            assert(floor && *(int *)tree_get_data(floor) == previous);
+        else
+            assert(!floor);
+    }
+
+    // [10, 21) holds 10, 12, ..., 20
+    int lo = 10, hi = 21;
+    long sum = 0;
+    assert(tree_range(tree, &lo, &hi, cmpInt, sumInt, &sum) == 6);
+    assert(sum == 90);
+    assert(tree_range(tree, &hi, &lo, cmpInt, sumInt, &sum) == 0);
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testRBTOrder(void) {
+    Tree tree = NULL;
+    int n = 1000;
+
+    printf("\n===== Test RBT rang et sélection =====\n");
+    // Even values 0, 2, ..., 2n - 2, then remove the multiples of 4
+    for (int i = 0; i < n; i++) {
+        int v = (i * 7) % n * 2;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+    }
+    for (int v = 0; v < 2 * n; v += 4)
+        assert(tree_remove_sorted(&tree, &v, cmpInt));
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)n / 2);
+
+    // The remaining values are 2, 6, 10, ...: rank k holds 4k + 2
+    for (size_t k = 0; k < (size_t)n / 2; k++) {
+        Tree node = tree_select(tree, k);
+        int v = 4 * (int)k + 2;
+        assert(node && *(int *)tree_get_data(node) == v);
+        assert(tree_rank(tree, &v, cmpInt) == k);
+        v++;
+        assert(tree_rank(tree, &v, cmpInt) == k + 1);
+    }
+    assert(!tree_select(tree, n / 2));
+    tree_delete(tree, NULL);
+
+    // Counts follow a tree built by hand, from the top
+    int i = 1, j = 2, k = 3;
+    Tree root = tree_create(&k, sizeof(int));
+    tree_set_left(root, tree_create(&i, sizeof(int)));
+    tree_set_right(tree_get_left(root), tree_create(&j, sizeof(int)));
+    assert(tree_size(root) == 3);
+    assert(*(int *)tree_get_data(tree_select(root, 1)) == 2);
+    printf("OK\n");
+
+    tree_delete(root, NULL);
+}
+
+void testRBTFromSorted(void) {
+    int n = 5000;
+    int *array = malloc(n * sizeof(int));
+
+    printf("\n===== Test RBT construit depuis un tableau trié =====\n");
+    for (int i = 0; i < n; i++)
+        array[i] = 2 * i;
+    assert(!tree_from_sorted(array, 0, sizeof(int)));
+    // Every shape of small tree, then a large one
+    for (int length = 1; length <= n;
+         length = length < 64 ? length + 1 : length * 8) {
+        Tree tree = tree_from_sorted(array, length, sizeof(int));
+        int height = 0;
+
+        while (length >> height)
+            height++;
+        checkRBT(tree, NULL);
+        assert(tree_size(tree) == (size_t)length);
+        assert(tree_height(tree) == (size_t)height);
+        int expected = 0;
+        for (Tree node = tree_first(tree); node; node = tree_next(node)) {
+            assert(*(int *)tree_get_data(node) == expected);
+            expected += 2;
+        }
+
+        // The tree takes insertions and removals as usual
+        int v = 3;
+        assert(tree_insert_sorted(&tree, &v, sizeof(int), cmpInt));
+        v = 0;
+        assert(tree_remove_sorted(&tree, &v, cmpInt));
+        checkRBT(tree, NULL);
+        tree_delete(tree, NULL);
+    }
+    printf("OK\n");
+
+    free(array);
+}
+
+void testRBTBatch(void) {
+    Tree tree = NULL;
+    int batch[3000];
+
+    printf("\n===== Test RBT insertion par lots =====\n");
+    srand(11);
+    for (int i = 0; i < 3000; i++)
+        batch[i] = rand() % 10000;
+    // Empty tree: built from the sorted batch
+    assert(tree_insert_batch(&tree, batch, 3000, sizeof(int), cmpInt) ==
+           TREE_BATCH_REBUILD);
+    checkRBT(tree, NULL);
+    // Small batches: inserted from the previous insertion point
+    for (int round = 0; round < 10; round++) {
+        int *small = batch + round * 30;
+        for (int i = 0; i < 30; i++)
+            small[i] = rand() % 10000;
+        assert(tree_insert_batch(&tree, small, 30, sizeof(int), cmpInt) ==
+               TREE_BATCH_FINGER);
+        checkRBT(tree, NULL);
+    }
+    assert(tree_size(tree) == 3300);
+    // Large batch: merged with the tree
+    assert(tree_insert_batch(&tree, batch, 1000, sizeof(int), cmpInt) ==
+           TREE_BATCH_REBUILD);
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == 4300);
+    int previous = -1;
+    tree_in_order(tree, checkSorted, &previous);
+    for (int i = 0; i < 1000; i++)
+        assert(tree_search(tree, &batch[i], cmpInt));
+    printf("OK\n");
+
+    tree_delete(tree, NULL);
+}
+
+void testRBTJoinSplit(void) {
+    int n = 2000;
+    int *array = malloc(n * sizeof(int));
+
+    printf("\n===== Test RBT jointure et découpage =====\n");
+    for (int i = 0; i < n; i++)
+        array[i] = 2 * i;
+    srand(5);
+    for (int round = 0; round < 50; round++) {
+        Tree tree = NULL;
+        Tree lo, hi;
+        int length = rand() % n;
+        int key = rand() % (2 * n + 2) - 1;
+
+        // Trees built both ways, to vary the shapes
+        if (round % 2)
+            tree = tree_from_sorted(array, length, sizeof(int));
+        else
+            for (int i = 0; i < length; i++)
+                assert(tree_insert_sorted(&tree, &array[(i * 7) % length],
+                                          sizeof(int), cmpInt));
+        tree_split(tree, &key, cmpInt, &lo, &hi);
+        checkRBT(lo, NULL);
+        checkRBT(hi, NULL);
+        assert(tree_size(lo) + tree_size(hi) == (size_t)length);
+        assert(!lo || *(int *)tree_get_data(tree_last(lo)) < key);
+        assert(!hi || *(int *)tree_get_data(tree_first(hi)) >= key);
+
+        // Odd keys are absent: join back with a pivot, or without
+        if (key % 2) {
+            tree = tree_join(lo, tree_create(&key, sizeof(int)), hi);
+            assert(tree_size(tree) == (size_t)length + 1);
+        } else {
+            tree = tree_concat(lo, hi);
+            assert(tree_size(tree) == (size_t)length);
+        }
+        checkRBT(tree, NULL);
+        int previous = -2;
+        tree_in_order(tree, checkSorted, &previous);
+        tree_delete(tree, NULL);
+    }
+    printf("OK\n");
+
+    free(array);
+}
+
+// Tree of the keys i < n with member[i] set, and their number in *length
+Tree subsetTree(const bool *member, int n, int *keys, size_t *length) {
+    *length = 0;
+    for (int i = 0; i < n; i++)
+        if (member[i])
+            keys[(*length)++] = i;
+    return tree_from_sorted(keys, *length, sizeof(int));
+}
+
+void testRBTSetOps(void) {
+    int sizes[] = {0, 1, 50, 3000, 100000};
+    int n = 100000;
+    bool *in1 = malloc(n * sizeof(bool));
+    bool *in2 = malloc(n * sizeof(bool));
+    int *keys = malloc(n * sizeof(int));
+
+    printf("\n===== Test RBT union, intersection et différence =====\n");
+    srand(6);
+    for (int round = 0; round < 25; round++) {
+        int n1 = sizes[round % 5], n2 = sizes[round / 5];
+        size_t l1, l2, expected[3] = {0, 0, 0};
+        Tree result[3];
+
+        for (int i = 0; i < n; i++) {
+            in1[i] = i < n1 && rand() % 2;
+            in2[i] = i < n2 && rand() % 3 == 0;
+            expected[0] += in1[i] || in2[i];
+            expected[1] += in1[i] && in2[i];
+            expected[2] += in1[i] && !in2[i];
+        }
+        for (int op = 0; op < 3; op++) {
+            Tree t1 = subsetTree(in1, n, keys, &l1);
+            Tree t2 = subsetTree(in2, n, keys, &l2);
+
+            if (op == 0)
+                result[op] = tree_union(t1, t2, cmpInt, NULL);
+            else if (op == 1)
+                result[op] = tree_intersection(t1, t2, cmpInt, NULL);
+            else
+                result[op] = tree_difference(t1, t2, cmpInt, NULL);
+            checkRBT(result[op], NULL);
+            assert(tree_size(result[op]) == expected[op]);
+            int previous = -1;
+            tree_in_order(result[op], checkSorted, &previous);
+        }
+        for (int i = 0; i < n; i++) {
+            assert((tree_search(result[0], &i, cmpInt) != NULL) ==
+                   (in1[i] || in2[i]));
+            assert((tree_search(result[1], &i, cmpInt) != NULL) ==
+                   (in1[i] && in2[i]));
+            assert((tree_search(result[2], &i, cmpInt) != NULL) ==
+                   (in1[i] && !in2[i]));
+        }
+        for (int op = 0; op < 3; op++)
+            tree_delete(result[op], NULL);
+    }
+
+    // Results that keep a subtree of an operand as it is, here the red
+    // right child 7 of {5, 7} built by insertion: the root must be black
+    // for the next insertion
+    int five = 5, six = 6, seven = 7;
+    Tree kept[2], t[4] = {NULL, NULL, NULL, NULL};
+    for (int i = 0; i < 4; i++) {
+        assert(tree_insert_sorted(&t[i], &five, sizeof(int), cmpInt));
+        if (i != 1)
+            assert(tree_insert_sorted(&t[i], &seven, sizeof(int), cmpInt));
+    }
+    kept[0] = tree_difference(t[0], t[1], cmpInt, NULL);
+    kept[1] = tree_intersection(t[2], t[3], cmpInt, NULL);
+    for (int i = 0; i < 2; i++) {
+        checkRBT(kept[i], NULL);
+        assert(tree_insert_sorted(&kept[i], &six, sizeof(int), cmpInt));
+        checkRBT(kept[i], NULL);
+        assert(tree_size(kept[i]) == (size_t)(i ? 3 : 2));
+        tree_delete(kept[i], NULL);
+    }
+    printf("OK\n");
+
+    free(keys);
+    free(in2);
+    free(in1);
+}
+
+int comparisons = 0;
+
+int cmpIntCounted(const void *a, const void *b) {
+    comparisons++;
+    return cmpInt(a, b);
+}
+
+void testRBTHint(void) {
+    int n = 20000;
+    Tree tree = NULL;
+    Tree rightmost = NULL;
+    Tree node = NULL;
+
+    printf("\n===== Test RBT insertion avec indice =====\n");
+    // Increasing keys with a few late ones: appends cost one comparison
+    srand(7);
+    for (int i = 0; i < n; i++) {
+        int key = i % 10 == 9 ? i - rand() % 50 : i;
+        comparisons = 0;
+        node = tree_insert_rightmost(&tree, &rightmost, &key, sizeof(int),
+                                     cmpIntCounted);
+        assert(node && *(int *)tree_get_data(node) == key);
+        assert(rightmost == tree_last(tree));
+        assert(i % 10 == 9 || comparisons <= 1);
+    }
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)n);
+    int previous = -100;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete(tree, NULL);
+
+    // Decreasing keys, each one hinted by the previous node
+    tree = NULL;
+    node = NULL;
+    comparisons = 0;
+    for (int i = n; i > 0; i--)
+        node = tree_insert_hint(&tree, node, &i, sizeof(int), cmpIntCounted);
+    assert(comparisons <= 3 * n);
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)n);
+    assert(*(int *)tree_get_data(tree_first(tree)) == 1);
+
+    // Any node is a valid hint, even far from the data
+    for (int i = 0; i < n; i++) {
+        int key = rand() % (2 * n);
+        Tree hint = tree_select(tree, rand() % tree_size(tree));
+        node = tree_insert_hint(&tree, hint, &key, sizeof(int), cmpInt);
+        assert(*(int *)tree_get_data(node) == key);
+    }
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)2 * n);
+    previous = 0;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    int key;
+    int value;
+} Pair;
+
+int cmpPair(const void *a, const void *b) {
+    return cmpInt(&((const Pair *)a)->key, &((const Pair *)b)->key);
+}
+
+void testRBTUnique(void) {
+    int n = 1000;
+    int *counts = calloc(n, sizeof(int));
+    int *values = malloc(n * sizeof(int));
+    Tree set = NULL, map = NULL, multiset = NULL;
+    size_t distinct = 0;
+    bool inserted;
+    int height = 0;
+
+    printf("\n===== Test RBT insertion unique, mise à jour et multi-ensemble =====\n");
+    srand(8);
+    for (int i = 0; i < 20 * n; i++) {
+        int key = rand() % n;
+        Pair pair = {key, i};
+
+        // One descent each: no more comparisons than a search
+        comparisons = 0;
+        Tree node = tree_insert_unique(&set, &key, sizeof(int), cmpIntCounted,
+                                       &inserted);
+        assert(comparisons <= height);
+        assert(*(int *)tree_get_data(node) == key);
+        assert(inserted == (counts[key] == 0));
+        if (inserted) {
+            distinct++;
+            height = tree_height(set);
+        }
+
+        node = tree_upsert(&map, &pair, sizeof(Pair), cmpPair, &inserted);
+        assert(inserted == (counts[key] == 0));
+        assert(((Pair *)tree_get_data(node))->value == i);
+        values[key] = i;
+
+        node = tree_multiset_add(&multiset, &key, sizeof(int), cmpInt);
+        assert(*(int *)tree_multiset_get_data(node) == key);
+        assert(tree_multiset_get_count(node) == (size_t)++counts[key]);
+    }
+    assert(tree_size(set) == distinct && tree_size(map) == distinct);
+    assert(tree_size(multiset) == distinct);
+    checkRBT(set, NULL);
+    checkRBT(map, NULL);
+    for (Tree node = tree_first(map); node; node = tree_next(node)) {
+        Pair *pair = tree_get_data(node);
+        assert(pair->value == values[pair->key]);
+    }
+
+    // Remove occurrences one at a time: the node goes with the last one
+    for (int i = 0; i < 10 * n; i++) {
+        int key = rand() % n;
+        assert(tree_multiset_remove(&multiset, &key, cmpInt) ==
+               (counts[key] > 0));
+        if (counts[key] > 0 && --counts[key] == 0)
+            distinct--;
+        assert(tree_multiset_count(multiset, &key, cmpInt) ==
+               (size_t)counts[key]);
+    }
+    assert(tree_size(multiset) == distinct);
+    checkRBT(multiset, NULL);
+    int previous = -1;
+    for (Tree node = tree_first(multiset); node; node = tree_next(node)) {
+        int key = *(int *)tree_multiset_get_data(node);
+        assert(key > previous && counts[key] > 0);
+        assert(tree_multiset_get_count(node) == (size_t)counts[key]);
+        previous = key;
+    }
+    tree_delete(multiset, NULL);
+    tree_delete(map, NULL);
+    tree_delete(set, NULL);
+    printf("OK\n");
+
+    free(values);
+    free(counts);
+}
+
+void testRBTRemoveNode(void) {
+    int n = 5000;
+    Tree tree = NULL;
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+
+    printf("\n===== Test RBT suppression par noeud =====\n");
+    for (int i = 0; i < n; i++) {
+        int key = (i * 7) % n;
+        assert(tree_insert_sorted_slab(&tree, slab, &key, sizeof(int),
+                                       cmpInt));
+    }
+
+    // Evict while walking from the minimum, without any comparison
+    comparisons = 0;
+    for (Tree node = tree_first(tree); node;) {
+        int key = *(int *)tree_get_data(node);
+        if (key % 3)
+            node = tree_remove_node_slab(&tree, slab, node);
+        else
+            node = tree_next(node);
+        assert(!node || *(int *)tree_get_data(node) == key + 1);
+    }
+    assert(comparisons == 0);
+    checkRBT(tree, NULL);
+    assert(tree_size(tree) == (size_t)(n + 2) / 3);
+    int previous = -1;
+    tree_in_order(tree, checkSorted, &previous);
+    tree_delete_slab(tree, slab, NULL);
+    tree_slab_delete(slab);
+
+    // Remove every node, from the maximum down
+    tree = NULL;
+    for (int i = 0; i < n; i++)
+        assert(tree_insert_sorted(&tree, &i, sizeof(int), cmpInt));
+    for (int i = n - 1; i >= 0; i--) {
+        Tree last = tree_last(tree);
+        assert(*(int *)tree_get_data(last) == i);
+        assert(tree_remove_node(&tree, last) == NULL);
+        if (i % 500 == 0)
+            checkRBT(tree, NULL);
+    }
+    assert(tree == NULL);
+    printf("OK\n");
+}
+
+void testRBTHandle(void) {
+    int n = 3000;
+    TreeSlab *slab = tree_slab_new(sizeof(int));
+
+    printf("\n===== Test RBT avec poignée =====\n");
+    srand(9);
+    for (int round = 0; round < 2; round++) {
+        TreeHandle handle = tree_handle_new(sizeof(int), cmpInt,
+                                            round ? slab : NULL);
+        assert(tree_handle_size(handle) == 0);
+        assert(!tree_handle_first(handle) && !tree_handle_last(handle));
+
+        // Random insertions and removals, the cache checked against walks
+        for (int i = 0; i < 4 * n; i++) {
+            int key = rand() % n;
+            bool inserted;
+
+            if (rand() % 3)
+                assert(tree_handle_insert(handle, &key));
+            else if (rand() % 2)
+                tree_handle_remove(handle, &key);
+            else
+                assert(tree_handle_insert_unique(handle, &key, &inserted));
+            Tree root = tree_handle_root(handle);
+            assert(tree_handle_size(handle) == tree_size(root));
+            assert(tree_handle_first(handle) == tree_first(root));
+            assert(tree_handle_last(handle) == tree_last(root));
+        }
+        checkRBT(tree_handle_root(handle), NULL);
+        int key = *(int *)tree_get_data(tree_handle_last(handle));
+        assert(*(int *)tree_handle_search(handle, &key) == key);
+
+        // Pop the minimum until empty
+        int previous = -1;
+        while (tree_handle_size(handle) > 0) {
+            Tree first = tree_handle_first(handle);
+            assert(*(int *)tree_get_data(first) >= previous);
+            previous = *(int *)tree_get_data(first);
+            tree_handle_remove_node(handle, first);
+            assert(tree_handle_first(handle) ==
+                   tree_first(tree_handle_root(handle)));
+        }
+        assert(!tree_handle_root(handle) && !tree_handle_last(handle));
+        assert(tree_handle_insert(handle, &key));
+        tree_handle_delete(handle, NULL);
+    }
+
+    // Two trees on one slab: deleting one leaves the nodes of the other
+    TreeHandle one = tree_handle_new(sizeof(int), cmpInt, slab);
+    TreeHandle other = tree_handle_new(sizeof(int), cmpInt, slab);
+    for (int i = 0; i < n; i++) {
+        assert(tree_handle_insert(one, &i));
+        assert(tree_handle_insert(other, &i));
+    }
+    tree_handle_delete(one, NULL);
+    for (int i = 0; i < n; i++) {
+        int key = n + i; // on the nodes given back by one
+
+        assert(*(int *)tree_handle_search(other, &i) == i);
+        assert(tree_handle_insert(other, &key));
+    }
+    checkRBT(tree_handle_root(other), NULL);
+    assert(tree_handle_size(other) == 2 * (size_t)n);
+    tree_handle_delete(other, NULL);
+    tree_slab_delete(slab);
+    printf("OK\n");
+}
+
+void testRBTPriorityQueue(void) {
+    TreeHandle queue = tree_handle_new(sizeof(int), cmpInt, NULL);
+    int now = 0, key;
+
+    printf("\n===== Test RBT file de priorité =====\n");
+    assert(!tree_handle_peek_min(queue) && !tree_handle_pop_min(queue, &key));
+    // Timers: each expired one is rearmed later, the minimum never decreases
+    srand(10);
+    for (int i = 0; i < 1000; i++) {
+        key = rand() % 1000;
+        assert(tree_handle_insert(queue, &key));
+    }
+    for (int i = 0; i < 20000; i++) {
+        int peeked = *(int *)tree_handle_peek_min(queue);
+        assert(tree_handle_pop_min(queue, &key) && key == peeked);
+        assert(key >= now);
+        now = key;
+        key = now + 1 + rand() % 1000;
+        assert(tree_handle_insert(queue, &key));
+        assert(*(int *)tree_handle_peek_max(queue) >= key);
+    }
+    checkRBT(tree_handle_root(queue), NULL);
+    assert(tree_handle_size(queue) == 1000);
+
+    // Drain from the maximum
+    int previous = *(int *)tree_handle_peek_max(queue);
+    while (tree_handle_pop_max(queue, &key)) {
+        assert(key <= previous);
+        previous = key;
+    }
+    assert(tree_handle_size(queue) == 0 && !tree_handle_peek_max(queue));
+    tree_handle_delete(queue, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    SyncTree tree;
+    int n;
+    int id;
+} SyncJob;
+
+void *syncWriter(void *arg) {
+    SyncJob *job = arg;
+
+    // Batches of 100 insertions under one lock
+    for (int i = job->id; i < job->n; i += 200) {
+        TreeHandle handle = sync_tree_write_begin(job->tree);
+        for (int k = i; k < i + 200 && k < job->n; k += 2)
+            assert(tree_handle_insert(handle, &k));
+        sync_tree_write_end(job->tree);
+    }
+    // Then single removals of a quarter of the keys
+    for (int k = job->id; k < job->n; k += 4)
+        assert(sync_tree_remove(job->tree, &k));
+    return NULL;
+}
+
+void *syncReader(void *arg) {
+    SyncJob *job = arg;
+
+    // Short scans, in parallel with each other and between the writes
+    for (int i = 0; i < 2000; i++) {
+        int lo = (i * 97) % job->n, hi = lo + 100;
+        int previous = -1;
+        size_t count = sync_tree_range(job->tree, &lo, &hi, checkSorted,
+                                       &previous);
+        assert(count <= 100);
+
+        // A read section sees one consistent tree
+        TreeHandle handle = sync_tree_read_begin(job->tree);
+        assert(tree_handle_size(handle) ==
+               tree_size(tree_handle_root(handle)));
+        sync_tree_read_end(job->tree);
+    }
+    return NULL;
+}
+
+void *sortJob(void *arg) {
+    SyncJob *job = arg;
+    int *array = malloc(job->n * sizeof(int));
+
+    for (int i = 0; i < job->n; i++)
+        array[i] = (i * 7919 + job->id) % job->n;
+    assert(tree_sort(array, job->n, sizeof(int), cmpInt));
+    for (int i = 0; i < job->n; i++)
+        assert(array[i] == i);
+    free(array);
+    return NULL;
+}
+
+typedef struct {
+    SyncTree tree;
+    atomic_bool done;  // the writer got through
+    atomic_int starved; // readers that gave up waiting for it
+} WriterProgress;
+
+void *progressReader(void *arg) {
+    WriterProgress *progress = arg;
+
+    // Overlapping read sections: some reader always holds the lock
+    for (int i = 0; !atomic_load(&progress->done); i++) {
+        if (i == 100000) {
+            atomic_fetch_add(&progress->starved, 1);
+            break;
+        }
+        sync_tree_read_begin(progress->tree);
+        sched_yield();
+        sync_tree_read_end(progress->tree);
+    }
+    return NULL;
+}
+
+void *progressWriter(void *arg) {
+    WriterProgress *progress = arg;
+
+    for (int k = 0; k < 100; k++)
+        assert(sync_tree_insert(progress->tree, &k));
+    atomic_store(&progress->done, true);
+    return NULL;
+}
+
+void testRBTSync(void) {
+    int n = 20000;
+    SyncTree tree = sync_tree_new(sizeof(int), cmpInt);
+    pthread_t threads[4];
+    SyncJob jobs[4];
+
+    printf("\n===== Test RBT partagé entre threads =====\n");
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (SyncJob){tree, n, i % 2};
+        assert(pthread_create(&threads[i], NULL,
+                              i < 2 ? syncWriter : syncReader, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    assert(sync_tree_size(tree) == (size_t)n / 2);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(sync_tree_search(tree, &k, &found) == (k % 4 >= 2));
+        assert(k % 4 < 2 || found == k);
+    }
+    sync_tree_delete(tree, NULL);
+
+    // A writer among readers that keep the lock busy must get through
+    WriterProgress progress = { .tree = sync_tree_new(sizeof(int), cmpInt) };
+    atomic_init(&progress.done, false);
+    atomic_init(&progress.starved, 0);
+    for (int i = 0; i < 4; i++)
+        assert(pthread_create(&threads[i], NULL,
+                              i < 3 ? progressReader : progressWriter,
+                              &progress) == 0);
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    assert(atomic_load(&progress.starved) == 0);
+    assert(sync_tree_size(progress.tree) == 100);
+    sync_tree_delete(progress.tree, NULL);
+
+    // Concurrent sorts of distinct arrays
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (SyncJob){NULL, 1000 * (i + 1) + 1, i};
+        assert(pthread_create(&threads[i], NULL, sortJob, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    RcuTree tree;
+    int n;
+} RcuJob;
+
+void *rcuWriter(void *arg) {
+    RcuJob *job = arg;
+
+    // Every key in a scrambled order, then removal of a quarter of them
+    for (int i = 0; i < job->n; i++) {
+        int k = (i * 7919) % job->n;
+        assert(rcu_tree_insert(job->tree, &k));
+    }
+    for (int k = 0; k < job->n; k += 4)
+        assert(rcu_tree_remove(job->tree, &k));
+    return NULL;
+}
+
+void rcuCheckSorted(const void *data, void *extra_data) {
+    int *previous = extra_data;
+
+    assert(*(const int *)data > *previous);
+    *previous = *(const int *)data;
+}
+
+void *rcuReader(void *arg) {
+    RcuJob *job = arg;
+    RcuReader reader = rcu_tree_reader_new(job->tree);
+    char *seen = calloc(job->n, 1);
+
+    assert(reader);
+    for (int i = 0; i < 20000; i++) {
+        int k = (i * 97) % job->n, hi = k + 100, previous = -1;
+
+        rcu_tree_read_begin(reader);
+        const int *found = rcu_tree_search(job->tree, &k);
+        assert(!found || *found == k);
+        // Only the keys k % 4 == 0 go away
+        assert(found || !seen[k]);
+        seen[k] = found && k % 4 != 0;
+        assert(rcu_tree_range(job->tree, &k, &hi, rcuCheckSorted,
+                              &previous) <= 100);
+        // Every published version is a red-black tree
+        assert(i % 1000 || rcu_tree_black_height(job->tree) >= 0);
+        rcu_tree_read_end(reader);
+    }
+    rcu_tree_reader_delete(reader);
+    free(seen);
+    return NULL;
+}
+
+void testRBTRcu(void) {
+    int n = 20000;
+    RcuTree tree = rcu_tree_new(sizeof(int), cmpInt);
+    pthread_t threads[4];
+    RcuJob job = {tree, n};
+
+    printf("\n===== Test RBT lu sans verrou (RCU) =====\n");
+    for (int i = 0; i < 4; i++)
+        assert(pthread_create(&threads[i], NULL,
+                              i == 0 ? rcuWriter : rcuReader, &job) == 0);
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    RcuReader reader = rcu_tree_reader_new(tree);
+    int previous = -1, height;
+
+    // No parent links to check: path copying shares the unchanged subtrees
+    // between versions, and the in-order walk of strictly increasing keys,
+    // as many as the size, shows that no node hangs under two parents
+    assert(rcu_tree_size(tree) == (size_t)(n - n / 4));
+    rcu_tree_read_begin(reader);
+    assert(rcu_tree_range(tree, NULL, NULL, rcuCheckSorted, &previous) ==
+           rcu_tree_size(tree));
+    height = rcu_tree_black_height(tree);
+    assert(height > 0 && (1UL << height) - 1 <= rcu_tree_size(tree));
+    for (int k = 0; k < n; k++) {
+        const int *found = rcu_tree_search(tree, &k);
+        assert(k % 4 == 0 ? !found : found && *found == k);
+    }
+    rcu_tree_read_end(reader);
+    assert(!rcu_tree_remove(tree, &(int){0}));
+
+    // Removals down to one key, the tree checked on the way
+    for (int k = 1; k < n - 1; k++) {
+        if (k % 4 == 0)
+            continue;
+        assert(rcu_tree_remove(tree, &k));
+        if (k % 97 == 0 || k > n - 10) {
+            rcu_tree_read_begin(reader);
+            assert(rcu_tree_black_height(tree) >= 0);
+            rcu_tree_read_end(reader);
+        }
+    }
+    rcu_tree_read_begin(reader);
+    assert(rcu_tree_size(tree) == 1 && rcu_tree_black_height(tree) == 1);
+    rcu_tree_read_end(reader);
+    rcu_tree_reader_delete(reader);
+    rcu_tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    ShardTree tree;
+    int n;
+    int id;
+} ShardJob;
+
+void *shardWriter(void *arg) {
+    ShardJob *job = arg;
+
+    // Insertions of the keys k % 4 == id, then removal of half of them
+    for (int k = job->id; k < job->n; k += 4)
+        assert(shard_tree_insert(job->tree, &k));
+    for (int k = job->id; k < job->n; k += 8)
+        assert(shard_tree_remove(job->tree, &k));
+    return NULL;
+}
+
+void *shardRebuilder(void *arg) {
+    ShardJob *job = arg;
+
+    // Split points moved while the writers run
+    for (int i = 0; i < 20; i++) {
+        int points[3] = {i * 100, i * 200, i * 300};
+        assert(shard_tree_rebuild(job->tree, i % 2 ? NULL : points));
+    }
+    return NULL;
+}
+
+void testRBTShard(void) {
+    int n = 40000, points[3] = {10000, 20000, 30000};
+    ShardTree tree = shard_tree_new(sizeof(int), cmpInt, 4, points);
+    pthread_t threads[5];
+    ShardJob jobs[5];
+    int previous = -1, lo = 15000, hi = 25000;
+
+    printf("\n===== Test RBT réparti par intervalles de clés =====\n");
+    assert(shard_tree_count(tree) == 4);
+    for (int i = 0; i < 5; i++) {
+        jobs[i] = (ShardJob){tree, n, i};
+        assert(pthread_create(&threads[i], NULL,
+                              i < 4 ? shardWriter : shardRebuilder,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 5; i++)
+        pthread_join(threads[i], NULL);
+
+    // Keys k % 8 >= 4 are left, in order across the shards
+    assert(shard_tree_size(tree, 4) == (size_t)n / 2);
+    shard_tree_in_order(tree, checkSorted, &previous);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(shard_tree_search(tree, &k, &found) == (k % 8 >= 4));
+        assert(k % 8 < 4 || found == k);
+    }
+    previous = -1;
+    assert(shard_tree_range(tree, &lo, &hi, checkSorted, &previous) ==
+           (size_t)(hi - lo) / 2);
+
+    // Equal shards after a rebuild without split points
+    assert(shard_tree_rebuild(tree, NULL));
+    for (size_t i = 0; i < 4; i++)
+        assert(shard_tree_size(tree, i) == (size_t)n / 8);
+    assert(shard_tree_rebuild(tree, points));
+    assert(shard_tree_size(tree, 0) == (size_t)points[0] / 2);
+
+    // Points that move past the others: the payloads between the old and
+    // the new places change shards, none is lost or doubled
+    int crossing[3] = {2000, 36000, 38000}, sizes[4] = {1000, 17000, 1000,
+                                                        1000};
+    for (int round = 0; round < 2; round++) {
+        assert(shard_tree_rebuild(tree, round ? points : crossing));
+        for (size_t i = 0; i < 4; i++)
+            assert(shard_tree_size(tree, i) ==
+                   (round ? (size_t)n / 8 : (size_t)sizes[i]));
+        previous = -1;
+        shard_tree_in_order(tree, checkSorted, &previous);
+        for (int k = 4; k < n; k += 8)
+            assert(shard_tree_search(tree, &k, NULL));
+        assert(shard_tree_size(tree, 4) == (size_t)n / 2);
+    }
+    shard_tree_delete(tree, NULL);
+
+    // From a tree in a single shard, and back to it
+    tree = shard_tree_new(sizeof(int), cmpInt, 4, NULL);
+    assert(shard_tree_rebuild(tree, NULL) && shard_tree_size(tree, 0) == 0);
+    for (int k = 0; k < n; k++)
+        assert(shard_tree_insert(tree, &k));
+    assert(shard_tree_size(tree, 0) == (size_t)n);
+    assert(shard_tree_rebuild(tree, NULL));
+    for (size_t i = 0; i < 4; i++)
+        assert(shard_tree_size(tree, i) == (size_t)n / 4);
+    assert(shard_tree_search(tree, &(int){n / 4}, NULL));
+    assert(shard_tree_rebuild(tree, (int[3]){n, n, n}));
+    assert(shard_tree_size(tree, 0) == (size_t)n);
+    shard_tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
+typedef struct {
+    CombiningTree tree;
+    int n;
+    int id;
+} CombiningJob;
+
+void *combiningWorker(void *arg) {
+    CombiningJob *job = arg;
+    CombiningSlot slot = combining_tree_slot_new(job->tree);
+
+    // Insertions of the keys k % 4 == id, then removal of half of them
+    assert(slot);
+    for (int k = job->id; k < job->n; k += 4) {
+        int found = -1;
+        assert(combining_tree_insert(slot, &k));
+        assert(combining_tree_search(slot, &k, &found) && found == k);
+    }
+    for (int k = job->id; k < job->n; k += 8)
+        assert(combining_tree_remove(slot, &k));
+    combining_tree_slot_delete(slot);
+    return NULL;
+}
+
+void testRBTCombining(void) {
+    int n = 40000;
+    CombiningTree tree = combining_tree_new(sizeof(int), cmpInt);
+    pthread_t threads[4];
+    CombiningJob jobs[4];
+    CombiningSlot slot;
+
+    printf("\n===== Test RBT par combinaison des requêtes =====\n");
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = (CombiningJob){tree, n, i};
+        assert(pthread_create(&threads[i], NULL, combiningWorker,
+                              &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    // Keys k % 8 >= 4 are left; the slot of a finished thread is reused
+    assert(combining_tree_size(tree) == (size_t)n / 2);
+    slot = combining_tree_slot_new(tree);
+    assert(slot);
+    for (int k = 0; k < n; k++) {
+        int found = -1;
+        assert(combining_tree_search(slot, &k, &found) == (k % 8 >= 4));
+        assert(k % 8 < 4 || found == k);
+    }
+    assert(!combining_tree_remove(slot, &(int){0}));
+    assert(combining_tree_search(slot, &(int){4}, NULL));
+    combining_tree_slot_delete(slot);
+    assert(combining_tree_slot_new(tree) == slot);
+    combining_tree_delete(tree, NULL);
+    printf("OK\n");
+}
+
 /// ------------------ MAIN ------------------
 
 int main(void) {
@@ -189,6 +1407,26 @@ int main(void) {
     testAVLInt();           // AVL with integers
     testAVLStr();           // AVL with strings
     testAVLEntry();         // AVL with structs
+    testRBTInvariants();    // RBT colors and parents
+    testRBTSlab();          // RBT with nodes from a slab
+    testRBTCompact();       // RBT on 32-bit indices
+    testRBTTyped();         // RBT specialized for a key type
+    testRBTIterate();       // RBT walked with first/next and last/prev
+    testRBTRange();         // RBT bounds and range scans
+    testRBTOrder();         // RBT rank and select
+    testRBTFromSorted();    // RBT built from a sorted array
+    testRBTBatch();         // RBT batch insertion
+    testRBTJoinSplit();     // RBT join and split
+    testRBTSetOps();        // RBT union, intersection and difference
+    testRBTHint();          // RBT insertion from a hint
+    testRBTUnique();        // RBT insert-or-find, upsert and multiset
+    testRBTRemoveNode();    // RBT removal of a node already found
+    testRBTHandle();        // RBT behind a handle caching size, first and last
+    testRBTPriorityQueue(); // RBT peek and pop of the minimum and maximum
+    testRBTSync();          // RBT shared between threads, concurrent sorts
+    testRBTRcu();           // RBT read without locks, one writer
+    testRBTShard();         // RBT split into shards by key range
+    testRBTCombining();     // RBT shared by flat combining
 
     printf("\nTous les tests sont terminés avec succès.\n");
     return EXIT_SUCCESS;
@@ -0,0 +1,609 @@
+#include <string.h>
+#include <stdint.h>
+#include "tree-rbt-compact.h"
+#include "min-max.h"
+
+/*--------------------------------------------------------------------*/
+/* Layout: a node is its payload followed by three 32-bit links. The color
+   lives in the high bit of the parent link, which leaves 31 bits for
+   indices. */
+
+#define COMPACT_MAGIC 0x31435452u // "RTC1"
+#define INDEX_BITS 31
+#define NIL ((uint32_t)((1u << INDEX_BITS) - 1)) // also the node limit
+
+typedef enum { RED, BLACK } Color;
+
+typedef struct
+{
+  uint32_t left;
+  uint32_t right;
+  uint32_t parent; // color in the high bit
+} Links;
+
+struct _CompactTree
+{
+  uint32_t magic;    // identifies a snapshot
+  uint32_t root;
+  uint32_t count;    // nodes in use, stored at indices [0, count)
+  uint32_t capacity; // nodes allocated
+  uint32_t size;     // payload size
+  uint32_t links;    // offset of the links in a node
+  uint32_t stride;   // size of a node
+  uint32_t reserved;
+  char nodes[];
+};
+
+static inline char *node_data(CompactTree tree, uint32_t node)
+{
+  return tree->nodes + (size_t)node * tree->stride;
+}
+
+static inline Links *node_links(CompactTree tree, uint32_t node)
+{
+  return (Links *)(node_data(tree, node) + tree->links);
+}
+
+#define LEFT(node) (node_links(tree, node)->left)
+#define RIGHT(node) (node_links(tree, node)->right)
+
+static inline uint32_t node_parent(CompactTree tree, uint32_t node)
+{
+  return node_links(tree, node)->parent & NIL;
+}
+
+static inline void node_set_parent(CompactTree tree, uint32_t node, uint32_t parent)
+{
+  Links *links = node_links(tree, node);
+  links->parent = (links->parent & ~NIL) | parent;
+}
+
+// NIL leaves are BLACK
+static inline Color node_color(CompactTree tree, uint32_t node)
+{
+  if (node == NIL)
+    return BLACK;
+  return (Color)(node_links(tree, node)->parent >> INDEX_BITS);
+}
+
+static inline void node_set_color(CompactTree tree, uint32_t node, Color color)
+{
+  Links *links = node_links(tree, node);
+  links->parent = (links->parent & NIL) | (uint32_t)color << INDEX_BITS;
+}
+
+/*--------------------------------------------------------------------*/
+// Offset of the links and size of a node holding a payload of size bytes
+static void node_layout(uint32_t size, uint32_t *links, uint32_t *stride)
+{
+  uint32_t align = 4;
+
+  // Payloads keep the natural alignment of their size, up to 16
+  while (align < 16 && size % (2 * align) == 0)
+    align *= 2;
+
+  *links = (size + 3) / 4 * 4;
+  *stride = (*links + sizeof(Links) + align - 1) / align * align;
+}
+
+CompactTree compact_tree_new(size_t size)
+{
+  CompactTree tree;
+
+  if (size > UINT32_MAX / 2)
+    return NULL;
+
+  tree = malloc(sizeof(*tree));
+  if (tree)
+  {
+    tree->magic = COMPACT_MAGIC;
+    tree->root = NIL;
+    tree->count = 0;
+    tree->capacity = 0;
+    tree->size = size;
+    node_layout(size, &tree->links, &tree->stride);
+    tree->reserved = 0;
+  }
+
+  return tree;
+}
+
+void compact_tree_delete(CompactTree tree, void (*delete_data)(void *))
+{
+  uint32_t i;
+
+  if (tree)
+  {
+    // The array is dense: no walk needed
+    if (delete_data)
+      for (i = 0; i < tree->count; i++)
+        delete_data(node_data(tree, i));
+    free(tree);
+  }
+}
+
+static bool grow(CompactTree *ptree)
+{
+  CompactTree tree = *ptree;
+  uint32_t capacity;
+
+  if (tree->capacity == NIL)
+    return false;
+  capacity = tree->capacity ? MIN(2 * (uint64_t)tree->capacity, NIL) : 16;
+  tree = realloc(tree, sizeof(*tree) + (size_t)capacity * tree->stride);
+  if (!tree)
+    return false;
+  tree->capacity = capacity;
+  *ptree = tree;
+  return true;
+}
+
+size_t compact_tree_size(CompactTree tree)
+{
+  return tree ? tree->count : 0;
+}
+
+static size_t height(CompactTree tree, uint32_t node)
+{
+  if (node == NIL)
+    return 0;
+  return 1 + MAX(height(tree, LEFT(node)), height(tree, RIGHT(node)));
+}
+
+size_t compact_tree_height(CompactTree tree)
+{
+  return tree ? height(tree, tree->root) : 0;
+}
+
+size_t compact_tree_bytes(CompactTree tree)
+{
+  return tree ? sizeof(*tree) + (size_t)tree->count * tree->stride : 0;
+}
+
+/* A snapshot is checked before any use: the header must match its payload
+   size, every link must be NIL or an index below count, the links must
+   form one tree whose parent links agree with the child links, and the
+   colors must follow the red-black rules (no red child of a red node, the
+   same number of black nodes on every path). The order of the payloads is
+   not checked, there is no comparison function here: a misordered
+   snapshot gives wrong answers, but no access out of bounds. */
+static bool valid_links(CompactTree tree)
+{
+  uint32_t i, node, next, previous, visited = 0, *blacks;
+  bool valid = true;
+
+  if (tree->count == 0)
+    return tree->root == NIL;
+  if (tree->root >= tree->count || node_parent(tree, tree->root) != NIL)
+    return false;
+
+  // Each link agrees with the link back, in both directions
+  for (i = 0; i < tree->count; i++)
+  {
+    uint32_t left = LEFT(i), right = RIGHT(i), parent;
+
+    if ((left != NIL &&
+         (left >= tree->count || node_parent(tree, left) != i)) ||
+        (right != NIL &&
+         (right >= tree->count || node_parent(tree, right) != i)) ||
+        (left == right && left != NIL))
+      return false;
+    parent = node_parent(tree, i);
+    if (i != tree->root &&
+        (parent >= tree->count ||
+         (LEFT(parent) != i && RIGHT(parent) != i)))
+      return false;
+  }
+
+  /* Nodes below the root are then a tree: a second path to a node would
+     give it two parents. The walk counts them and checks the colors in
+     post-order, without recursion: the depth is unknown. */
+  blacks = malloc((size_t)tree->count * sizeof(*blacks));
+  if (!blacks)
+    return false;
+  for (node = tree->root, previous = NIL; valid && node != NIL;
+       previous = node, node = next)
+  {
+    uint32_t left = LEFT(node), right = RIGHT(node);
+    bool down = previous == node_parent(tree, node);
+
+    if (down && left != NIL)
+      next = left;
+    else if ((down || previous == left) && right != NIL)
+      next = right;
+    else
+    {
+      // Black nodes on the paths down from node, NIL leaves excluded
+      uint32_t bl = left == NIL ? 0 : blacks[left];
+      uint32_t br = right == NIL ? 0 : blacks[right];
+
+      valid = bl == br &&
+              (node_color(tree, node) == BLACK ||
+               (node_color(tree, left) == BLACK &&
+                node_color(tree, right) == BLACK));
+      blacks[node] = bl + (node_color(tree, node) == BLACK);
+      visited++;
+      next = node_parent(tree, node);
+    }
+  }
+  free(blacks);
+  return valid && visited == tree->count;
+}
+
+CompactTree compact_tree_load(const void *buffer, size_t bytes)
+{
+  const struct _CompactTree *header = buffer;
+  uint32_t links, stride;
+  CompactTree tree;
+
+  if (bytes < sizeof(*header) || header->magic != COMPACT_MAGIC ||
+      header->size > UINT32_MAX / 2 || header->count > NIL ||
+      header->reserved != 0)
+    return NULL;
+  node_layout(header->size, &links, &stride);
+  if (header->links != links || header->stride != stride ||
+      bytes < sizeof(*header) + (size_t)header->count * stride)
+    return NULL;
+
+  bytes = sizeof(*header) + (size_t)header->count * stride;
+  tree = malloc(bytes);
+  if (tree)
+  {
+    memcpy(tree, buffer, bytes);
+    tree->capacity = tree->count;
+    if (!valid_links(tree))
+    {
+      free(tree);
+      return NULL;
+    }
+  }
+
+  return tree;
+}
+
+static void in_order(CompactTree tree, uint32_t node,
+                     void (*func)(void *, void *), void *extra_data)
+{
+  if (node != NIL)
+  {
+    in_order(tree, LEFT(node), func, extra_data);
+    func(node_data(tree, node), extra_data);
+    in_order(tree, RIGHT(node), func, extra_data);
+  }
+}
+
+void compact_tree_in_order(CompactTree tree,
+                           void (*func)(void *, void *),
+                           void *extra_data)
+{
+  if (tree)
+    in_order(tree, tree->root, func, extra_data);
+}
+
+static uint32_t search_node(CompactTree tree,
+                            const void *data,
+                            int (*compare)(const void *, const void *))
+{
+  uint32_t node = tree->root;
+
+  while (node != NIL)
+  {
+    int cmp = compare(data, node_data(tree, node));
+    if (cmp == 0)
+      break;
+    node = cmp < 0 ? LEFT(node) : RIGHT(node);
+  }
+  return node;
+}
+
+void *compact_tree_search(CompactTree tree,
+                          const void *data,
+                          int (*compare)(const void *, const void *))
+{
+  uint32_t node;
+
+  if (!tree)
+    return NULL;
+  node = search_node(tree, data, compare);
+  return node == NIL ? NULL : node_data(tree, node);
+}
+
+/*--------------------------------------------------------------------*/
+/* Rebalancing: same algorithms as tree-rbt.c, on indices. */
+
+// Make the link that pointed to u point to v (transplant without parents)
+static void replace_child(CompactTree tree, uint32_t parent, uint32_t u, uint32_t v)
+{
+  if (parent == NIL)
+    tree->root = v;
+  else if (LEFT(parent) == u)
+    LEFT(parent) = v;
+  else
+    RIGHT(parent) = v;
+}
+
+static void rotate_left(CompactTree tree, uint32_t x)
+{
+  uint32_t y = RIGHT(x);
+  uint32_t parent = node_parent(tree, x);
+
+  RIGHT(x) = LEFT(y);
+  if (LEFT(y) != NIL)
+    node_set_parent(tree, LEFT(y), x);
+  node_set_parent(tree, y, parent);
+  replace_child(tree, parent, x, y);
+  LEFT(y) = x;
+  node_set_parent(tree, x, y);
+}
+
+static void rotate_right(CompactTree tree, uint32_t x)
+{
+  uint32_t y = LEFT(x);
+  uint32_t parent = node_parent(tree, x);
+
+  LEFT(x) = RIGHT(y);
+  if (RIGHT(y) != NIL)
+    node_set_parent(tree, RIGHT(y), x);
+  node_set_parent(tree, y, parent);
+  replace_child(tree, parent, x, y);
+  RIGHT(y) = x;
+  node_set_parent(tree, x, y);
+}
+
+static void insert_fixup(CompactTree tree, uint32_t z)
+{
+  while (z != tree->root && node_color(tree, node_parent(tree, z)) == RED)
+  {
+    uint32_t parent = node_parent(tree, z);
+    uint32_t grandparent = node_parent(tree, parent);
+
+    if (parent == LEFT(grandparent))
+    {
+      uint32_t y = RIGHT(grandparent); // The Uncle
+      if (node_color(tree, y) == RED)
+      {
+        // Case 1: Uncle is RED -> Recolor and move up
+        node_set_color(tree, parent, BLACK);
+        node_set_color(tree, y, BLACK);
+        node_set_color(tree, grandparent, RED);
+        z = grandparent;
+      }
+      else
+      {
+        // Case 2: Uncle is BLACK -> Rotations needed
+        if (z == RIGHT(parent))
+        {
+          z = parent;
+          rotate_left(tree, z);
+          parent = node_parent(tree, z);
+        }
+        node_set_color(tree, parent, BLACK);
+        node_set_color(tree, grandparent, RED);
+        rotate_right(tree, grandparent);
+      }
+    }
+    else
+    {
+      // Symmetric case for when the parent is a right child
+      uint32_t y = LEFT(grandparent); // The Uncle
+      if (node_color(tree, y) == RED)
+      {
+        node_set_color(tree, parent, BLACK);
+        node_set_color(tree, y, BLACK);
+        node_set_color(tree, grandparent, RED);
+        z = grandparent;
+      }
+      else
+      {
+        if (z == LEFT(parent))
+        {
+          z = parent;
+          rotate_right(tree, z);
+          parent = node_parent(tree, z);
+        }
+        node_set_color(tree, parent, BLACK);
+        node_set_color(tree, grandparent, RED);
+        rotate_left(tree, grandparent);
+      }
+    }
+  }
+  node_set_color(tree, tree->root, BLACK);
+}
+
+static void delete_fixup(CompactTree tree, uint32_t x, uint32_t x_parent)
+{
+  uint32_t w; // Sibling
+
+  while (x != tree->root && node_color(tree, x) == BLACK)
+  {
+    if (LEFT(x_parent) == x)
+    {
+      w = RIGHT(x_parent);
+      if (node_color(tree, w) == RED)
+      { // Case 1
+        node_set_color(tree, w, BLACK);
+        node_set_color(tree, x_parent, RED);
+        rotate_left(tree, x_parent);
+        w = RIGHT(x_parent);
+      }
+      if (node_color(tree, LEFT(w)) == BLACK && node_color(tree, RIGHT(w)) == BLACK)
+      { // Case 2
+        node_set_color(tree, w, RED);
+        x = x_parent;
+        x_parent = node_parent(tree, x);
+      }
+      else
+      {
+        if (node_color(tree, RIGHT(w)) == BLACK)
+        { // Case 3
+          node_set_color(tree, LEFT(w), BLACK);
+          node_set_color(tree, w, RED);
+          rotate_right(tree, w);
+          w = RIGHT(x_parent);
+        }
+        // Case 4
+        node_set_color(tree, w, node_color(tree, x_parent));
+        node_set_color(tree, x_parent, BLACK);
+        if (RIGHT(w) != NIL)
+          node_set_color(tree, RIGHT(w), BLACK);
+        rotate_left(tree, x_parent);
+        x = tree->root;
+      }
+    }
+    else
+    { // x is a right child
+      w = LEFT(x_parent);
+      if (node_color(tree, w) == RED)
+      { // Case 1
+        node_set_color(tree, w, BLACK);
+        node_set_color(tree, x_parent, RED);
+        rotate_right(tree, x_parent);
+        w = LEFT(x_parent);
+      }
+      if (node_color(tree, LEFT(w)) == BLACK && node_color(tree, RIGHT(w)) == BLACK)
+      { // Case 2
+        node_set_color(tree, w, RED);
+        x = x_parent;
+        x_parent = node_parent(tree, x);
+      }
+      else
+      {
+        if (node_color(tree, LEFT(w)) == BLACK)
+        { // Case 3
+          node_set_color(tree, RIGHT(w), BLACK);
+          node_set_color(tree, w, RED);
+          rotate_left(tree, w);
+          w = LEFT(x_parent);
+        }
+        // Case 4
+        node_set_color(tree, w, node_color(tree, x_parent));
+        node_set_color(tree, x_parent, BLACK);
+        if (LEFT(w) != NIL)
+          node_set_color(tree, LEFT(w), BLACK);
+        rotate_right(tree, x_parent);
+        x = tree->root;
+      }
+    }
+  }
+  if (x != NIL)
+    node_set_color(tree, x, BLACK);
+}
+
+bool compact_tree_insert_sorted(CompactTree *ptree,
+                                const void *data,
+                                int (*compare)(const void *, const void *))
+{
+  CompactTree tree;
+  uint32_t parent = NIL, node, z;
+  bool left = false;
+  Links *links;
+
+  if (!ptree || !*ptree)
+    return false;
+  if ((*ptree)->count == (*ptree)->capacity && !grow(ptree))
+    return false;
+  tree = *ptree;
+
+  node = tree->root;
+  while (node != NIL)
+  {
+    parent = node;
+    left = compare(data, node_data(tree, node)) < 0;
+    node = left ? LEFT(node) : RIGHT(node);
+  }
+
+  z = tree->count++;
+  memcpy(node_data(tree, z), data, tree->size);
+  links = node_links(tree, z);
+  links->left = NIL;
+  links->right = NIL;
+  links->parent = parent;
+  node_set_color(tree, z, RED);
+
+  if (parent == NIL)
+    tree->root = z;
+  else if (left)
+    LEFT(parent) = z;
+  else
+    RIGHT(parent) = z;
+
+  insert_fixup(tree, z);
+  return true;
+}
+
+// Fill the slot of a removed node with the last node of the array
+static void fill_hole(CompactTree tree, uint32_t hole)
+{
+  uint32_t last = --tree->count;
+
+  if (last == hole)
+    return;
+  memcpy(node_data(tree, hole), node_data(tree, last), tree->stride);
+
+  replace_child(tree, node_parent(tree, hole), last, hole);
+  if (LEFT(hole) != NIL)
+    node_set_parent(tree, LEFT(hole), hole);
+  if (RIGHT(hole) != NIL)
+    node_set_parent(tree, RIGHT(hole), hole);
+}
+
+bool compact_tree_remove_sorted(CompactTree *ptree,
+                                const void *data,
+                                int (*compare)(const void *, const void *))
+{
+  CompactTree tree;
+  uint32_t z, y, x, x_parent;
+  Color y_original_color;
+
+  if (!ptree || !*ptree)
+    return false;
+  tree = *ptree;
+
+  z = search_node(tree, data, compare);
+  if (z == NIL)
+    return false;
+
+  y = z;
+  y_original_color = node_color(tree, y);
+  if (LEFT(z) == NIL || RIGHT(z) == NIL)
+  {
+    x = LEFT(z) == NIL ? RIGHT(z) : LEFT(z);
+    x_parent = node_parent(tree, z);
+    if (x != NIL)
+      node_set_parent(tree, x, x_parent);
+    replace_child(tree, x_parent, z, x);
+  }
+  else
+  {
+    y = RIGHT(z);
+    while (LEFT(y) != NIL)
+      y = LEFT(y);
+    y_original_color = node_color(tree, y);
+    x = RIGHT(y);
+
+    if (node_parent(tree, y) == z)
+    {
+      x_parent = y;
+    }
+    else
+    {
+      x_parent = node_parent(tree, y);
+      LEFT(x_parent) = x;
+      if (x != NIL)
+        node_set_parent(tree, x, x_parent);
+      RIGHT(y) = RIGHT(z);
+      node_set_parent(tree, RIGHT(y), y);
+    }
+    LEFT(y) = LEFT(z);
+    node_set_parent(tree, LEFT(y), y);
+    // Parent and color of z
+    node_links(tree, y)->parent = node_links(tree, z)->parent;
+    replace_child(tree, node_parent(tree, z), z, y);
+  }
+
+  if (y_original_color == BLACK)
+    delete_fixup(tree, x, x_parent);
+
+  fill_hole(tree, z);
+  return true;
+}
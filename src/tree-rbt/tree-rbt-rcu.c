@@ -0,0 +1,644 @@
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tree-rbt.h"
+#include "tree-rbt-rcu.h"
+
+/*--------------------------------------------------------------------*/
+/* Path copying: a published node is never modified again. The writer
+   copies every node it changes (the path from the root, and the siblings
+   and uncles recolored or rotated by the fixups), modifies the copies, and
+   publishes the new root with a release store. Readers load the root with
+   an acquire load and walk plain pointers.
+
+   The nodes have no parent pointer, since a copy would have to update the
+   parent pointers of its children: the fixups are the usual ones, walking
+   back up a stack of the nodes on the path (as in GNU libavl).
+
+   Reclamation by epochs: a reader announces the global epoch when it
+   enters a read section. The nodes replaced by a write are retired in the
+   current epoch; the writer advances the epoch once every reader in a
+   read section has announced it, and then frees the nodes retired two
+   epochs before, which no reader can still see. */
+
+// Height of a red-black tree of 2^64 nodes
+#define RCU_MAX_HEIGHT 128
+
+// Copies made by one write per level of the tree, at most
+#define RCU_COPIES_PER_LEVEL 6
+
+typedef struct _RcuNode *RcuNode;
+
+struct _RcuNode
+{
+  RcuNode link[2];    // left and right
+  RcuNode retired;    // next node of a limbo or spare list
+  unsigned long write; // write that created the node
+  Color color;
+  char data[];
+};
+
+#define RCU_NODE_SIZE(size) (sizeof(struct _RcuNode) + (size))
+
+struct _RcuReader
+{
+  RcuTree tree;
+  atomic_ulong epoch; // (epoch << 1) | 1 in a read section, else 0
+  atomic_bool used;
+  RcuReader next;
+};
+
+struct _RcuTree
+{
+  _Atomic(RcuNode) root;
+  atomic_size_t count;
+  size_t size;
+  int (*compare)(const void *, const void *);
+  _Atomic(RcuReader) readers;
+  atomic_ulong epoch;
+  // Writer state, under the lock
+  pthread_mutex_t write_lock;
+  unsigned long write;
+  RcuNode retired;   // replaced by the current write
+  RcuNode limbo[3];  // retired in the epoch of the same index mod 3
+  RcuNode spare;     // reclaimed, reused by later writes
+  size_t spare_count;
+};
+
+RcuTree rcu_tree_new(size_t size, int (*compare)(const void *, const void *))
+{
+  RcuTree tree = malloc(sizeof(*tree));
+
+  if (!tree)
+    return NULL;
+
+  if (pthread_mutex_init(&tree->write_lock, NULL) != 0)
+  {
+    free(tree);
+    return NULL;
+  }
+  atomic_init(&tree->root, NULL);
+  atomic_init(&tree->count, 0);
+  tree->size = size;
+  tree->compare = compare;
+  atomic_init(&tree->readers, NULL);
+  atomic_init(&tree->epoch, 0);
+  tree->write = 0;
+  tree->retired = NULL;
+  tree->limbo[0] = tree->limbo[1] = tree->limbo[2] = NULL;
+  tree->spare = NULL;
+  tree->spare_count = 0;
+  return tree;
+}
+
+static void free_list(RcuNode node)
+{
+  RcuNode next;
+
+  for (; node; node = next)
+  {
+    next = node->retired;
+    free(node);
+  }
+}
+
+static void free_nodes(RcuNode node, void (*delete_data)(void *))
+{
+  if (node)
+  {
+    free_nodes(node->link[0], delete_data);
+    free_nodes(node->link[1], delete_data);
+    if (delete_data)
+      delete_data(node->data);
+    free(node);
+  }
+}
+
+void rcu_tree_delete(RcuTree tree, void (*delete_data)(void *))
+{
+  RcuReader reader, next;
+
+  if (tree)
+  {
+    free_nodes(atomic_load(&tree->root), delete_data);
+    free_list(tree->retired);
+    free_list(tree->limbo[0]);
+    free_list(tree->limbo[1]);
+    free_list(tree->limbo[2]);
+    free_list(tree->spare);
+    for (reader = atomic_load(&tree->readers); reader; reader = next)
+    {
+      next = reader->next;
+      free(reader);
+    }
+    pthread_mutex_destroy(&tree->write_lock);
+    free(tree);
+  }
+}
+
+/*--------------------------------------------------------------------*/
+/* Readers */
+
+RcuReader rcu_tree_reader_new(RcuTree tree)
+{
+  RcuReader reader;
+
+  // Reuse the slot of a deleted reader
+  for (reader = atomic_load(&tree->readers); reader; reader = reader->next)
+  {
+    bool used = false;
+
+    if (atomic_compare_exchange_strong(&reader->used, &used, true))
+      return reader;
+  }
+
+  reader = malloc(sizeof(*reader));
+  if (!reader)
+    return NULL;
+  reader->tree = tree;
+  atomic_init(&reader->epoch, 0);
+  atomic_init(&reader->used, true);
+  reader->next = atomic_load(&tree->readers);
+  while (!atomic_compare_exchange_weak(&tree->readers, &reader->next, reader))
+    ;
+  return reader;
+}
+
+void rcu_tree_reader_delete(RcuReader reader)
+{
+  if (reader)
+  {
+    atomic_store(&reader->epoch, 0);
+    atomic_store(&reader->used, false);
+  }
+}
+
+void rcu_tree_read_begin(RcuReader reader)
+{
+  unsigned long epoch = atomic_load_explicit(&reader->tree->epoch,
+                                             memory_order_relaxed);
+
+  // An exchange rather than a store: the writer reading the announcement
+  // synchronizes with the end of the previous section too
+  atomic_exchange_explicit(&reader->epoch, (epoch << 1) | 1,
+                           memory_order_acq_rel);
+  // The announcement must be visible before the root is read
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+void rcu_tree_read_end(RcuReader reader)
+{
+  atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+const void *rcu_tree_search(RcuTree tree, const void *data)
+{
+  RcuNode node = atomic_load_explicit(&tree->root, memory_order_acquire);
+
+  while (node)
+  {
+    int cmp = tree->compare(data, node->data);
+
+    if (cmp == 0)
+      return node->data;
+    node = node->link[cmp > 0];
+  }
+
+  return NULL;
+}
+
+static size_t range(RcuTree tree,
+                    RcuNode node,
+                    const void *lo,
+                    const void *hi,
+                    void (*func)(const void *, void *),
+                    void *extra_data)
+{
+  size_t count = 0;
+
+  while (node)
+  {
+    if (lo && tree->compare(node->data, lo) < 0)
+      node = node->link[1];
+    else if (hi && tree->compare(node->data, hi) >= 0)
+      node = node->link[0];
+    else
+    {
+      // In range: the left part is bounded by lo only, the right by hi
+      count += range(tree, node->link[0], lo, NULL, func, extra_data);
+      func(node->data, extra_data);
+      count++;
+      lo = NULL;
+      node = node->link[1];
+    }
+  }
+
+  return count;
+}
+
+size_t rcu_tree_range(RcuTree tree,
+                      const void *lo,
+                      const void *hi,
+                      void (*func)(const void *, void *),
+                      void *extra_data)
+{
+  return range(tree, atomic_load_explicit(&tree->root, memory_order_acquire),
+               lo, hi, func, extra_data);
+}
+
+size_t rcu_tree_size(RcuTree tree)
+{
+  return atomic_load_explicit(&tree->count, memory_order_relaxed);
+}
+
+static bool is_red(RcuNode node)
+{
+  return node && node->color == RED;
+}
+
+// Black nodes on every path from node down, -1 if two paths differ, a red
+// node has a red child or a payload is smaller than *last, the payload
+// before it in order
+static int rcu_black_height(RcuTree tree,
+                            RcuNode node,
+                            bool red_parent,
+                            const void **last)
+{
+  int left, right;
+
+  if (!node)
+    return 0;
+  if (red_parent && node->color == RED)
+    return -1;
+  left = rcu_black_height(tree, node->link[0], node->color == RED, last);
+  if (left < 0 || (*last && tree->compare(*last, node->data) > 0))
+    return -1;
+  *last = node->data;
+  right = rcu_black_height(tree, node->link[1], node->color == RED, last);
+  if (right != left)
+    return -1;
+
+  return left + (node->color == BLACK);
+}
+
+int rcu_tree_black_height(RcuTree tree)
+{
+  RcuNode root = atomic_load_explicit(&tree->root, memory_order_acquire);
+  const void *last = NULL;
+
+  if (is_red(root))
+    return -1;
+
+  return rcu_black_height(tree, root, false, &last);
+}
+
+/*--------------------------------------------------------------------*/
+/* Writer */
+
+// Enough spare nodes for one write, so that it cannot fail halfway
+static bool reserve(RcuTree tree)
+{
+  size_t height = 0, needed, count = atomic_load(&tree->count) + 1;
+
+  for (; count; count >>= 1)
+    height += 2;
+  needed = RCU_COPIES_PER_LEVEL * height + 1;
+
+  while (tree->spare_count < needed)
+  {
+    RcuNode node = malloc(RCU_NODE_SIZE(tree->size));
+
+    if (!node)
+      return false;
+    node->retired = tree->spare;
+    tree->spare = node;
+    tree->spare_count++;
+  }
+  return true;
+}
+
+static RcuNode take_spare(RcuTree tree)
+{
+  RcuNode node = tree->spare;
+
+  tree->spare = node->retired;
+  tree->spare_count--;
+  node->write = tree->write;
+  return node;
+}
+
+static void retire(RcuTree tree, RcuNode node)
+{
+  node->retired = tree->retired;
+  tree->retired = node;
+}
+
+// Writable version of node: node itself if the current write created it
+static RcuNode node_copy(RcuTree tree, RcuNode node)
+{
+  RcuNode copy;
+
+  if (node->write == tree->write)
+    return node;
+  copy = take_spare(tree);
+  memcpy(copy->link, node->link, sizeof(node->link));
+  copy->color = node->color;
+  memcpy(copy->data, node->data, tree->size);
+  retire(tree, node);
+  return copy;
+}
+
+// Same, stored in the link (of a writable node) leading to it
+static RcuNode link_copy(RcuTree tree, RcuNode *link)
+{
+  return *link = node_copy(tree, *link);
+}
+
+// Nodes retired in the epoch before last are unreachable
+static void reclaim(RcuTree tree, RcuNode node)
+{
+  RcuNode next;
+
+  for (; node; node = next)
+  {
+    next = node->retired;
+    if (tree->spare_count < RCU_MAX_HEIGHT * RCU_COPIES_PER_LEVEL)
+    {
+      node->retired = tree->spare;
+      tree->spare = node;
+      tree->spare_count++;
+    }
+    else
+      free(node);
+  }
+}
+
+static void publish(RcuTree tree, RcuNode root, bool added)
+{
+  unsigned long epoch;
+  RcuReader reader;
+  RcuNode last;
+
+  atomic_store_explicit(&tree->root, root, memory_order_release);
+  if (added)
+    atomic_fetch_add_explicit(&tree->count, 1, memory_order_relaxed);
+  else
+    atomic_fetch_sub_explicit(&tree->count, 1, memory_order_relaxed);
+  // Readers announcing an epoch after this fence see the new root
+  atomic_thread_fence(memory_order_seq_cst);
+
+  epoch = atomic_load_explicit(&tree->epoch, memory_order_relaxed);
+  if (tree->retired)
+  {
+    for (last = tree->retired; last->retired; last = last->retired)
+      ;
+    last->retired = tree->limbo[epoch % 3];
+    tree->limbo[epoch % 3] = tree->retired;
+    tree->retired = NULL;
+  }
+
+  for (reader = atomic_load(&tree->readers); reader; reader = reader->next)
+  {
+    unsigned long announced = atomic_load_explicit(&reader->epoch,
+                                                   memory_order_acquire);
+
+    if ((announced & 1) && announced >> 1 != epoch)
+      return;
+  }
+  atomic_store_explicit(&tree->epoch, epoch + 1, memory_order_relaxed);
+  reclaim(tree, tree->limbo[(epoch + 1) % 3]);
+  tree->limbo[(epoch + 1) % 3] = NULL;
+}
+
+bool rcu_tree_insert(RcuTree tree, const void *data)
+{
+  // holder.link[0] is the root; pa[k] is the k-th node of the path, da[k]
+  // the side taken from it
+  struct _RcuNode holder;
+  RcuNode pa[RCU_MAX_HEIGHT + 1];
+  unsigned char da[RCU_MAX_HEIGHT + 1];
+  RcuNode node;
+  int k = 1;
+
+  pthread_mutex_lock(&tree->write_lock);
+  if (!reserve(tree))
+  {
+    pthread_mutex_unlock(&tree->write_lock);
+    return false;
+  }
+  tree->write++;
+  holder.link[0] = atomic_load_explicit(&tree->root, memory_order_relaxed);
+  holder.write = tree->write;
+  pa[0] = &holder;
+  da[0] = 0;
+
+  while (pa[k - 1]->link[da[k - 1]])
+  {
+    node = link_copy(tree, &pa[k - 1]->link[da[k - 1]]);
+    pa[k] = node;
+    da[k++] = tree->compare(data, node->data) >= 0;
+  }
+
+  node = take_spare(tree);
+  node->link[0] = node->link[1] = NULL;
+  node->color = RED;
+  memcpy(node->data, data, tree->size);
+  pa[k - 1]->link[da[k - 1]] = node;
+
+  // The new node is red: fix a red parent
+  while (k >= 3 && pa[k - 1]->color == RED)
+  {
+    int dir = da[k - 2];
+    RcuNode uncle = pa[k - 2]->link[!dir];
+    RcuNode x, y;
+
+    if (is_red(uncle))
+    {
+      uncle = link_copy(tree, &pa[k - 2]->link[!dir]);
+      pa[k - 1]->color = uncle->color = BLACK;
+      pa[k - 2]->color = RED;
+      k -= 2;
+      continue;
+    }
+
+    if (da[k - 1] == dir)
+      y = pa[k - 1];
+    else
+    {
+      x = pa[k - 1];
+      y = x->link[!dir];
+      x->link[!dir] = y->link[dir];
+      y->link[dir] = x;
+      pa[k - 2]->link[dir] = y;
+    }
+
+    x = pa[k - 2];
+    x->color = RED;
+    y->color = BLACK;
+    x->link[dir] = y->link[!dir];
+    y->link[!dir] = x;
+    pa[k - 3]->link[da[k - 3]] = y;
+    break;
+  }
+  holder.link[0]->color = BLACK;
+
+  publish(tree, holder.link[0], true);
+  pthread_mutex_unlock(&tree->write_lock);
+  return true;
+}
+
+bool rcu_tree_remove(RcuTree tree, const void *data)
+{
+  struct _RcuNode holder;
+  RcuNode pa[RCU_MAX_HEIGHT + 1];
+  unsigned char da[RCU_MAX_HEIGHT + 1];
+  RcuNode removed;
+  Color color;
+  int j, k = 1;
+
+  pthread_mutex_lock(&tree->write_lock);
+  if (!reserve(tree))
+  {
+    pthread_mutex_unlock(&tree->write_lock);
+    return false;
+  }
+  holder.link[0] = atomic_load_explicit(&tree->root, memory_order_relaxed);
+  pa[0] = &holder;
+  da[0] = 0;
+
+  // Find the node first: a write copies nothing before it is sure to
+  // succeed
+  for (removed = holder.link[0]; removed; removed = removed->link[da[k++]])
+  {
+    int cmp = tree->compare(data, removed->data);
+
+    if (cmp == 0)
+      break;
+    pa[k] = removed;
+    da[k] = cmp > 0;
+  }
+  if (!removed)
+  {
+    pthread_mutex_unlock(&tree->write_lock);
+    return false;
+  }
+
+  // Copy the path down to the node, which is retired rather than copied
+  tree->write++;
+  holder.write = tree->write;
+  for (j = 1; j < k; j++)
+    pa[j] = link_copy(tree, &pa[j - 1]->link[da[j - 1]]);
+
+  color = removed->color;
+  if (!removed->link[1])
+    pa[k - 1]->link[da[k - 1]] = removed->link[0];
+  else
+  {
+    RcuNode right = node_copy(tree, removed->link[1]);
+    RcuNode r = right;
+
+    if (!r->link[0])
+    {
+      // The right child takes the place of the node
+      r->link[0] = removed->link[0];
+      color = r->color;
+      r->color = removed->color;
+      pa[k - 1]->link[da[k - 1]] = r;
+      da[k] = 1;
+      pa[k++] = r;
+    }
+    else
+    {
+      // The successor s takes the place of the node
+      RcuNode s;
+
+      j = k++;
+      for (;;)
+      {
+        da[k] = 0;
+        pa[k++] = r;
+        s = link_copy(tree, &r->link[0]);
+        if (!s->link[0])
+          break;
+        r = s;
+      }
+
+      da[j] = 1;
+      pa[j] = s;
+      pa[k - 1]->link[0] = s->link[1];
+      s->link[0] = removed->link[0];
+      s->link[1] = right;
+      pa[j - 1]->link[da[j - 1]] = s;
+      color = s->color;
+      s->color = removed->color;
+    }
+  }
+  retire(tree, removed);
+
+  // A black node went away: fix the missing black
+  if (color == BLACK)
+  {
+    for (;;)
+    {
+      RcuNode x = pa[k - 1]->link[da[k - 1]];
+      RcuNode w;
+      int dir;
+
+      if (is_red(x))
+      {
+        link_copy(tree, &pa[k - 1]->link[da[k - 1]])->color = BLACK;
+        break;
+      }
+      if (k < 2)
+        break;
+
+      dir = da[k - 1];
+      w = link_copy(tree, &pa[k - 1]->link[!dir]);
+      if (w->color == RED)
+      {
+        w->color = BLACK;
+        pa[k - 1]->color = RED;
+        pa[k - 1]->link[!dir] = w->link[dir];
+        w->link[dir] = pa[k - 1];
+        pa[k - 2]->link[da[k - 2]] = w;
+
+        pa[k] = pa[k - 1];
+        da[k] = dir;
+        pa[k - 1] = w;
+        k++;
+
+        w = link_copy(tree, &pa[k - 1]->link[!dir]);
+      }
+
+      if (!is_red(w->link[0]) && !is_red(w->link[1]))
+        w->color = RED;
+      else
+      {
+        if (!is_red(w->link[!dir]))
+        {
+          RcuNode y = link_copy(tree, &w->link[dir]);
+
+          y->color = BLACK;
+          w->color = RED;
+          w->link[dir] = y->link[!dir];
+          y->link[!dir] = w;
+          w = pa[k - 1]->link[!dir] = y;
+        }
+
+        w->color = pa[k - 1]->color;
+        pa[k - 1]->color = BLACK;
+        link_copy(tree, &w->link[!dir])->color = BLACK;
+        pa[k - 1]->link[!dir] = w->link[dir];
+        w->link[dir] = pa[k - 1];
+        pa[k - 2]->link[da[k - 2]] = w;
+        break;
+      }
+
+      k--;
+    }
+  }
+
+  publish(tree, holder.link[0], false);
+  pthread_mutex_unlock(&tree->write_lock);
+  return true;
+}
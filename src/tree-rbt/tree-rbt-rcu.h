@@ -0,0 +1,65 @@
+#ifndef _TREE_RBT_RCU_H_
+#define _TREE_RBT_RCU_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Red-black tree for many readers and one writer at a time (read-copy-
+   update): the writer copies the nodes it changes, and publishes the new
+   root with one atomic store. Readers take no lock and never wait: they
+   walk whichever version of the tree was the last one published.
+
+   Each reader thread registers once, then reads between
+   rcu_tree_read_begin() and rcu_tree_read_end(). Nodes replaced by a
+   write are released once every read section that could see them has
+   ended (epoch-based reclamation): a payload returned by rcu_tree_search()
+   stays valid until the end of the read section. Every call in a section
+   reads the last published version, so two calls may see different
+   versions. Writes are serialized by a lock of their own. */
+typedef struct _RcuTree *RcuTree;
+
+typedef struct _RcuReader *RcuReader;
+
+RcuTree rcu_tree_new (size_t size,
+                      int (*compare) (const void *, const void *));
+
+// Not thread-safe: no other thread may use the tree or its readers any more
+void rcu_tree_delete (RcuTree tree, void (*delete_data) (void *));
+
+// Register the calling thread as a reader, NULL if the allocation failed
+RcuReader rcu_tree_reader_new (RcuTree tree);
+
+// Outside of a read section
+void rcu_tree_reader_delete (RcuReader reader);
+
+// Sections do not nest
+void rcu_tree_read_begin (RcuReader reader);
+
+void rcu_tree_read_end (RcuReader reader);
+
+// In a read section: the payload equal to data, NULL if there is none
+const void *rcu_tree_search (RcuTree tree, const void *data);
+
+// In a read section: call func on the data in [lo, hi) in order, return
+// the number of calls
+size_t rcu_tree_range (RcuTree tree,
+                       const void *lo,
+                       const void *hi,
+                       void (*func) (const void *, void *),
+                       void *extra_data);
+
+size_t rcu_tree_size (RcuTree tree);
+
+// In a read section: the number of black nodes on every path from the root
+// of the version read, -1 if it is not a red-black tree (red root, red node
+// with a red child, paths of different black heights, payloads out of
+// order)
+int rcu_tree_black_height (RcuTree tree);
+
+// Equal payloads go right of each other. false if the allocation failed.
+bool rcu_tree_insert (RcuTree tree, const void *data);
+
+// Remove one payload equal to data, false if there is none
+bool rcu_tree_remove (RcuTree tree, const void *data);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _TREE_RBT_SHARD_H_
+#define _TREE_RBT_SHARD_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "tree-rbt-handle.h"
+
+/* Red-black tree split into shards by key range, for many writers: each
+   shard is a tree with its own reader-writer lock, so updates of distinct
+   shards run in parallel.
+
+   Shard i holds the payloads not less than split point i - 1 and less
+   than split point i: count shards have count - 1 split points, sorted
+   payloads of size bytes. Searches and updates lock one shard; range scans
+   and walks lock the shards they cover, in order, and see them all at the
+   same time. shard_tree_rebuild() moves the split points: it locks only
+   the shards on both sides of the points that move, and moves the
+   payloads between them by splitting and joining their trees, in
+   O(log n) per shard plus, without TREE_ORDER_STATISTICS, the count of
+   the payloads that change shards. */
+typedef struct _ShardTree *ShardTree;
+
+// split_points: count - 1 sorted payloads, or NULL to put every payload in
+// the first shard until the first rebuild
+ShardTree shard_tree_new (size_t size,
+                          int (*compare) (const void *, const void *),
+                          size_t count,
+                          const void *split_points);
+
+// Not thread-safe: no other thread may use the tree any more
+void shard_tree_delete (ShardTree tree, void (*delete_data) (void *));
+
+size_t shard_tree_count (ShardTree tree);
+
+// Number of payloads of shard i, of all shards if i is not less than the
+// count of shards
+size_t shard_tree_size (ShardTree tree, size_t i);
+
+// Copy the payload equal to data to result (unless result is NULL),
+// return false if there is none
+bool shard_tree_search (ShardTree tree, const void *data, void *result);
+
+// Call func on the data in [lo, hi) in order, return the number of calls
+size_t shard_tree_range (ShardTree tree,
+                         const void *lo,
+                         const void *hi,
+                         void (*func) (void *, void *),
+                         void *extra_data);
+
+void shard_tree_in_order (ShardTree tree,
+                          void (*func) (void *, void *),
+                          void *extra_data);
+
+bool shard_tree_insert (ShardTree tree, const void *data);
+
+bool shard_tree_remove (ShardTree tree, const void *data);
+
+// Move the split points to split_points (count - 1 sorted payloads), or
+// with NULL to the payloads that split the tree into shards of equal sizes
+// (which reads every shard; an empty tree is left as it is). false if an
+// allocation failed: the tree is then unchanged.
+bool shard_tree_rebuild (ShardTree tree, const void *split_points);
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np()
+#endif
+#include <string.h>
+#include <pthread.h>
+#include "tree-rbt-sync.h"
+
+/*--------------------------------------------------------------------*/
+/* The handle does the work, the lock only orders the calls. The nodes
+   come from a slab of the tree: allocations and releases only happen
+   under the write lock. As in tree-avl-sync.c, the lock prefers writers
+   on glibc too. */
+
+struct _SyncTree
+{
+  pthread_rwlock_t lock;
+  TreeHandle handle;
+  TreeSlab *slab;
+  size_t size;
+  int (*compare)(const void *, const void *);
+};
+
+SyncTree sync_tree_new(size_t size, int (*compare)(const void *, const void *))
+{
+  SyncTree tree = malloc(sizeof(*tree));
+  pthread_rwlockattr_t attr;
+  int status;
+
+  if (!tree)
+    return NULL;
+
+  tree->slab = tree_slab_new(size); // NULL: fall back on malloc
+  tree->handle = tree_handle_new(size, compare, tree->slab);
+  tree->size = size;
+  tree->compare = compare;
+
+  pthread_rwlockattr_init(&attr);
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  status = pthread_rwlock_init(&tree->lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+  if (!tree->handle || status != 0)
+  {
+    tree_handle_delete(tree->handle, NULL);
+    tree_slab_delete(tree->slab);
+    free(tree);
+    return NULL;
+  }
+
+  return tree;
+}
+
+void sync_tree_delete(SyncTree tree, void (*delete_data)(void *))
+{
+  if (tree)
+  {
+    tree_handle_delete(tree->handle, delete_data);
+    tree_slab_delete(tree->slab);
+    pthread_rwlock_destroy(&tree->lock);
+    free(tree);
+  }
+}
+
+size_t sync_tree_size(SyncTree tree)
+{
+  size_t count;
+
+  pthread_rwlock_rdlock(&tree->lock);
+  count = tree_handle_size(tree->handle);
+  pthread_rwlock_unlock(&tree->lock);
+  return count;
+}
+
+bool sync_tree_search(SyncTree tree, const void *data, void *result)
+{
+  void *found;
+
+  pthread_rwlock_rdlock(&tree->lock);
+  found = tree_handle_search(tree->handle, data);
+  if (found && result)
+    memcpy(result, found, tree->size);
+  pthread_rwlock_unlock(&tree->lock);
+  return found != NULL;
+}
+
+size_t sync_tree_range(SyncTree tree,
+                       const void *lo,
+                       const void *hi,
+                       void (*func)(void *, void *),
+                       void *extra_data)
+{
+  size_t count;
+
+  pthread_rwlock_rdlock(&tree->lock);
+  count = tree_range(tree_handle_root(tree->handle), lo, hi,
+                     tree->compare, func, extra_data);
+  pthread_rwlock_unlock(&tree->lock);
+  return count;
+}
+
+void sync_tree_in_order(SyncTree tree,
+                        void (*func)(void *, void *),
+                        void *extra_data)
+{
+  pthread_rwlock_rdlock(&tree->lock);
+  tree_in_order(tree_handle_root(tree->handle), func, extra_data);
+  pthread_rwlock_unlock(&tree->lock);
+}
+
+bool sync_tree_insert(SyncTree tree, const void *data)
+{
+  Tree node;
+
+  pthread_rwlock_wrlock(&tree->lock);
+  node = tree_handle_insert(tree->handle, data);
+  pthread_rwlock_unlock(&tree->lock);
+  return node != NULL;
+}
+
+bool sync_tree_remove(SyncTree tree, const void *data)
+{
+  bool removed;
+
+  pthread_rwlock_wrlock(&tree->lock);
+  removed = tree_handle_remove(tree->handle, data);
+  pthread_rwlock_unlock(&tree->lock);
+  return removed;
+}
+
+TreeHandle sync_tree_write_begin(SyncTree tree)
+{
+  pthread_rwlock_wrlock(&tree->lock);
+  return tree->handle;
+}
+
+void sync_tree_write_end(SyncTree tree)
+{
+  pthread_rwlock_unlock(&tree->lock);
+}
+
+TreeHandle sync_tree_read_begin(SyncTree tree)
+{
+  pthread_rwlock_rdlock(&tree->lock);
+  return tree->handle;
+}
+
+void sync_tree_read_end(SyncTree tree)
+{
+  pthread_rwlock_unlock(&tree->lock);
+}
@@ -0,0 +1,58 @@
+#ifndef _TREE_RBT_SYNC_H_
+#define _TREE_RBT_SYNC_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "tree-rbt-handle.h"
+
+/* Red-black tree shared between threads, behind a reader-writer lock:
+   searches, range scans and walks run in parallel, modifications one at
+   a time.
+
+   A payload is only read under the lock: searches copy it out, range
+   scans and walks call func with the lock held (func must not call back
+   into the same tree). For many modifications in a row, a write section
+   takes the lock once: between sync_tree_write_begin() and
+   sync_tree_write_end() the returned handle is modified with the
+   functions of tree-rbt-handle.h. Read sections work the same way for
+   several reads that must see the same tree. A waiting writer goes before
+   new readers, so a thread must not nest read sections: its second read
+   lock would wait behind a writer that waits for its first one. */
+typedef struct _SyncTree *SyncTree;
+
+SyncTree sync_tree_new (size_t size,
+                        int (*compare) (const void *, const void *));
+
+// Not thread-safe: no other thread may use the tree any more
+void sync_tree_delete (SyncTree tree, void (*delete_data) (void *));
+
+size_t sync_tree_size (SyncTree tree);
+
+// Copy the payload equal to data to result (unless result is NULL),
+// return false if there is none
+bool sync_tree_search (SyncTree tree, const void *data, void *result);
+
+// Call func on the data in [lo, hi) in order, return the number of calls
+size_t sync_tree_range (SyncTree tree,
+                        const void *lo,
+                        const void *hi,
+                        void (*func) (void *, void *),
+                        void *extra_data);
+
+void sync_tree_in_order (SyncTree tree,
+                         void (*func) (void *, void *),
+                         void *extra_data);
+
+bool sync_tree_insert (SyncTree tree, const void *data);
+
+bool sync_tree_remove (SyncTree tree, const void *data);
+
+TreeHandle sync_tree_write_begin (SyncTree tree);
+
+void sync_tree_write_end (SyncTree tree);
+
+TreeHandle sync_tree_read_begin (SyncTree tree);
+
+void sync_tree_read_end (SyncTree tree);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _TREE_RBT_TYPED_H_
+#define _TREE_RBT_TYPED_H_
+
+#include <stddef.h>
+#include "tree-rbt.h"
+
+/* Type-specialized red-black trees.
+
+   DEFINE_RBT(name, key_type, cmp_expr) generates static inline functions
+   working on keys of type key_type, stored directly in the payload of the
+   nodes. cmp_expr compares two keys named a and b and is negative, zero or
+   positive like the compare functions of tree-rbt.h, e.g.
+
+       DEFINE_RBT(rbt_i64, int64_t, (a > b) - (a < b))
+
+   The comparison is inlined in the search loops instead of being called
+   through a function pointer, and keys are assigned instead of copied with
+   memcpy(). Linking and rebalancing are the ones of the generic tree
+   (tree_insert_node() and tree_detach_node(), which run tree_insert_fixup()
+   and delete_fixup()), so a typed tree is an ordinary Tree: it can be
+   walked with tree_in_order() and released with tree_delete(tree, NULL).
+
+   Generated functions:
+       key_type *name_key(Tree node);
+       Tree name_search_node(Tree tree, key_type key);
+       key_type *name_search(Tree tree, key_type key);
+       bool name_insert(Tree *ptree, key_type key);
+       bool name_remove(Tree *ptree, key_type key); */
+#define DEFINE_RBT(name, key_type, cmp_expr)                                  \
+  _Static_assert(_Alignof(key_type) <= _Alignof(struct _TreeNode),            \
+                 "key type of " #name " is over-aligned for tree nodes");     \
+                                                                              \
+  static inline int name##_compare(key_type a, key_type b)                    \
+  {                                                                           \
+    return (cmp_expr);                                                        \
+  }                                                                           \
+                                                                              \
+  static inline key_type *name##_key(Tree node)                               \
+  {                                                                           \
+    return (key_type *)node->data;                                            \
+  }                                                                           \
+                                                                              \
+  static inline Tree name##_search_node(Tree tree, key_type key)              \
+  {                                                                           \
+    while (tree)                                                              \
+    {                                                                         \
+      int cmp = name##_compare(key, *name##_key(tree));                       \
+      if (cmp == 0)                                                           \
+        return tree;                                                          \
+      tree = cmp < 0 ? tree->left : tree->right;                              \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline key_type *name##_search(Tree tree, key_type key)              \
+  {                                                                           \
+    Tree node = name##_search_node(tree, key);                                \
+    return node ? name##_key(node) : NULL;                                    \
+  }                                                                           \
+                                                                              \
+  static inline bool name##_insert(Tree *ptree, key_type key)                 \
+  {                                                                           \
+    Tree parent = NULL;                                                       \
+    bool left = false;                                                        \
+                                                                              \
+    for (Tree node = *ptree; node; node = left ? node->left : node->right)    \
+    {                                                                         \
+      parent = node;                                                          \
+      left = name##_compare(key, *name##_key(node)) < 0;                      \
+    }                                                                         \
+                                                                              \
+    Tree node = malloc(offsetof(struct _TreeNode, data) +                     \
+                       sizeof(key_type));                                     \
+    if (!node)                                                                \
+      return false;                                                           \
+    *name##_key(node) = key;                                                  \
+    tree_insert_node(ptree, parent, left, node);                              \
+    return true;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline bool name##_remove(Tree *ptree, key_type key)                 \
+  {                                                                           \
+    Tree node = name##_search_node(*ptree, key);                              \
+    if (!node)                                                                \
+      return false;                                                           \
+    tree_detach_node(ptree, node);                                            \
+    free(node);                                                               \
+    return true;                                                              \
+  }
+
+#endif
@@ -1,10 +1,178 @@
-
-
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 #include "tree-rbt.h"
 #include <stdbool.h>
 #include "min-max.h"
 
+/*--------------------------------------------------------------------*/
+/* Node layout: the color lives in the low bit of the parent link, which is
+   always 0 since nodes are at least 2-byte aligned. */
+
+#define COLOR_MASK ((uintptr_t)1)
+
+// Bytes needed by a node carrying a payload of the given size
+#define NODE_SIZE(size) (offsetof(struct _TreeNode, data) + (size))
+
+static inline Tree node_parent(Tree node)
+{
+  return (Tree)(node->parent & ~COLOR_MASK);
+}
+
+static inline void node_set_parent(Tree node, Tree parent)
+{
+  node->parent = (uintptr_t)parent | (node->parent & COLOR_MASK);
+}
+
+static inline Color node_color(Tree node)
+{
+  return (Color)(node->parent & COLOR_MASK);
+}
+
+static inline void node_set_color(Tree node, Color color)
+{
+  node->parent = (node->parent & ~COLOR_MASK) | (uintptr_t)color;
+}
+
+/* Subtree counts (TREE_ORDER_STATISTICS): node_update() recounts a node
+   from its children, update_path() every node from node up to the root. */
+#if TREE_ORDER_STATISTICS
+static inline size_t node_count(Tree node)
+{
+  return node ? node->count : 0;
+}
+
+static inline void node_update(Tree node)
+{
+  node->count = 1 + node_count(node->left) + node_count(node->right);
+}
+#else
+static inline void node_update(Tree node)
+{
+  (void)node;
+}
+#endif
+
+static void update_path(Tree node)
+{
+#if TREE_ORDER_STATISTICS
+  for (; node; node = node_parent(node))
+    node_update(node);
+#else
+  (void)node;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+/* Node allocator: a slab carves the nodes of a tree out of large chunks
+   and recycles removed nodes through a free list. Every function taking a
+   slab falls back on malloc/free when it is NULL. */
+
+#define TREE_SLAB_CHUNK 65536
+
+typedef union _TreeSlabChunk
+{
+  union _TreeSlabChunk *next;
+  max_align_t align; // the nodes follow the header, suitably aligned
+} TreeSlabChunk;
+
+struct _TreeSlab
+{
+  size_t size;           // payload size the slab was created for
+  size_t node_size;      // size of a node, rounded up for alignment
+  size_t chunk_nodes;    // number of nodes per chunk
+  TreeSlabChunk *chunks; // every chunk, most recent first
+  char *next;            // first never used node of the current chunk
+  char *end;             // end of the current chunk
+  void *free_list;       // released nodes, linked through their first word
+};
+
+TreeSlab *tree_slab_new(size_t size)
+{
+  TreeSlab *slab = malloc(sizeof(*slab));
+  size_t align = _Alignof(max_align_t);
+
+  if (slab)
+  {
+    slab->size = size;
+    slab->node_size = (NODE_SIZE(size) + align - 1) / align * align;
+    slab->chunk_nodes = MAX(TREE_SLAB_CHUNK / slab->node_size, 16);
+    slab->chunks = NULL;
+    slab->next = NULL;
+    slab->end = NULL;
+    slab->free_list = NULL;
+  }
+
+  return slab;
+}
+
+// Give every chunk back to the system: all the nodes are released at once
+static void tree_slab_release(TreeSlab *slab)
+{
+  while (slab->chunks)
+  {
+    TreeSlabChunk *next = slab->chunks->next;
+    free(slab->chunks);
+    slab->chunks = next;
+  }
+  slab->next = NULL;
+  slab->end = NULL;
+  slab->free_list = NULL;
+}
+
+void tree_slab_delete(TreeSlab *slab)
+{
+  if (slab)
+  {
+    tree_slab_release(slab);
+    free(slab);
+  }
+}
+
+static Tree node_alloc(TreeSlab *slab, size_t size)
+{
+  void *node;
+
+  if (!slab)
+    return malloc(NODE_SIZE(size));
+  if (size > slab->size)
+    return NULL;
+
+  if (slab->free_list)
+  {
+    node = slab->free_list;
+    slab->free_list = *(void **)node;
+    return node;
+  }
+
+  if (slab->next == slab->end)
+  {
+    TreeSlabChunk *chunk = malloc(sizeof(*chunk) + slab->chunk_nodes * slab->node_size);
+    if (!chunk)
+      return NULL;
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->next = (char *)(chunk + 1);
+    slab->end = slab->next + slab->chunk_nodes * slab->node_size;
+  }
+  node = slab->next;
+  slab->next += slab->node_size;
+  return node;
+}
+
+static void node_free(TreeSlab *slab, Tree node)
+{
+  if (!slab)
+    free(node);
+  else
+  {
+    *(void **)node = slab->free_list;
+    slab->free_list = node;
+  }
+}
+
 /*--------------------------------------------------------------------*/
 Tree tree_new()
 {
@@ -23,9 +191,49 @@ void tree_delete(Tree tree, void (*delete)(void *))
   }
 }
 
+static void delete_payloads(Tree tree, void (*delete)(void *))
+{
+  if (tree)
+  {
+    delete_payloads(tree->left, delete);
+    delete_payloads(tree->right, delete);
+    delete(tree->data);
+  }
+}
+
+void tree_delete_slab(Tree tree, TreeSlab *slab, void (*delete)(void *))
+{
+  if (!slab)
+    tree_delete(tree, delete);
+  else
+  {
+    // Only the payloads need a walk, the nodes go with their chunks
+    if (delete)
+      delete_payloads(tree, delete);
+    tree_slab_release(slab);
+  }
+}
+
+void tree_delete_into_slab(Tree tree, TreeSlab *slab, void (*delete)(void *))
+{
+  if (tree)
+  {
+    tree_delete_into_slab(tree->left, slab, delete);
+    tree_delete_into_slab(tree->right, slab, delete);
+    if (delete)
+      delete(tree->data);
+    node_free(slab, tree);
+  }
+}
+
 Tree tree_create(const void *data, size_t size)
 {
-  Tree tree = malloc(sizeof(*tree) - sizeof(tree->data) + size); // Allocate more data for the parent and the balance
+  return tree_slab_create(NULL, data, size);
+}
+
+Tree tree_slab_create(TreeSlab *slab, const void *data, size_t size)
+{
+  Tree tree = node_alloc(slab, size);
   if (tree)
   {
 
@@ -33,8 +241,9 @@ Tree tree_create(const void *data, size_t size)
     tree->right = NULL;
 
     // NEW: Parent node and balance
-    tree->parent = NULL;
-    tree->color = RED;
+    tree->parent = 0;
+    node_set_color(tree, RED);
+    node_update(tree);
 
     memcpy(tree->data, data, size);
   }
@@ -58,6 +267,22 @@ Tree tree_get_right(Tree tree)
     return NULL;
 }
 
+Tree tree_get_parent(Tree tree)
+{
+  if (tree)
+    return node_parent(tree);
+  else
+    return NULL;
+}
+
+Color tree_get_color(Tree tree)
+{
+  if (tree)
+    return node_color(tree);
+  else
+    return BLACK;
+}
+
 void *
 tree_get_data(Tree tree)
 {
@@ -75,7 +300,8 @@ bool tree_set_left(Tree tree, Tree left)
 
     // NEW: set the parent pointer for the child
     if (left)
-      left->parent = tree;
+      node_set_parent(left, tree);
+    update_path(tree);
 
     return true;
   }
@@ -91,7 +317,8 @@ bool tree_set_right(Tree tree, Tree right)
 
     // NEW: set the parent pointer for the child
     if (right)
-      right->parent = tree;
+      node_set_parent(right, tree);
+    update_path(tree);
 
     return true;
   }
@@ -146,6 +373,50 @@ void tree_post_order(Tree tree,
   }
 }
 
+Tree tree_first(Tree tree)
+{
+  if (tree)
+    while (tree->left)
+      tree = tree->left;
+  return tree;
+}
+
+Tree tree_last(Tree tree)
+{
+  if (tree)
+    while (tree->right)
+      tree = tree->right;
+  return tree;
+}
+
+Tree tree_next(Tree node)
+{
+  if (node->right)
+    return tree_first(node->right);
+  // Climb until coming from a left child
+  Tree parent = node_parent(node);
+  while (parent && node == parent->right)
+  {
+    node = parent;
+    parent = node_parent(node);
+  }
+  return parent;
+}
+
+Tree tree_prev(Tree node)
+{
+  if (node->left)
+    return tree_last(node->left);
+  // Climb until coming from a right child
+  Tree parent = node_parent(node);
+  while (parent && node == parent->left)
+  {
+    node = parent;
+    parent = node_parent(node);
+  }
+  return parent;
+}
+
 size_t
 tree_height(Tree tree)
 {
@@ -159,10 +430,69 @@ tree_height(Tree tree)
 size_t
 tree_size(Tree tree)
 {
+#if TREE_ORDER_STATISTICS
+  return node_count(tree);
+#else
   if (tree)
     return 1 + tree_size(tree->left) + tree_size(tree->right);
   else
     return 0;
+#endif
+}
+
+Tree tree_select(Tree tree, size_t k)
+{
+#if TREE_ORDER_STATISTICS
+  while (tree)
+  {
+    size_t left = node_count(tree->left);
+
+    if (k == left)
+      return tree;
+    if (k < left)
+    {
+      tree = tree->left;
+    }
+    else
+    {
+      k -= left + 1;
+      tree = tree->right;
+    }
+  }
+  return NULL;
+#else
+  for (tree = tree_first(tree); tree && k > 0; k--)
+    tree = tree_next(tree);
+  return tree;
+#endif
+}
+
+size_t tree_rank(Tree tree,
+                 const void *data,
+                 int (*compare)(const void *, const void *))
+{
+  size_t rank = 0;
+
+#if TREE_ORDER_STATISTICS
+  while (tree)
+  {
+    if (compare(tree->data, data) < 0)
+    {
+      rank += node_count(tree->left) + 1;
+      tree = tree->right;
+    }
+    else
+    {
+      tree = tree->left;
+    }
+  }
+#else
+  for (tree = tree_first(tree);
+       tree && compare(tree->data, data) < 0;
+       tree = tree_next(tree))
+    rank++;
+#endif
+  return rank;
 }
 
 void *
@@ -171,57 +501,136 @@ tree_search(Tree tree,
             int (*compare)(const void *, const void
                                              *))
 {
-  if (tree)
+  while (tree)
   {
-    switch (compare(data, tree->data))
-    {
-    case -1:
-      return tree_search(tree->left, data, compare);
-    case 0:
+    int cmp = compare(data, tree->data);
+
+    if (cmp == 0)
       return tree->data;
-    case 1:
-      return tree_search(tree->right, data, compare);
-    default:
-      return NULL; // RAJOUTE CAR WARNING !!!
+    tree = cmp < 0 ? tree->left : tree->right;
+  }
+  return NULL;
+}
+
+Tree tree_lower_bound(Tree tree,
+                      const void *data,
+                      int (*compare)(const void *, const void *))
+{
+  Tree bound = NULL;
+
+  while (tree)
+  {
+    if (compare(tree->data, data) < 0)
+    {
+      tree = tree->right;
+    }
+    else
+    {
+      bound = tree;
+      tree = tree->left;
     }
   }
-  else
-    return NULL;
+  return bound;
 }
 
-static Tree tree_search_node(Tree tree,
-                             const void *data,
-                             int (*compare)(const void *, const void *))
+Tree tree_upper_bound(Tree tree,
+                      const void *data,
+                      int (*compare)(const void *, const void *))
 {
-  if (!tree)
-    return NULL;
+  Tree bound = NULL;
+
+  while (tree)
+  {
+    if (compare(tree->data, data) <= 0)
+    {
+      tree = tree->right;
+    }
+    else
+    {
+      bound = tree;
+      tree = tree->left;
+    }
+  }
+  return bound;
+}
 
-  int cmp = compare(data, tree->data);
+Tree tree_floor(Tree tree,
+                const void *data,
+                int (*compare)(const void *, const void *))
+{
+  Tree bound = NULL;
 
-  if (cmp < 0)
-    return tree_search_node(tree->left, data, compare);
-  else if (cmp > 0)
-    return tree_search_node(tree->right, data, compare);
-  else
-    return tree; // CORRECT: Return the entire node pointer
+  while (tree)
+  {
+    if (compare(tree->data, data) > 0)
+    {
+      tree = tree->left;
+    }
+    else
+    {
+      bound = tree;
+      tree = tree->right;
+    }
+  }
+  return bound;
 }
 
-static void
-set(void *data, void *array)
+Tree tree_ceil(Tree tree,
+               const void *data,
+               int (*compare)(const void *, const void *))
+{
+  return tree_lower_bound(tree, data, compare);
+}
+
+size_t tree_range(Tree tree,
+                  const void *lo,
+                  const void *hi,
+                  int (*compare)(const void *, const void *),
+                  void (*func)(void *, void *),
+                  void *extra_data)
 {
-  static size_t size;
-  static size_t offset;
+  size_t count = 0;
 
-  if (data)
+  for (Tree node = tree_lower_bound(tree, lo, compare);
+       node && compare(node->data, hi) < 0;
+       node = tree_next(node))
   {
-    memcpy(array + offset, data, size);
-    offset += size;
+    func(node->data, extra_data);
+    count++;
   }
-  else
+  return count;
+}
+
+static Tree tree_search_node(Tree tree,
+                             const void *data,
+                             int (*compare)(const void *, const void *))
+{
+  while (tree)
   {
-    offset = 0;
-    size = *(size_t *)array;
+    int cmp = compare(data, tree->data);
+
+    if (cmp == 0)
+      return tree;
+    tree = cmp < 0 ? tree->left : tree->right;
   }
+  return NULL;
+}
+
+// Where tree_sort() copies the next payload: per call, so that sorts can
+// run concurrently
+typedef struct
+{
+  char *next;
+  size_t size;
+} SortCursor;
+
+static void
+set(void *data, void *extra_data)
+{
+  SortCursor *cursor = extra_data;
+
+  memcpy(cursor->next, data, cursor->size);
+  cursor->next += cursor->size;
 }
 
 int tree_sort(void *array,
@@ -231,23 +640,26 @@ int tree_sort(void *array,
 {
   size_t i;
   Tree tree = tree_new();
+  TreeSlab *slab = tree_slab_new(size); // NULL: fall back on malloc
   void *pointer;
 
   pointer = array;
   for (i = 0; i < length; i++)
   {
-    if (tree_insert_sorted(&tree, pointer, size,
-                           compare))
+    if (tree_insert_sorted_slab(&tree, slab, pointer, size,
+                                compare))
       pointer += size;
     else
     {
-      tree_delete(tree, NULL);
+      tree_delete_slab(tree, slab, NULL);
+      tree_slab_delete(slab);
       return false;
     }
   }
-  set(NULL, &size);
-  tree_in_order(tree, set, array);
-  tree_delete(tree, NULL);
+  SortCursor cursor = { array, size };
+  tree_in_order(tree, set, &cursor);
+  tree_delete_slab(tree, slab, NULL);
+  tree_slab_delete(slab);
   return true;
 }
 
@@ -266,23 +678,25 @@ static void rotate_left(Tree *root, Tree x)
   x->right = y->left;
   if (y->left != NULL)
   {
-    y->left->parent = x;
+    node_set_parent(y->left, x);
   }
-  y->parent = x->parent;
-  if (x->parent == NULL)
+  node_set_parent(y, node_parent(x));
+  if (node_parent(x) == NULL)
   {
     *root = y;
   }
-  else if (x == x->parent->left)
+  else if (x == node_parent(x)->left)
   {
-    x->parent->left = y;
+    node_parent(x)->left = y;
   }
   else
   {
-    x->parent->right = y;
+    node_parent(x)->right = y;
   }
   y->left = x;
-  x->parent = y;
+  node_set_parent(x, y);
+  node_update(x);
+  node_update(y);
 }
 
 /* rotate right:
@@ -298,219 +712,463 @@ static void rotate_right(Tree *root, Tree x)
   x->left = y->right;
   if (y->right != NULL)
   {
-    y->right->parent = x;
+    node_set_parent(y->right, x);
   }
-  y->parent = x->parent;
-  if (x->parent == NULL)
+  node_set_parent(y, node_parent(x));
+  if (node_parent(x) == NULL)
   {
     *root = y;
   }
-  else if (x == x->parent->right)
+  else if (x == node_parent(x)->right)
   {
-    x->parent->right = y;
+    node_parent(x)->right = y;
   }
   else
   {
-    x->parent->left = y;
+    node_parent(x)->left = y;
   }
   y->right = x;
-  x->parent = y;
+  node_set_parent(x, y);
+  node_update(x);
+  node_update(y);
 }
 
-static void tree_insert_fixup(Tree *root, Tree z);
+static bool tree_insert_fixup(Tree *root, Tree z);
 
 bool tree_insert_sorted(Tree *ptree,
                         const void *data,
                         size_t size,
                         int (*compare)(const void *, const void *))
+{
+  return tree_insert_sorted_slab(ptree, NULL, data, size, compare);
+}
+
+bool tree_insert_sorted_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             size_t size,
+                             int (*compare)(const void *, const void *))
 {
   // Step 1: Standard BST insert
-  Tree z = tree_create(data, size);
+  Tree z = tree_slab_create(slab, data, size);
   if (!z)
     return false;
 
   Tree y = NULL;
   Tree x = *ptree;
+  bool left = false;
 
+  // One comparison per level, the last one tells the side of the leaf
   while (x != NULL)
   {
     y = x;
-    if (compare(z->data, x->data) < 0)
-    {
-      x = x->left;
-    }
-    else
+    left = compare(z->data, x->data) < 0;
+    x = left ? x->left : x->right;
+  }
+
+  tree_insert_node(ptree, y, left, z);
+  return true;
+}
+
+/* Hinted insertion, a finger search from a node near the data: climb from
+   hint to the lowest subtree that must hold data, comparing only at the
+   ancestors that could bound it, then descend from the lowest climbed node
+   the descent would pass through anyway. Inserting next to the hint costs
+   O(1) comparisons. */
+static void hint_link(Tree hint, const void *data,
+                      int (*compare)(const void *, const void *),
+                      Tree *pparent, bool *pleft)
+{
+  bool after = compare(data, hint->data) >= 0;
+  Tree start = hint;
+  Tree x = hint;
+  Tree parent;
+
+  while ((parent = node_parent(x)) != NULL)
+  {
+    if (x == (after ? parent->left : parent->right))
     {
-      x = x->right;
+      if ((compare(data, parent->data) >= 0) != after)
+        break; // parent bounds the subtree of x
+      start = parent;
     }
+    x = parent;
   }
 
-  z->parent = y;
-  if (y == NULL)
+  // From start the descent goes to the side of data relative to hint
+  bool left = !after;
+  for (x = left ? start->left : start->right; x;
+       x = left ? x->left : x->right)
   {
-    *ptree = z; // Tree was empty
+    start = x;
+    left = compare(data, x->data) < 0;
   }
-  else if (compare(z->data, y->data) < 0)
+  *pparent = start;
+  *pleft = left;
+}
+
+Tree tree_insert_hint(Tree *ptree,
+                      Tree hint,
+                      const void *data,
+                      size_t size,
+                      int (*compare)(const void *, const void *))
+{
+  return tree_insert_hint_slab(ptree, NULL, hint, data, size, compare);
+}
+
+Tree tree_insert_hint_slab(Tree *ptree,
+                           TreeSlab *slab,
+                           Tree hint,
+                           const void *data,
+                           size_t size,
+                           int (*compare)(const void *, const void *))
+{
+  Tree parent = NULL;
+  bool left = false;
+
+  if (!ptree)
+    return NULL;
+
+  if (hint)
   {
-    y->left = z;
+    hint_link(hint, data, compare, &parent, &left);
   }
   else
   {
-    y->right = z;
+    for (Tree x = *ptree; x; x = left ? x->left : x->right)
+    {
+      parent = x;
+      left = compare(data, x->data) < 0;
+    }
   }
 
-  // Step 2: Call the fix-up function to restore properties
-  tree_insert_fixup(ptree, z);
+  Tree node = tree_slab_create(slab, data, size);
+  if (!node)
+    return NULL;
+  tree_insert_node(ptree, parent, left, node);
+  return node;
+}
 
-  return true;
+Tree tree_insert_rightmost(Tree *ptree,
+                           Tree *prightmost,
+                           const void *data,
+                           size_t size,
+                           int (*compare)(const void *, const void *))
+{
+  return tree_insert_rightmost_slab(ptree, NULL, prightmost, data, size,
+                                    compare);
 }
-/*
-static void tree_insert_fixup(Tree *root, Tree z)
+
+Tree tree_insert_rightmost_slab(Tree *ptree,
+                                TreeSlab *slab,
+                                Tree *prightmost,
+                                const void *data,
+                                size_t size,
+                                int (*compare)(const void *, const void *))
+{
+  if (!ptree || !prightmost)
+    return NULL;
+
+  Tree rightmost = *prightmost ? *prightmost : tree_last(*ptree);
+  Tree node;
+
+  if (rightmost && compare(data, rightmost->data) < 0)
+    return tree_insert_hint_slab(ptree, slab, rightmost, data, size,
+                                 compare);
+
+  // Appending: the data goes right of the last node, no descent
+  node = tree_slab_create(slab, data, size);
+  if (!node)
+    return NULL;
+  tree_insert_node(ptree, rightmost, false, node);
+  *prightmost = node;
+  return node;
+}
+
+/* Insert-or-find in one descent. compare() is three-way, so the descent
+   stops on an equal payload instead of running to a leaf and searching
+   again. */
+
+// Node whose payload, offset bytes into the data, equals data, or NULL and
+// the link where data belongs
+static Tree find_link(Tree tree, const void *data, size_t offset,
+                      int (*compare)(const void *, const void *),
+                      Tree *pparent, bool *pleft)
 {
-  // Loop as long as the parent of z is RED
-  while (z->parent && z->parent->color == RED)
+  Tree parent = NULL;
+  bool left = false;
+
+  while (tree)
   {
-    // Case 1: Parent is a LEFT child
-    if (z->parent == z->parent->parent->left)
-    {
-      Tree y = z->parent->parent->right; // The "uncle"
-      if (y && y->color == RED)
-      {
-        // Case 1a: Uncle is RED -> Recolor and move up
-        z->parent->color = BLACK;
-        y->color = BLACK;
-        z->parent->parent->color = RED;
-        z = z->parent->parent;
-      }
-      else
-      {
-        // Case 1b: Uncle is BLACK (or NULL)
-        if (z == z->parent->right)
-        {
-          // Case 1b-i: z is a right child -> Left rotate on parent
-          z = z->parent;
-          rotate_left(root, z);
-        }
-        // Case 1b-ii: z is a left child -> Recolor and right rotate on grandparent
-        z->parent->color = BLACK;
-        z->parent->parent->color = RED;
-        rotate_right(root, z);
-      }
-    }
-    else
-    {
-      // Case 2: Parent is a RIGHT child (symmetric to Case 1)
-      Tree y = z->parent->parent->left; // The "uncle"
-      if (y && y->color == RED)
-      {
-        // Case 2a: Uncle is RED -> Recolor and move up
-        z->parent->color = BLACK;
-        y->color = BLACK;
-        z->parent->parent->color = RED;
-        z = z->parent->parent;
-      }
-      else
-      {
-        // Case 2b: Uncle is BLACK (or NULL)
-        if (z == z->parent->left)
-        {
-          // Case 2b-i: z is a left child -> Right rotate on parent
-          z = z->parent;
-          rotate_right(root, z);
-        }
-        // Case 2b-ii: z is a right child -> Recolor and left rotate on grandparent
-        z->parent->color = BLACK;
-        z->parent->parent->color = RED;
-        rotate_left(root, z);
-      }
-    }
+    int cmp = compare(data, tree->data + offset);
+
+    if (cmp == 0)
+      return tree;
+    parent = tree;
+    left = cmp < 0;
+    tree = left ? tree->left : tree->right;
   }
-  // Final Step: Ensure the root of the entire tree is BLACK
-  (*root)->color = BLACK;
+  *pparent = parent;
+  *pleft = left;
+  return NULL;
+}
+
+Tree tree_insert_unique(Tree *ptree,
+                        const void *data,
+                        size_t size,
+                        int (*compare)(const void *, const void *),
+                        bool *inserted)
+{
+  return tree_insert_unique_slab(ptree, NULL, data, size, compare,
+                                 inserted);
+}
+
+Tree tree_insert_unique_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             size_t size,
+                             int (*compare)(const void *, const void *),
+                             bool *inserted)
+{
+  Tree parent;
+  bool left;
+  Tree node;
+
+  if (inserted)
+    *inserted = false;
+  if (!ptree)
+    return NULL;
+
+  node = find_link(*ptree, data, 0, compare, &parent, &left);
+  if (node)
+    return node;
+  node = tree_slab_create(slab, data, size);
+  if (!node)
+    return NULL;
+  tree_insert_node(ptree, parent, left, node);
+  if (inserted)
+    *inserted = true;
+  return node;
+}
+
+Tree tree_upsert(Tree *ptree,
+                 const void *data,
+                 size_t size,
+                 int (*compare)(const void *, const void *),
+                 bool *inserted)
+{
+  return tree_upsert_slab(ptree, NULL, data, size, compare, inserted);
+}
+
+Tree tree_upsert_slab(Tree *ptree,
+                      TreeSlab *slab,
+                      const void *data,
+                      size_t size,
+                      int (*compare)(const void *, const void *),
+                      bool *inserted)
+{
+  bool added;
+  Tree node = tree_insert_unique_slab(ptree, slab, data, size, compare,
+                                      &added);
+
+  // The payload compares equal: overwriting it keeps the tree sorted
+  if (node && !added)
+    memcpy(node->data, data, size);
+  if (inserted)
+    *inserted = added;
+  return node;
+}
+
+/* Multiset: equal payloads share one node holding their multiplicity, a
+   size_t stored before the payload. */
+#define MULTISET_HEADER sizeof(size_t)
+
+static size_t *multiset_count(Tree node)
+{
+  return (size_t *)node->data;
 }
-*/
 
-static void tree_insert_fixup(Tree *root, Tree z)
+void *tree_multiset_get_data(Tree node)
 {
-  while (z != *root && z->parent->color == RED)
+  return node ? node->data + MULTISET_HEADER : NULL;
+}
+
+size_t tree_multiset_get_count(Tree node)
+{
+  return node ? *multiset_count(node) : 0;
+}
+
+Tree tree_multiset_add(Tree *ptree,
+                       const void *data,
+                       size_t size,
+                       int (*compare)(const void *, const void *))
+{
+  Tree parent;
+  bool left;
+  Tree node;
+
+  if (!ptree)
+    return NULL;
+
+  node = find_link(*ptree, data, MULTISET_HEADER, compare, &parent, &left);
+  if (node)
+  {
+    (*multiset_count(node))++;
+    return node;
+  }
+  node = malloc(NODE_SIZE(MULTISET_HEADER + size));
+  if (!node)
+    return NULL;
+  *multiset_count(node) = 1;
+  memcpy(node->data + MULTISET_HEADER, data, size);
+  tree_insert_node(ptree, parent, left, node);
+  return node;
+}
+
+bool tree_multiset_remove(Tree *ptree,
+                          const void *data,
+                          int (*compare)(const void *, const void *))
+{
+  Tree parent;
+  bool left;
+  Tree node;
+
+  if (!ptree)
+    return false;
+
+  node = find_link(*ptree, data, MULTISET_HEADER, compare, &parent, &left);
+  if (!node)
+    return false;
+  if (--*multiset_count(node) == 0)
+  {
+    tree_detach_node(ptree, node);
+    free(node);
+  }
+  return true;
+}
+
+size_t tree_multiset_count(Tree tree,
+                           const void *data,
+                           int (*compare)(const void *, const void *))
+{
+  Tree parent;
+  bool left;
+
+  return tree_multiset_get_count(find_link(tree, data, MULTISET_HEADER,
+                                           compare, &parent, &left));
+}
+
+void tree_insert_node(Tree *ptree, Tree parent, bool left, Tree node)
+{
+  node->left = NULL;
+  node->right = NULL;
+  node->parent = 0;
+  node_set_parent(node, parent);
+  node_set_color(node, RED);
+  node_update(node);
+
+  if (parent == NULL)
+  {
+    *ptree = node; // Tree was empty
+  }
+  else if (left)
+  {
+    parent->left = node;
+  }
+  else
+  {
+    parent->right = node;
+  }
+  update_path(parent);
+
+  // Step 2: Call the fix-up function to restore properties
+  tree_insert_fixup(ptree, node);
+}
+
+static bool tree_insert_fixup(Tree *root, Tree z)
+{
+  while (z != *root && node_color(node_parent(z)) == RED)
   {
     // The grandparent must exist because the parent is RED, and the root is always BLACK.
-    if (z->parent == z->parent->parent->left)
+    if (node_parent(z) == node_parent(node_parent(z))->left)
     {
-      Tree y = z->parent->parent->right; // The Uncle
-      if (y && y->color == RED)
+      Tree y = node_parent(node_parent(z))->right; // The Uncle
+      if (y && node_color(y) == RED)
       {
         // Case 1: Uncle is RED -> Recolor and move up
-        z->parent->color = BLACK;
-        y->color = BLACK;
-        z->parent->parent->color = RED;
-        z = z->parent->parent;
+        node_set_color(node_parent(z), BLACK);
+        node_set_color(y, BLACK);
+        node_set_color(node_parent(node_parent(z)), RED);
+        z = node_parent(node_parent(z));
       }
       else
       {
         // Case 2: Uncle is BLACK -> Rotations needed
-        if (z == z->parent->right)
+        if (z == node_parent(z)->right)
         {
           // This handles the Left-Right case by transforming it
           // into a Left-Left case for the next iteration.
-          z = z->parent;
+          z = node_parent(z);
           rotate_left(root, z);
         }
         // This now handles the clean Left-Left case.
-        z->parent->color = BLACK;
-        z->parent->parent->color = RED;
-        rotate_right(root, z->parent->parent);
+        node_set_color(node_parent(z), BLACK);
+        node_set_color(node_parent(node_parent(z)), RED);
+        rotate_right(root, node_parent(node_parent(z)));
       }
     }
     else
     {
       // Symmetric case for when the parent is a right child
-      Tree y = z->parent->parent->left; // The Uncle
-      if (y && y->color == RED)
+      Tree y = node_parent(node_parent(z))->left; // The Uncle
+      if (y && node_color(y) == RED)
       {
         // Case 1
-        z->parent->color = BLACK;
-        y->color = BLACK;
-        z->parent->parent->color = RED;
-        z = z->parent->parent;
+        node_set_color(node_parent(z), BLACK);
+        node_set_color(y, BLACK);
+        node_set_color(node_parent(node_parent(z)), RED);
+        z = node_parent(node_parent(z));
       }
       else
       {
         // Case 2
-        if (z == z->parent->left)
+        if (z == node_parent(z)->left)
         {
           // Right-Left case -> transform to Right-Right
-          z = z->parent;
+          z = node_parent(z);
           rotate_right(root, z);
         }
         // Right-Right case
-        z->parent->color = BLACK;
-        z->parent->parent->color = RED;
-        rotate_left(root, z->parent->parent);
+        node_set_color(node_parent(z), BLACK);
+        node_set_color(node_parent(node_parent(z)), RED);
+        rotate_left(root, node_parent(node_parent(z)));
       }
     }
   }
-  // Ensure the root of the entire tree is always BLACK.
-  (*root)->color = BLACK;
+  // Ensure the root of the entire tree is always BLACK. Turning it BLACK
+  // adds one to the black height of the tree: report it.
+  bool grew = node_color(*root) == RED;
+  node_set_color(*root, BLACK);
+  return grew;
 }
 
 static void transplant(Tree *root, Tree u, Tree v)
 {
-  if (u->parent == NULL)
+  if (node_parent(u) == NULL)
   {
     *root = v;
   }
-  else if (u == u->parent->left)
+  else if (u == node_parent(u)->left)
   {
-    u->parent->left = v;
+    node_parent(u)->left = v;
   }
   else
   {
-    u->parent->right = v;
+    node_parent(u)->right = v;
   }
   if (v != NULL)
   {
-    v->parent = u->parent;
+    node_set_parent(v, node_parent(u));
   }
 }
 
@@ -527,40 +1185,40 @@ static void delete_fixup(Tree *root, Tree x, Tree x_parent)
 {
   Tree w; // Sibling
 
-  while (x != *root && (x == NULL || x->color == BLACK))
+  while (x != *root && (x == NULL || node_color(x) == BLACK))
   {
     if (x_parent->left == x)
     { // Is x a left child?
       w = x_parent->right;
-      if (w->color == RED)
+      if (node_color(w) == RED)
       { // Case 1
-        w->color = BLACK;
-        x_parent->color = RED;
+        node_set_color(w, BLACK);
+        node_set_color(x_parent, RED);
         rotate_left(root, x_parent);
         w = x_parent->right;
       }
-      if ((w->left == NULL || w->left->color == BLACK) &&
-          (w->right == NULL || w->right->color == BLACK))
+      if ((w->left == NULL || node_color(w->left) == BLACK) &&
+          (w->right == NULL || node_color(w->right) == BLACK))
       { // Case 2
-        w->color = RED;
+        node_set_color(w, RED);
         x = x_parent;
-        x_parent = x->parent; // <<< --- FIX: UPDATE THE PARENT POINTER
+        x_parent = node_parent(x); // <<< --- FIX: UPDATE THE PARENT POINTER
       }
       else
       {
-        if (w->right == NULL || w->right->color == BLACK)
+        if (w->right == NULL || node_color(w->right) == BLACK)
         { // Case 3
           if (w->left)
-            w->left->color = BLACK;
-          w->color = RED;
+            node_set_color(w->left, BLACK);
+          node_set_color(w, RED);
           rotate_right(root, w);
           w = x_parent->right;
         }
         // Case 4
-        w->color = x_parent->color;
-        x_parent->color = BLACK;
+        node_set_color(w, node_color(x_parent));
+        node_set_color(x_parent, BLACK);
         if (w->right)
-          w->right->color = BLACK;
+          node_set_color(w->right, BLACK);
         rotate_left(root, x_parent);
         x = *root;
       }
@@ -568,99 +1226,872 @@ static void delete_fixup(Tree *root, Tree x, Tree x_parent)
     else
     { // x is a right child
       w = x_parent->left;
-      if (w->color == RED)
+      if (node_color(w) == RED)
       { // Case 1
-        w->color = BLACK;
-        x_parent->color = RED;
+        node_set_color(w, BLACK);
+        node_set_color(x_parent, RED);
         rotate_right(root, x_parent);
         w = x_parent->left;
       }
-      if ((w->left == NULL || w->left->color == BLACK) &&
-          (w->right == NULL || w->right->color == BLACK))
+      if ((w->left == NULL || node_color(w->left) == BLACK) &&
+          (w->right == NULL || node_color(w->right) == BLACK))
       { // Case 2
-        w->color = RED;
+        node_set_color(w, RED);
         x = x_parent;
-        x_parent = x->parent; // <<< --- FIX: UPDATE THE PARENT POINTER
+        x_parent = node_parent(x); // <<< --- FIX: UPDATE THE PARENT POINTER
       }
       else
       {
-        if (w->left == NULL || w->left->color == BLACK)
+        if (w->left == NULL || node_color(w->left) == BLACK)
         { // Case 3
           if (w->right)
-            w->right->color = BLACK;
-          w->color = RED;
+            node_set_color(w->right, BLACK);
+          node_set_color(w, RED);
           rotate_left(root, w);
           w = x_parent->left;
         }
         // Case 4
-        w->color = x_parent->color;
-        x_parent->color = BLACK;
+        node_set_color(w, node_color(x_parent));
+        node_set_color(x_parent, BLACK);
         if (w->left)
-          w->left->color = BLACK;
+          node_set_color(w->left, BLACK);
         rotate_right(root, x_parent);
         x = *root;
       }
     }
   }
   if (x)
-    x->color = BLACK;
+    node_set_color(x, BLACK);
 }
 
 // In tree_remove_sorted, you MUST find the parent of x before the fixup call
 bool tree_remove_sorted(Tree *ptree,
                         const void *data,
                         int (*compare)(const void *, const void *))
+{
+  return tree_remove_sorted_slab(ptree, NULL, data, compare);
+}
+
+bool tree_remove_sorted_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             int (*compare)(const void *, const void *))
 {
   Tree z = tree_search_node(*ptree, data, compare);
   if (z == NULL)
     return false;
 
+  tree_detach_node(ptree, z);
+  node_free(slab, z);
+  return true;
+}
+
+Tree tree_remove_node(Tree *ptree, Tree node)
+{
+  return tree_remove_node_slab(ptree, NULL, node);
+}
+
+// No search: the links are fixed from the node up, through the parents
+Tree tree_remove_node_slab(Tree *ptree, TreeSlab *slab, Tree node)
+{
+  Tree next;
+
+  if (!ptree || !node)
+    return NULL;
+
+  next = tree_next(node);
+  tree_detach_node(ptree, node);
+  node_free(slab, node);
+  return next;
+}
+
+void tree_detach_node(Tree *ptree, Tree z)
+{
   Tree y = z;
   Tree x;
   Tree x_parent; // We need to track the parent of x
-  Color y_original_color = y->color;
+  Color y_original_color = node_color(y);
 
   if (z->left == NULL)
   {
     x = z->right;
-    x_parent = z->parent;
+    x_parent = node_parent(z);
     transplant(ptree, z, z->right);
   }
   else if (z->right == NULL)
   {
     x = z->left;
-    x_parent = z->parent;
+    x_parent = node_parent(z);
     transplant(ptree, z, z->left);
   }
   else
   {
     y = min_value_node(z->right);
-    y_original_color = y->color;
+    y_original_color = node_color(y);
     x = y->right;
 
-    if (y->parent == z)
+    if (node_parent(y) == z)
     {
       x_parent = y;
     }
     else
     {
-      x_parent = y->parent;
+      x_parent = node_parent(y);
       transplant(ptree, y, y->right);
       y->right = z->right;
-      y->right->parent = y;
+      node_set_parent(y->right, y);
     }
     transplant(ptree, z, y);
     y->left = z->left;
-    y->left->parent = y;
-    y->color = z->color;
+    node_set_parent(y->left, y);
+    node_set_color(y, node_color(z));
   }
-
-  free(z);
+  update_path(x_parent); // Every subtree from x_parent up lost a node
 
   if (y_original_color == BLACK)
   {
     delete_fixup(ptree, x, x_parent);
   }
+}
 
-  return true;
-}
\ No newline at end of file
+/* Bulk building: the nodes of a sorted sequence are linked by splitting it
+   in the middle, recursively. Every leaf of such a tree of height h lies at
+   depth h - 1 or h, so coloring the nodes at depth h red and the others
+   black gives every path the same number of black nodes. */
+static int sorted_height(size_t length)
+{
+  int height = 0;
+
+  for (; length; length >>= 1)
+    height++;
+  return height;
+}
+
+// Link nodes[0..length), in order, below parent and return their root
+static Tree link_sorted(Tree *nodes, size_t length, Tree parent,
+                        int depth, int red_depth)
+{
+  if (length == 0)
+    return NULL;
+
+  size_t mid = length / 2;
+  Tree node = nodes[mid];
+
+  node->parent = 0;
+  node_set_parent(node, parent);
+  node_set_color(node, depth == red_depth ? RED : BLACK);
+  node->left = link_sorted(nodes, mid, node, depth + 1, red_depth);
+  node->right = link_sorted(nodes + mid + 1, length - mid - 1, node,
+                            depth + 1, red_depth);
+  node_update(node);
+  return node;
+}
+
+// Link nodes[0..length), in order, into a whole tree and return its root
+static Tree link_sorted_tree(Tree *nodes, size_t length)
+{
+  int height = sorted_height(length);
+
+  // A lone root stays BLACK
+  return link_sorted(nodes, length, NULL, 1, height > 1 ? height : 0);
+}
+
+Tree tree_from_sorted(const void *array, size_t length, size_t size)
+{
+  return tree_from_sorted_slab(NULL, array, length, size);
+}
+
+Tree tree_from_sorted_slab(TreeSlab *slab,
+                           const void *array,
+                           size_t length,
+                           size_t size)
+{
+  Tree *nodes = malloc(length * sizeof(Tree));
+  Tree tree = NULL;
+  size_t i;
+
+  if (!nodes)
+    return NULL;
+  for (i = 0; i < length; i++)
+  {
+    nodes[i] = tree_slab_create(slab, (const char *)array + i * size, size);
+    if (!nodes[i])
+      break;
+  }
+  if (i == length)
+  {
+    tree = link_sorted_tree(nodes, length);
+  }
+  else
+  {
+    while (i > 0)
+      node_free(slab, nodes[--i]);
+  }
+  free(nodes);
+  return tree;
+}
+
+/* Batch insertion. Below this fraction of the tree (batch * fraction <
+   tree size) the new nodes are inserted one by one; above it, walking the
+   whole tree to merge and relink it is cheaper than the descents. */
+#define TREE_BATCH_REBUILD_FRACTION 8
+
+/* Size of the tree if it is at most limit, else some size above limit:
+   without subtree counts, the walk stops there, so that a small batch
+   never walks a large tree. */
+static size_t tree_size_up_to(Tree tree, size_t limit)
+{
+#if TREE_ORDER_STATISTICS
+  (void)limit;
+  return tree_size(tree);
+#else
+  size_t count = 0;
+
+  for (tree = tree_first(tree); tree && count <= limit;
+       tree = tree_next(tree))
+    count++;
+  return count;
+#endif
+}
+
+/* Stable merge sort of items[0..length), pointers to payloads, tmp holds
+   length pointers. Return the array holding the result, items or tmp. */
+static const void **sort_items(const void **items, const void **tmp,
+                               size_t length,
+                               int (*compare)(const void *, const void *))
+{
+  for (size_t width = 1; width < length; width *= 2)
+  {
+    for (size_t lo = 0; lo < length; lo += 2 * width)
+    {
+      size_t mid = MIN(lo + width, length);
+      size_t hi = MIN(lo + 2 * width, length);
+      size_t i = lo, j = mid, k = lo;
+
+      while (i < mid && j < hi)
+        tmp[k++] = compare(items[j], items[i]) < 0
+                   ? items[j++] : items[i++];
+      while (i < mid)
+        tmp[k++] = items[i++];
+      while (j < hi)
+        tmp[k++] = items[j++];
+    }
+    const void **swap = items;
+    items = tmp;
+    tmp = swap;
+  }
+  return items;
+}
+
+/* Insert sorted nodes, each one from the previous: climb from it while the
+   new payload does not sort before the lowest ancestor it is left of, then
+   descend as usual. Equal payloads go right, like tree_insert_sorted(). */
+static void insert_finger(Tree *ptree, Tree *nodes, size_t length,
+                          int (*compare)(const void *, const void *))
+{
+  Tree finger = NULL;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    Tree node = nodes[i];
+    Tree x = *ptree;
+    Tree parent = NULL;
+    bool left = false;
+
+    if (finger)
+    {
+      x = finger;
+      while ((parent = node_parent(x)) != NULL &&
+             (x == parent->right ||
+              compare(node->data, parent->data) >= 0))
+        x = parent;
+    }
+    for (; x; x = left ? x->left : x->right)
+    {
+      parent = x;
+      left = compare(node->data, x->data) < 0;
+    }
+    tree_insert_node(ptree, parent, left, node);
+    finger = node;
+  }
+}
+
+TreeBatchStrategy tree_insert_batch(Tree *ptree,
+                                    const void *array,
+                                    size_t length,
+                                    size_t size,
+                                    int (*compare)(const void *, const void *))
+{
+  return tree_insert_batch_slab(ptree, NULL, array, length, size, compare);
+}
+
+TreeBatchStrategy tree_insert_batch_slab(Tree *ptree,
+                                         TreeSlab *slab,
+                                         const void *array,
+                                         size_t length,
+                                         size_t size,
+                                         int (*compare)(const void *,
+                                                        const void *))
+{
+  size_t count = tree_size_up_to(*ptree,
+                                 length * TREE_BATCH_REBUILD_FRACTION);
+  bool rebuild = length * TREE_BATCH_REBUILD_FRACTION >= count;
+  const void **items = malloc(2 * length * sizeof(void *));
+  // The new nodes, then the merged nodes when rebuilding
+  Tree *nodes = malloc((rebuild ? count + 2 * length : length)
+                       * sizeof(Tree));
+  size_t i;
+
+  if (!items || !nodes)
+  {
+    free(items);
+    free(nodes);
+    return TREE_BATCH_FAILED;
+  }
+  // Sort pointers to the payloads: the nodes are then allocated in order
+  for (i = 0; i < length; i++)
+    items[i] = (const char *)array + i * size;
+  const void **sorted = sort_items(items, items + length, length, compare);
+  for (i = 0; i < length; i++)
+  {
+    nodes[i] = tree_slab_create(slab, sorted[i], size);
+    if (!nodes[i])
+    {
+      while (i > 0)
+        node_free(slab, nodes[--i]);
+      free(items);
+      free(nodes);
+      return TREE_BATCH_FAILED;
+    }
+  }
+  free(items);
+
+  if (!rebuild)
+  {
+    insert_finger(ptree, nodes, length, compare);
+    free(nodes);
+    return TREE_BATCH_FINGER;
+  }
+
+  // Merge the nodes of the tree with the new ones, the tree first on ties
+  Tree *merged = nodes + length;
+  Tree old = tree_first(*ptree);
+  size_t j = 0, k = 0;
+
+  while (old || j < length)
+  {
+    if (old && (j == length || compare(nodes[j]->data, old->data) >= 0))
+    {
+      merged[k++] = old;
+      old = tree_next(old);
+    }
+    else
+    {
+      merged[k++] = nodes[j++];
+    }
+  }
+  *ptree = link_sorted_tree(merged, count + length);
+  free(nodes);
+  return TREE_BATCH_REBUILD;
+}
+
+/* Join and split. Black heights are passed along so that a join only
+   walks down the spine of the higher tree to the black height of the other
+   one: O(difference + 1), and a split, which joins subtrees of increasing
+   black heights, stays O(log n) overall. */
+
+// Black nodes on any path from the root of tree down to a leaf
+static int black_height(Tree tree)
+{
+  int height = 0;
+
+  for (; tree; tree = tree->left)
+    height += node_color(tree) == BLACK;
+  return height;
+}
+
+/* Join left (black height bl), the node pivot and right (black height br)
+   into one tree, store its black height in *height and return it. */
+static Tree join_with(Tree left, int bl, Tree pivot, Tree right, int br,
+                      int *height)
+{
+  Tree root, c, p = NULL;
+
+  pivot->parent = 0;
+  // Both roots must be BLACK, a red root is recolored
+  if (left)
+  {
+    node_set_parent(left, NULL);
+    if (node_color(left) == RED)
+    {
+      node_set_color(left, BLACK);
+      bl++;
+    }
+  }
+  if (right)
+  {
+    node_set_parent(right, NULL);
+    if (node_color(right) == RED)
+    {
+      node_set_color(right, BLACK);
+      br++;
+    }
+  }
+
+  if (bl == br)
+  {
+    pivot->left = left;
+    pivot->right = right;
+    if (left)
+      node_set_parent(left, pivot);
+    if (right)
+      node_set_parent(right, pivot);
+    node_set_color(pivot, BLACK);
+    node_update(pivot);
+    *height = bl + 1;
+    return pivot;
+  }
+
+  // Walk down the inner spine of the higher tree to a BLACK node (or a
+  // leaf) c of the black height of the other tree, which pivot replaces
+  int b = MAX(bl, br);
+  root = c = bl > br ? left : right;
+  while (c && (node_color(c) == RED || b > MIN(bl, br)))
+  {
+    b -= node_color(c) == BLACK;
+    p = c;
+    c = bl > br ? c->right : c->left;
+  }
+  pivot->left = bl > br ? c : left;
+  pivot->right = bl > br ? right : c;
+  if (pivot->left)
+    node_set_parent(pivot->left, pivot);
+  if (pivot->right)
+    node_set_parent(pivot->right, pivot);
+  node_set_parent(pivot, p);
+  if (bl > br)
+    p->right = pivot;
+  else
+    p->left = pivot;
+  node_set_color(pivot, RED);
+  node_update(pivot);
+  update_path(p);
+
+  // A red pivot below a red node is fixed up like a fresh insertion
+  *height = MAX(bl, br) + tree_insert_fixup(&root, pivot);
+  return root;
+}
+
+/* Split tree (black height height) into the nodes before data, stored in
+   *lo, and the others, stored in *hi, with their black heights. When equal
+   is not NULL, the first node found equal to data is kept out of both
+   trees and stored there. */
+static void split_with(Tree tree, int height,
+                       const void *data,
+                       int (*compare)(const void *, const void *),
+                       Tree *lo, int *hlo, Tree *hi, int *hhi, Tree *equal)
+{
+  if (!tree)
+  {
+    *lo = *hi = NULL;
+    *hlo = *hhi = 0;
+    return;
+  }
+
+  Tree left = tree->left;
+  Tree right = tree->right;
+  int child = height - (node_color(tree) == BLACK);
+  int cmp = compare(tree->data, data);
+
+  if (equal && cmp == 0)
+  {
+    *equal = tree;
+    *lo = left;
+    *hi = right;
+    *hlo = *hhi = child;
+    if (left)
+      node_set_parent(left, NULL);
+    if (right)
+      node_set_parent(right, NULL);
+    tree->left = tree->right = NULL;
+    tree->parent = 0;
+    node_update(tree);
+  }
+  else if (cmp < 0)
+  {
+    Tree rlo;
+    int hrlo;
+
+    split_with(right, child, data, compare, &rlo, &hrlo, hi, hhi, equal);
+    *lo = join_with(left, child, tree, rlo, hrlo, hlo);
+  }
+  else
+  {
+    Tree lhi;
+    int hlhi;
+
+    split_with(left, child, data, compare, lo, hlo, &lhi, &hlhi, equal);
+    *hi = join_with(lhi, hlhi, tree, right, child, hhi);
+  }
+}
+
+Tree tree_join(Tree left, Tree pivot, Tree right)
+{
+  int height;
+
+  return join_with(left, black_height(left), pivot,
+                   right, black_height(right), &height);
+}
+
+Tree tree_concat(Tree left, Tree right)
+{
+  Tree pivot = tree_last(left);
+
+  if (!pivot)
+    return right;
+  tree_detach_node(&left, pivot);
+  return tree_join(left, pivot, right);
+}
+
+void tree_split(Tree tree,
+                const void *data,
+                int (*compare)(const void *, const void *),
+                Tree *lo,
+                Tree *hi)
+{
+  int hlo, hhi;
+
+  split_with(tree, black_height(tree), data, compare,
+             lo, &hlo, hi, &hhi, NULL);
+  // The roots of the results must be BLACK
+  if (*lo)
+    node_set_color(*lo, BLACK);
+  if (*hi)
+    node_set_color(*hi, BLACK);
+}
+
+/* Set operations, by divide and conquer over join and split: split one
+   tree around the root of the other, recurse on both sides, join the
+   results. This costs O(m log(n / m + 1)) for trees of m <= n nodes.
+
+   The two recursive calls on large subtrees run in parallel: the first one
+   is queued for a pool of at most one worker per other online processor,
+   started on the first fork and joined at the end of the operation, and
+   the caller runs the second one. A caller that finds its first task still
+   queued takes it back and runs it, so a fork costs a lock and no thread
+   creation, and no thread waits on a task that nobody runs. */
+
+// Subtrees below this black height are not worth a hand-off to a worker
+#define TREE_SET_PARALLEL_HEIGHT 12
+
+typedef enum { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE } SetOperation;
+
+typedef enum { TASK_QUEUED, TASK_RUNNING, TASK_DONE } TaskState;
+
+typedef struct _SetTask SetTask;
+
+typedef struct
+{
+  int (*compare)(const void *, const void *);
+  void (*delete_data)(void *);
+  pthread_mutex_t lock; // guards everything below
+  pthread_cond_t work;  // a task was queued, or stop
+  pthread_cond_t done;  // a task is done
+  SetTask *head, *tail; // queued tasks, oldest (largest) first
+  int queued;
+  int idle;             // workers waiting for a task
+  int workers, max_workers;
+  pthread_t *threads;
+  bool stop;
+} SetContext;
+
+struct _SetTask
+{
+  SetContext *context;
+  SetOperation operation;
+  Tree t1, t2;
+  int h1, h2;
+  Tree result;
+  int height;
+  TaskState state;
+  SetTask *prev, *next;
+};
+
+static Tree set_with(SetContext *context, SetOperation operation,
+                     Tree t1, int h1, Tree t2, int h2, int *height);
+
+static void set_task_run(SetTask *task)
+{
+  task->result = set_with(task->context, task->operation,
+                          task->t1, task->h1, task->t2, task->h2,
+                          &task->height);
+}
+
+static void unqueue(SetContext *context, SetTask *task)
+{
+  if (task->prev)
+    task->prev->next = task->next;
+  else
+    context->head = task->next;
+  if (task->next)
+    task->next->prev = task->prev;
+  else
+    context->tail = task->prev;
+  context->queued--;
+}
+
+static void *set_worker(void *arg)
+{
+  SetContext *context = arg;
+
+  pthread_mutex_lock(&context->lock);
+  while (!context->stop)
+  {
+    SetTask *task = context->head;
+
+    if (!task)
+    {
+      pthread_cond_wait(&context->work, &context->lock);
+      continue;
+    }
+    unqueue(context, task);
+    task->state = TASK_RUNNING;
+    context->idle--;
+    pthread_mutex_unlock(&context->lock);
+
+    set_task_run(task);
+
+    pthread_mutex_lock(&context->lock);
+    task->state = TASK_DONE;
+    context->idle++;
+    pthread_cond_broadcast(&context->done);
+  }
+  pthread_mutex_unlock(&context->lock);
+  return NULL;
+}
+
+// Queue task if a worker is, or can be made, idle for it
+static bool offer(SetContext *context, SetTask *task)
+{
+  bool queued = false;
+
+  pthread_mutex_lock(&context->lock);
+  if (context->queued >= context->idle &&
+      context->workers < context->max_workers &&
+      pthread_create(&context->threads[context->workers], NULL,
+                     set_worker, context) == 0)
+  {
+    context->workers++;
+    context->idle++;
+  }
+  if (context->queued < context->idle)
+  {
+    task->state = TASK_QUEUED;
+    task->prev = context->tail;
+    task->next = NULL;
+    if (context->tail)
+      context->tail->next = task;
+    else
+      context->head = task;
+    context->tail = task;
+    context->queued++;
+    pthread_cond_signal(&context->work);
+    queued = true;
+  }
+  pthread_mutex_unlock(&context->lock);
+  return queued;
+}
+
+// Run both tasks, the first one on a worker if allowed and possible
+static void run_both(SetContext *context, SetTask *a, SetTask *b,
+                     bool parallel)
+{
+  if (!parallel || context->max_workers == 0 || !offer(context, a))
+  {
+    set_task_run(a);
+    set_task_run(b);
+    return;
+  }
+  set_task_run(b);
+
+  pthread_mutex_lock(&context->lock);
+  if (a->state == TASK_QUEUED)
+  {
+    unqueue(context, a);
+    pthread_mutex_unlock(&context->lock);
+    set_task_run(a);
+    return;
+  }
+  while (a->state != TASK_DONE)
+    pthread_cond_wait(&context->done, &context->lock);
+  pthread_mutex_unlock(&context->lock);
+}
+
+static void free_node(SetContext *context, Tree node)
+{
+  if (context->delete_data)
+    context->delete_data(node->data);
+  free(node);
+}
+
+// Remove the last node of tree (of black height height) into *last,
+// return the rest
+static Tree split_last(Tree tree, int height, Tree *last, int *hrest)
+{
+  int hleft = height - (node_color(tree) == BLACK);
+  int hright = hleft;
+
+  if (!tree->right)
+  {
+    *last = tree;
+    *hrest = hleft;
+    return tree->left;
+  }
+  int h;
+  Tree rest = split_last(tree->right, hright, last, &h);
+  return join_with(tree->left, hleft, tree, rest, h, hrest);
+}
+
+// Join two trees without pivot
+static Tree join2_with(Tree left, int hl, Tree right, int hr, int *height)
+{
+  Tree last;
+
+  if (!left)
+  {
+    if (right)
+      node_set_parent(right, NULL);
+    *height = hr;
+    return right;
+  }
+  left = split_last(left, hl, &last, &hl);
+  return join_with(left, hl, last, right, hr, height);
+}
+
+static Tree set_with(SetContext *context, SetOperation operation,
+                     Tree t1, int h1, Tree t2, int h2, int *height)
+{
+  if (!t1 || !t2)
+  {
+    Tree kept = NULL;
+
+    *height = 0;
+    switch (operation)
+    {
+    case SET_UNION:
+      kept = t1 ? t1 : t2;
+      *height = t1 ? h1 : h2;
+      break;
+    case SET_INTERSECTION:
+      tree_delete(t1 ? t1 : t2, context->delete_data);
+      break;
+    case SET_DIFFERENCE:
+      tree_delete(t2, context->delete_data);
+      kept = t1;
+      *height = h1;
+      break;
+    }
+    if (kept)
+      node_set_parent(kept, NULL);
+    return kept;
+  }
+
+  // Split the other tree around the root of t1 (of t2 for a difference)
+  bool difference = operation == SET_DIFFERENCE;
+  Tree pivot = difference ? t2 : t1;
+  Tree other = difference ? t1 : t2;
+  int hpivot = difference ? h2 : h1;
+  int hleft = hpivot - (node_color(pivot) == BLACK);
+  int hright = hleft;
+  Tree lo, hi, equal = NULL;
+  int hlo, hhi;
+
+  split_with(other, difference ? h1 : h2, pivot->data, context->compare,
+             &lo, &hlo, &hi, &hhi, &equal);
+
+  // The pieces of t1 stay first
+  Tree left = pivot->left, right = pivot->right;
+  SetTask first = { .context = context, .operation = operation,
+                    .t1 = left, .t2 = lo, .h1 = hleft, .h2 = hlo };
+  SetTask second = { .context = context, .operation = operation,
+                     .t1 = right, .t2 = hi, .h1 = hright, .h2 = hhi };
+  if (difference)
+  {
+    first = (SetTask){ .context = context, .operation = operation,
+                       .t1 = lo, .t2 = left, .h1 = hlo, .h2 = hleft };
+    second = (SetTask){ .context = context, .operation = operation,
+                        .t1 = hi, .t2 = right, .h1 = hhi, .h2 = hright };
+  }
+  run_both(context, &first, &second,
+           MAX(h1, h2) >= TREE_SET_PARALLEL_HEIGHT);
+
+  bool keep = operation == SET_UNION ||
+              (operation == SET_INTERSECTION && equal);
+  if (equal)
+    free_node(context, equal);
+  if (keep)
+    return join_with(first.result, first.height, pivot,
+                     second.result, second.height, height);
+  free_node(context, pivot);
+  return join2_with(first.result, first.height,
+                    second.result, second.height, height);
+}
+
+static Tree set_operation(SetOperation operation, Tree t1, Tree t2,
+                          int (*compare)(const void *, const void *),
+                          void (*delete_data)(void *))
+{
+  SetContext context = { .compare = compare, .delete_data = delete_data };
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  int height;
+  Tree result;
+
+  pthread_mutex_init(&context.lock, NULL);
+  pthread_cond_init(&context.work, NULL);
+  pthread_cond_init(&context.done, NULL);
+  if (processors > 1)
+  {
+    context.threads = malloc((processors - 1) * sizeof(pthread_t));
+    if (context.threads)
+      context.max_workers = (int)processors - 1;
+  }
+
+  result = set_with(&context, operation, t1, black_height(t1),
+                    t2, black_height(t2), &height);
+  // A subtree kept as it is, or joined without pivot, may have a RED root
+  if (result)
+    node_set_color(result, BLACK);
+
+  pthread_mutex_lock(&context.lock);
+  context.stop = true;
+  pthread_cond_broadcast(&context.work);
+  pthread_mutex_unlock(&context.lock);
+  for (int i = 0; i < context.workers; i++)
+    pthread_join(context.threads[i], NULL);
+  free(context.threads);
+  pthread_cond_destroy(&context.done);
+  pthread_cond_destroy(&context.work);
+  pthread_mutex_destroy(&context.lock);
+  return result;
+}
+
+Tree tree_union(Tree t1, Tree t2,
+                int (*compare)(const void *, const void *),
+                void (*delete_data)(void *))
+{
+  return set_operation(SET_UNION, t1, t2, compare, delete_data);
+}
+
+Tree tree_intersection(Tree t1, Tree t2,
+                       int (*compare)(const void *, const void *),
+                       void (*delete_data)(void *))
+{
+  return set_operation(SET_INTERSECTION, t1, t2, compare, delete_data);
+}
+
+Tree tree_difference(Tree t1, Tree t2,
+                     int (*compare)(const void *, const void *),
+                     void (*delete_data)(void *))
+{
+  return set_operation(SET_DIFFERENCE, t1, t2, compare, delete_data);
+}
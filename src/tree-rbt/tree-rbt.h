@@ -3,8 +3,20 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-typedef enum { RED, BLACK } Color;
+/* Order statistics: when TREE_ORDER_STATISTICS is set (off by default),
+   every node also counts the nodes of its subtree. tree_size() is then
+   O(1), and tree_select() and tree_rank() are O(log n) instead of O(n),
+   but every insertion and removal recounts the subtrees up to the root:
+   O(log n) more, even where the rebalancing is O(1). The library and the
+   code using it must be built with the same value (CMake option
+   TREE_ORDER_STATISTICS). */
+#ifndef TREE_ORDER_STATISTICS
+#define TREE_ORDER_STATISTICS 0
+#endif
+
+typedef enum { RED, BLACK } Color; // RED must stay 0 and BLACK 1
 
 
 typedef struct _TreeNode *Tree;
@@ -13,15 +25,23 @@ struct _TreeNode
   {
     Tree left;
     Tree right;
-    Tree parent; // pointer to parent node
-
-    Color color;
-    char data[1];
+    // pointer to parent node, with the color packed in its low bit:
+    // use tree_get_parent() and tree_get_color()
+    uintptr_t parent;
+#if TREE_ORDER_STATISTICS
+    size_t count; // number of nodes of the subtree rooted here
+#endif
+    char data[]; // payload, allocated along with the node
   };
 
+/* Node allocator shared by the nodes of one tree. A slab created for a
+   payload size carves nodes out of large chunks, reuses removed nodes and
+   releases a whole tree at once. */
+typedef struct _TreeSlab TreeSlab;
+
 Tree tree_new ();
 
-void tree_delete (Tree tree, void (*delete) (void *));
+void tree_delete (Tree tree, void (*delete_data) (void *));
 
 Tree tree_create (const void *data, size_t size);
 
@@ -29,8 +49,13 @@ Tree tree_get_left (Tree tree);
 
 Tree tree_get_right (Tree tree);
 
+Tree tree_get_parent (Tree tree);
+
+Color tree_get_color (Tree tree);
+
 void *tree_get_data (Tree tree);
 
+// The setters link a child and recount the subtrees up to the root
 bool tree_set_left(Tree tree, Tree left);
 
 bool tree_set_right (Tree tree, Tree right);
@@ -50,10 +75,31 @@ void tree_post_order (Tree tree,
                       void (*func) (void *, void *),
                       void *extra_data);
 
+/* Ordered walk without callback nor recursion: tree_first() and
+   tree_last() return the smallest and the largest node of a tree,
+   tree_next() and tree_prev() the node after and before a node, all of
+   them NULL when there is none. A full walk costs O(1) per node, amortized
+   over the parent links. */
+Tree tree_first (Tree tree);
+
+Tree tree_last (Tree tree);
+
+Tree tree_next (Tree node);
+
+Tree tree_prev (Tree node);
+
 size_t tree_height (Tree tree);
 
 size_t tree_size (Tree tree);
 
+// Node of rank k (the k-th smallest, from 0), NULL if k >= tree_size()
+Tree tree_select (Tree tree, size_t k);
+
+// Number of nodes whose data is less than data
+size_t tree_rank (Tree tree,
+                  const void *data,
+                  int (*compare) (const void *, const void *));
+
 bool tree_insert_sorted(Tree * ptree,
                         const void *data,
                         size_t size,
@@ -64,6 +110,36 @@ void *tree_search (Tree tree,
                    int (*compare) (const void *, const
 void *));
 
+/* Ordered searches, O(log n). tree_lower_bound() returns the first node
+   not less than data, tree_upper_bound() the first node greater than data,
+   tree_floor() the last node not greater than data and tree_ceil() the
+   first node not less than data; NULL when there is none. */
+Tree tree_lower_bound (Tree tree,
+                       const void *data,
+                       int (*compare) (const void *, const void *));
+
+Tree tree_upper_bound (Tree tree,
+                       const void *data,
+                       int (*compare) (const void *, const void *));
+
+Tree tree_floor (Tree tree,
+                 const void *data,
+                 int (*compare) (const void *, const void *));
+
+Tree tree_ceil (Tree tree,
+                const void *data,
+                int (*compare) (const void *, const void *));
+
+// Call func on the data in [lo, hi) in order, return the number of calls
+size_t tree_range (Tree tree,
+                   const void *lo,
+                   const void *hi,
+                   int (*compare) (const void *, const void *),
+                   void (*func) (void *, void *),
+                   void *extra_data);
+
+// Sort array in place (stable). Reentrant: concurrent calls on distinct
+// arrays do not share any state.
 int tree_sort (void *array,
                size_t length,
                size_t size,
@@ -76,4 +152,227 @@ bool tree_remove_sorted(Tree *ptree,
                         const void *data,
                         int (*compare)(const void *, const void *));
 
+/* Building blocks for trees that allocate and compare their nodes
+   themselves (see tree-rbt-typed.h). tree_insert_node() links a node, with
+   room for its payload, as the left (or right) child of parent, which must
+   be free (parent NULL: the tree is empty), then restores the red-black
+   properties. tree_detach_node() unlinks a node and restores them, the node
+   is not freed. */
+void tree_insert_node(Tree *ptree, Tree parent, bool left, Tree node);
+
+void tree_detach_node(Tree *ptree, Tree node);
+
+TreeSlab *tree_slab_new (size_t size);
+
+// Release the slab and every node still allocated from it
+void tree_slab_delete (TreeSlab *slab);
+
+// Same as the functions above, nodes being allocated from slab (or with
+// malloc when slab is NULL)
+Tree tree_slab_create (TreeSlab *slab, const void *data, size_t size);
+
+bool tree_insert_sorted_slab(Tree * ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             size_t size,
+                             int (*compare) (const void *, const void *));
+
+bool tree_remove_sorted_slab(Tree *ptree,
+                             TreeSlab *slab,
+                             const void *data,
+                             int (*compare)(const void *, const void *));
+
+// Delete a tree whose nodes all come from slab. Without a payload
+// destructor this costs O(number of chunks): the slab must not hold the
+// nodes of another tree.
+void tree_delete_slab (Tree tree, TreeSlab *slab, void (*delete_data) (void *));
+
+// Delete a tree node by node, each node going back to slab for reuse: O(n),
+// the other nodes of the slab stay allocated
+void tree_delete_into_slab (Tree tree,
+                            TreeSlab *slab,
+                            void (*delete_data) (void *));
+
+/* Build a tree from length payloads of size bytes, already sorted, in
+   O(n): the nodes are allocated in one pass and linked into a perfectly
+   balanced tree, with no comparison and no rebalancing. NULL if length is
+   0 or an allocation fails. */
+Tree tree_from_sorted (const void *array, size_t length, size_t size);
+
+Tree tree_from_sorted_slab (TreeSlab *slab,
+                            const void *array,
+                            size_t length,
+                            size_t size);
+
+/* Strategy chosen by tree_insert_batch() */
+typedef enum
+  {
+    TREE_BATCH_FAILED,  // allocation failure: the tree is unchanged
+    TREE_BATCH_FINGER,  // inserted in order, each from the previous one
+    TREE_BATCH_REBUILD  // merged with the nodes of the tree, relinked
+  } TreeBatchStrategy;
+
+/* Insert length payloads of size bytes, in any order. The new nodes are
+   sorted (stable merge sort), then either merged with an in-order walk of
+   the tree and relinked in O(n + length) when the batch is large compared
+   with the tree, or inserted one after the other with a descent starting
+   from the previous insertion point. */
+TreeBatchStrategy tree_insert_batch (Tree * ptree,
+                                     const void *array,
+                                     size_t length,
+                                     size_t size,
+                                     int (*compare) (const void *,
+                                                     const void *));
+
+TreeBatchStrategy tree_insert_batch_slab (Tree * ptree,
+                                          TreeSlab *slab,
+                                          const void *array,
+                                          size_t length,
+                                          size_t size,
+                                          int (*compare) (const void *,
+                                                          const void *));
+
+/* Join and split in O(log n), the nodes are moved, not copied.
+   tree_join() links the trees left and right with the node pivot between
+   them and returns the result: the payloads of left must sort before the
+   one of pivot, and the payloads of right not before it. pivot must be a
+   node on its own, e.g. from tree_create() or tree_detach_node().
+   tree_concat() joins two such trees without pivot. */
+Tree tree_join (Tree left, Tree pivot, Tree right);
+
+Tree tree_concat (Tree left, Tree right);
+
+/* Split tree into *lo, holding the nodes whose payloads sort before data,
+   and *hi, holding the others. */
+void tree_split (Tree tree,
+                 const void *data,
+                 int (*compare) (const void *, const void *),
+                 Tree * lo,
+                 Tree * hi);
+
+/* Set operations by join and split, in O(m log(n / m + 1)) for trees of
+   m <= n nodes; large subtrees are processed in parallel on the online
+   processors. t1 and t2 must be sorted by compare and hold unique payloads.
+   Both trees are consumed: the nodes of the result are the ones of t1 and
+   t2 (those of t1 on equal payloads), the other nodes are released with
+   delete_data(), possibly from several threads at once, then free(). The
+   nodes must come from malloc(), not from a slab. */
+Tree tree_union (Tree t1,
+                 Tree t2,
+                 int (*compare) (const void *, const void *),
+                 void (*delete_data) (void *));
+
+Tree tree_intersection (Tree t1,
+                        Tree t2,
+                        int (*compare) (const void *, const void *),
+                        void (*delete_data) (void *));
+
+// Nodes of t1 whose payloads are not in t2
+Tree tree_difference (Tree t1,
+                      Tree t2,
+                      int (*compare) (const void *, const void *),
+                      void (*delete_data) (void *));
+
+/* Insertion starting from hint, a node of *ptree near data (or NULL to
+   start from the root): the search climbs from hint only as far as needed,
+   so inserting next to the previous insertion costs O(1) comparisons.
+   Return the new node, the natural hint for the next insertion, or NULL if
+   the allocation failed. */
+Tree tree_insert_hint (Tree * ptree,
+                       Tree hint,
+                       const void *data,
+                       size_t size,
+                       int (*compare) (const void *, const void *));
+
+Tree tree_insert_hint_slab (Tree * ptree,
+                            TreeSlab *slab,
+                            Tree hint,
+                            const void *data,
+                            size_t size,
+                            int (*compare) (const void *, const void *));
+
+/* Insertion for streams of mostly increasing payloads. *prightmost caches
+   the last node of *ptree (NULL: looked up): a payload not sorting before
+   it is linked as its right child with a single comparison and becomes the
+   new last node, other payloads are inserted with it as hint. */
+Tree tree_insert_rightmost (Tree * ptree,
+                            Tree * prightmost,
+                            const void *data,
+                            size_t size,
+                            int (*compare) (const void *, const void *));
+
+Tree tree_insert_rightmost_slab (Tree * ptree,
+                                 TreeSlab *slab,
+                                 Tree * prightmost,
+                                 const void *data,
+                                 size_t size,
+                                 int (*compare) (const void *,
+                                                 const void *));
+
+/* Insert-or-find in a single descent: return the node whose payload
+   compares equal to data if there is one, else a new node holding a copy
+   of data (NULL if the allocation failed). *inserted, unless inserted is
+   NULL, tells which one. */
+Tree tree_insert_unique (Tree * ptree,
+                         const void *data,
+                         size_t size,
+                         int (*compare) (const void *, const void *),
+                         bool *inserted);
+
+Tree tree_insert_unique_slab (Tree * ptree,
+                              TreeSlab *slab,
+                              const void *data,
+                              size_t size,
+                              int (*compare) (const void *, const void *),
+                              bool *inserted);
+
+// Same, the payload of an existing node being overwritten with data. The
+// old payload is not released.
+Tree tree_upsert (Tree * ptree,
+                  const void *data,
+                  size_t size,
+                  int (*compare) (const void *, const void *),
+                  bool *inserted);
+
+Tree tree_upsert_slab (Tree * ptree,
+                       TreeSlab *slab,
+                       const void *data,
+                       size_t size,
+                       int (*compare) (const void *, const void *),
+                       bool *inserted);
+
+/* Multiset: equal payloads share one node counting them instead of being
+   stored as duplicate nodes. A multiset tree only holds nodes from
+   tree_multiset_add(), whose data starts with the count: read them with
+   tree_multiset_get_data() and tree_multiset_get_count(), not
+   tree_get_data(). It is walked with tree_first() and tree_next() and
+   released with tree_delete (tree, NULL). */
+void *tree_multiset_get_data (Tree node);
+
+size_t tree_multiset_get_count (Tree node);
+
+// Add one occurrence of data, return its node (NULL if allocation failed)
+Tree tree_multiset_add (Tree * ptree,
+                        const void *data,
+                        size_t size,
+                        int (*compare) (const void *, const void *));
+
+// Remove one occurrence of data, the node with the last one
+bool tree_multiset_remove (Tree * ptree,
+                           const void *data,
+                           int (*compare) (const void *, const void *));
+
+// Number of occurrences of data
+size_t tree_multiset_count (Tree tree,
+                            const void *data,
+                            int (*compare) (const void *, const void *));
+
+/* Remove node, a node of *ptree from a previous search or walk, without
+   searching for it again: only the rebalancing walks up from the node.
+   The payload is not released. Return the node that followed it, so that
+   a walk can remove as it goes. */
+Tree tree_remove_node (Tree * ptree, Tree node);
+
+Tree tree_remove_node_slab (Tree * ptree, TreeSlab *slab, Tree node);
+
 #endif
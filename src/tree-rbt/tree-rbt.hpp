@@ -0,0 +1,296 @@
+#ifndef _TREE_RBT_HPP_
+#define _TREE_RBT_HPP_
+
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "tree-rbt.h"
+}
+
+/* Header-only C++ map over the red-black tree (C++17).
+
+   Values are constructed in place in the payload of the nodes, so a value
+   is never copied into the tree, move-only values are supported and values
+   are destroyed by their destructor. The comparator is a function object
+   called directly, it is inlined in the search loops. Linking and
+   rebalancing are the ones of the C tree (tree_insert_node() and
+   tree_detach_node()).
+
+   Keys are unique. Nodes never move: references and iterators stay valid
+   until their element is erased. */
+namespace rbt {
+
+template <class Key, class T, class Compare = std::less<Key>>
+class map {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using key_compare = Compare;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+private:
+    static_assert(alignof(value_type) <= alignof(struct _TreeNode),
+                  "value type is over-aligned for tree nodes");
+
+    static value_type &value(Tree node) {
+        return *std::launder(reinterpret_cast<value_type *>(node->data));
+    }
+
+    static const Key &key(Tree node) {
+        return value(node).first;
+    }
+
+    template <class V>
+    class basic_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = V;
+        using difference_type = std::ptrdiff_t;
+        using pointer = V *;
+        using reference = V &;
+
+        basic_iterator() = default;
+        // An iterator converts to a const_iterator, not the other way
+        template <class W, class = std::enable_if_t<
+                               !std::is_const_v<W> &&
+                               std::is_same_v<const W, V>>>
+        basic_iterator(const basic_iterator<W> &other) : node_(other.node_) {}
+
+        reference operator*() const { return value(node_); }
+        pointer operator->() const { return &value(node_); }
+
+        basic_iterator &operator++() {
+            node_ = tree_next(node_);
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator old = *this;
+            node_ = tree_next(node_);
+            return old;
+        }
+
+        friend bool operator==(basic_iterator a, basic_iterator b) {
+            return a.node_ == b.node_;
+        }
+        friend bool operator!=(basic_iterator a, basic_iterator b) {
+            return a.node_ != b.node_;
+        }
+
+    private:
+        friend class map;
+        template <class W> friend class basic_iterator;
+
+        explicit basic_iterator(Tree node) : node_(node) {}
+
+        Tree node_ = nullptr;
+    };
+
+public:
+    using iterator = basic_iterator<value_type>;
+    using const_iterator = basic_iterator<const value_type>;
+
+    map() = default;
+    explicit map(const Compare &compare) : compare_(compare) {}
+
+    map(const map &) = delete;
+    map &operator=(const map &) = delete;
+
+    map(map &&other) noexcept
+        : root_(std::exchange(other.root_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          compare_(std::move(other.compare_)) {}
+
+    map &operator=(map &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root_ = std::exchange(other.root_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            compare_ = std::move(other.compare_);
+        }
+        return *this;
+    }
+
+    ~map() { clear(); }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator begin() { return iterator(tree_first(root_)); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(tree_first(root_)); }
+    const_iterator end() const { return const_iterator(); }
+
+    iterator find(const Key &k) { return iterator(find_node(k)); }
+    const_iterator find(const Key &k) const {
+        return const_iterator(find_node(k));
+    }
+
+    bool contains(const Key &k) const { return find_node(k) != nullptr; }
+
+    T &at(const Key &k) {
+        Tree node = find_node(k);
+        if (!node)
+            throw std::out_of_range("rbt::map::at");
+        return value(node).second;
+    }
+
+    const T &at(const Key &k) const {
+        Tree node = find_node(k);
+        if (!node)
+            throw std::out_of_range("rbt::map::at");
+        return value(node).second;
+    }
+
+    T &operator[](const Key &k) { return try_emplace(k).first->second; }
+    T &operator[](Key &&k) { return try_emplace(std::move(k)).first->second; }
+
+    // Construct the value in place, then link it unless its key is present
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+        Tree node = make_node(std::forward<Args>(args)...);
+        Tree parent;
+        bool left;
+        if (Tree found = find_link(key(node), parent, left)) {
+            destroy_node(node);
+            return { iterator(found), false };
+        }
+        link(parent, left, node);
+        return { iterator(node), true };
+    }
+
+    // Construct the value in place only if the key is absent
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace(K &&k, Args &&...args) {
+        Tree parent;
+        bool left;
+        if (Tree found = find_link(k, parent, left))
+            return { iterator(found), false };
+        Tree node = make_node(std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<K>(k)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        link(parent, left, node);
+        return { iterator(node), true };
+    }
+
+    std::pair<iterator, bool> insert(value_type &&v) {
+        return emplace(std::move(v));
+    }
+
+    std::pair<iterator, bool> insert(const value_type &v) {
+        return emplace(v);
+    }
+
+    iterator erase(const_iterator position) {
+        Tree node = position.node_;
+        Tree following = tree_next(node);
+        tree_detach_node(&root_, node);
+        size_--;
+        destroy_node(node);
+        return iterator(following);
+    }
+
+    size_type erase(const Key &k) {
+        Tree node = find_node(k);
+        if (!node)
+            return 0;
+        erase(const_iterator(node));
+        return 1;
+    }
+
+    void clear() {
+        destroy_tree(root_);
+        root_ = nullptr;
+        size_ = 0;
+    }
+
+    // The underlying C tree, e.g. for tree_height()
+    Tree tree() const { return root_; }
+
+private:
+    template <class K>
+    Tree find_node(const K &k) const {
+        Tree node = root_;
+        while (node) {
+            if (compare_(k, key(node)))
+                node = node->left;
+            else if (compare_(key(node), k))
+                node = node->right;
+            else
+                return node;
+        }
+        return nullptr;
+    }
+
+    // Return the node holding k, or NULL and the link where k belongs.
+    // One comparison per level: the last node not greater than k is
+    // checked for equality once at the bottom.
+    template <class K>
+    Tree find_link(const K &k, Tree &parent, bool &left) const {
+        Tree candidate = nullptr;
+        parent = nullptr;
+        left = false;
+        for (Tree node = root_; node; node = left ? node->left : node->right) {
+            parent = node;
+            left = compare_(k, key(node));
+            if (!left)
+                candidate = node;
+        }
+        if (candidate && !compare_(key(candidate), k))
+            return candidate;
+        return nullptr;
+    }
+
+    template <class... Args>
+    static Tree make_node(Args &&...args) {
+        void *memory = std::malloc(offsetof(struct _TreeNode, data) +
+                                   sizeof(value_type));
+        if (!memory)
+            throw std::bad_alloc();
+        Tree node = static_cast<Tree>(memory);
+        try {
+            ::new (static_cast<void *>(node->data))
+                value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            std::free(memory);
+            throw;
+        }
+        return node;
+    }
+
+    static void destroy_node(Tree node) {
+        value(node).~value_type();
+        std::free(node);
+    }
+
+    static void destroy_tree(Tree node) {
+        if (node) {
+            destroy_tree(node->left);
+            destroy_tree(node->right);
+            destroy_node(node);
+        }
+    }
+
+    void link(Tree parent, bool left, Tree node) {
+        tree_insert_node(&root_, parent, left, node);
+        size_++;
+    }
+
+    Tree root_ = nullptr;
+    size_type size_ = 0;
+    Compare compare_;
+};
+
+} // namespace rbt
+
+#endif